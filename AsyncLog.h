@@ -0,0 +1,325 @@
+#ifndef ASYNC_LOG_H
+#define ASYNC_LOG_H
+
+#include "LogFile.h"
+#include "OutputSink.h"
+#include <iostream>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <string>
+using namespace std;
+
+// What a producer does when the ring is full
+enum class OverflowPolicy {
+    BLOCK,  // Wait for the writer thread to make room
+    DROP,   // Discard the record; only getDroppedCount() shows it
+    COUNT   // Discard the record and write a "dropped N records" line once room returns
+};
+
+// One formatted log line, or one piece of a longer one: a line is cut into MAX_TEXT-byte
+// segments that go into consecutive slots, every one but the last marked `more`
+struct LogRecord {
+    static const int MAX_TEXT = 248;
+    uint16_t length;
+    bool more;
+    char text[MAX_TEXT];
+
+    // Slots a line of `length` bytes takes
+    static size_t segments(int length) {
+        return length > MAX_TEXT ? (size_t)(length + MAX_TEXT - 1) / MAX_TEXT : 1;
+    }
+
+    // Segment `index` of `count`; a line cut short to fit `count` slots loses its tail
+    void assign(const char* s, int len, size_t index = 0, size_t count = 1) {
+        int start = (int)index * MAX_TEXT;
+        int piece = len - start;
+        if(piece > MAX_TEXT) piece = MAX_TEXT;
+        if(piece < 0) piece = 0;
+        memcpy(text, s + start, piece);
+        length = (uint16_t)piece;
+        more = index + 1 < count;
+    }
+};
+
+// Bounded lock-free multi-producer/single-consumer queue (per-cell sequence numbers)
+template<typename T>
+class MpscRingBuffer {
+private:
+    struct Cell {
+        atomic<size_t> sequence;
+        T value;
+    };
+
+    Cell* cells;
+    size_t mask;
+    alignas(64) atomic<size_t> head; // Next slot producers claim
+    alignas(64) size_t tail;         // Next slot the consumer reads
+
+public:
+    // Capacity is rounded up to a power of two
+    MpscRingBuffer(size_t capacity) : head(0), tail(0) {
+        size_t size = 2;
+        while(size < capacity) size <<= 1;
+        cells = new Cell[size];
+        mask = size - 1;
+        for(size_t i = 0; i < size; i++) {
+            cells[i].sequence.store(i, memory_order_relaxed);
+        }
+    }
+
+    ~MpscRingBuffer() {
+        delete[] cells;
+    }
+
+    MpscRingBuffer(const MpscRingBuffer&) = delete;
+    MpscRingBuffer& operator=(const MpscRingBuffer&) = delete;
+
+    // Claims `count` consecutive slots (at most capacity()) and calls fill(value, i) for
+    // each, so the consumer reads them back to back. Returns false if they are not all free.
+    template<typename Fill>
+    bool tryPush(size_t count, Fill fill) {
+        size_t pos = head.load(memory_order_relaxed);
+        for(;;) {
+            size_t seq = cells[pos & mask].sequence.load(memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if(diff == 0) {
+                // The consumer frees slots in order, so the last one being free means all are
+                size_t last = pos + count - 1;
+                if(count > 1 && cells[last & mask].sequence.load(memory_order_acquire) != last) return false;
+                if(head.compare_exchange_weak(pos, pos + count, memory_order_relaxed)) break;
+            } else if(diff < 0) {
+                return false;
+            } else {
+                pos = head.load(memory_order_relaxed);
+            }
+        }
+        for(size_t i = 0; i < count; i++) {
+            Cell& cell = cells[(pos + i) & mask];
+            fill(cell.value, i);
+            cell.sequence.store(pos + i + 1, memory_order_release);
+        }
+        return true;
+    }
+
+    // Consumer only; returns nullptr when empty. Call release() after using the value.
+    T* front() {
+        Cell* cell = &cells[tail & mask];
+        size_t seq = cell->sequence.load(memory_order_acquire);
+        if((intptr_t)seq - (intptr_t)(tail + 1) < 0) return nullptr;
+        return &cell->value;
+    }
+
+    void release() {
+        cells[tail & mask].sequence.store(tail + mask + 1, memory_order_release);
+        tail++;
+    }
+
+    size_t capacity() const { return mask + 1; }
+
+    // Slots claimed so far; every one of them will be published
+    size_t claimed() const { return head.load(memory_order_acquire); }
+};
+
+// Log2 histogram with 8 linear sub-buckets per power of two (about 12% resolution)
+class LatencyHistogram {
+private:
+    static const int BUCKETS = 496;
+    atomic<uint64_t> counts[BUCKETS];
+
+    static int bucketOf(uint64_t v) {
+        if(v < 8) return (int)v;
+        int p = 63 - __builtin_clzll(v);
+        return (p - 2) * 8 + (int)((v >> (p - 3)) & 7);
+    }
+
+    static uint64_t lowerBound(int bucket) {
+        if(bucket < 8) return (uint64_t)bucket;
+        int p = bucket / 8 + 2;
+        return (uint64_t)(8 + bucket % 8) << (p - 3);
+    }
+
+public:
+    LatencyHistogram() {
+        reset();
+    }
+
+    void reset() {
+        for(int i = 0; i < BUCKETS; i++) counts[i].store(0, memory_order_relaxed);
+    }
+
+    void record(uint64_t nanos) {
+        counts[bucketOf(nanos)].fetch_add(1, memory_order_relaxed);
+    }
+
+    uint64_t total() const {
+        uint64_t n = 0;
+        for(int i = 0; i < BUCKETS; i++) n += counts[i].load(memory_order_relaxed);
+        return n;
+    }
+
+    // Lower edge of the bucket holding the given fraction (0..1) of samples
+    uint64_t percentile(double fraction) const {
+        uint64_t n = total();
+        if(n == 0) return 0;
+        uint64_t rank = (uint64_t)(fraction * (n - 1));
+        uint64_t seen = 0;
+        for(int i = 0; i < BUCKETS; i++) {
+            seen += counts[i].load(memory_order_relaxed);
+            if(seen > rank) return lowerBound(i);
+        }
+        return lowerBound(BUCKETS - 1);
+    }
+};
+
+// Background thread that drains the ring and writes whole batches to the log file and console
+class AsyncLogWriter {
+private:
+    static const int BATCH_BYTES = 64 * 1024;
+
+    MpscRingBuffer<LogRecord> ring;
+    OverflowPolicy policy;
+    LogFile& file;
+    atomic<bool> echoToConsole;
+
+    thread worker;
+    mutex wakeMutex;
+    condition_variable wake;
+    atomic<bool> sleeping;
+    atomic<bool> stopping;
+    atomic<uint64_t> dropped;
+    uint64_t droppedReported;
+
+    mutex flushMutex;
+    condition_variable flushed;
+    size_t written; // Ring slots whose records have reached the file
+
+    // Writes the batch's whole lines; a line whose later segments are still being filled
+    // in stays behind for the next batch
+    void flushBatch(string& batch) {
+        size_t whole = batch.rfind('\n') + 1; // 0 when there is no line end at all
+        if(whole == 0) return;
+        if(echoToConsole.load(memory_order_relaxed)) {
+            lock_guard<mutex> lock(consoleMutex());
+            cout.write(batch.data(), whole);
+            cout.flush();
+        }
+        if(file.is_open()) {
+            file.write(batch.data(), whole);
+            file.flush();
+        }
+        batch.erase(0, whole);
+    }
+
+    void run() {
+        string batch;
+        batch.reserve(BATCH_BYTES + LogRecord::MAX_TEXT + 64);
+        size_t consumed = 0;
+        for(;;) {
+            CoarseClock::tick();
+            bool drained = false;
+            while(LogRecord* rec = ring.front()) {
+                batch.append(rec->text, rec->length);
+                bool lineEnds = !rec->more;
+                if(lineEnds) batch.push_back('\n');
+                ring.release();
+                consumed++;
+                drained = true;
+                // Batches end on whole lines, which is where LogFile splits for rotation
+                if(lineEnds && (int)batch.size() >= BATCH_BYTES) flushBatch(batch);
+            }
+
+            bool midLine = !batch.empty() && batch.back() != '\n';
+            if(policy == OverflowPolicy::COUNT && !midLine) {
+                uint64_t lost = dropped.load(memory_order_relaxed);
+                if(lost != droppedReported) {
+                    batch += "[logger] dropped " + to_string(lost - droppedReported) + " records\n";
+                    droppedReported = lost;
+                }
+            }
+            flushBatch(batch);
+            {
+                lock_guard<mutex> lock(flushMutex);
+                written = consumed;
+            }
+            flushed.notify_all();
+
+            if(drained) continue;
+            if(stopping.load(memory_order_acquire)) {
+                // Producers are done; one last pass picks up anything published before stop
+                if(!ring.front()) break;
+                continue;
+            }
+
+            unique_lock<mutex> lock(wakeMutex);
+            sleeping.store(true, memory_order_seq_cst);
+            if(!ring.front() && !stopping.load(memory_order_acquire)) {
+                wake.wait_for(lock, chrono::milliseconds(5));
+            }
+            sleeping.store(false, memory_order_relaxed);
+        }
+    }
+
+public:
+    AsyncLogWriter(LogFile& logFile, size_t capacity, OverflowPolicy overflow, bool echo = true)
+        : ring(capacity), policy(overflow), file(logFile), echoToConsole(echo),
+          sleeping(false), stopping(false), dropped(0), droppedReported(0), written(0) {
+        worker = thread(&AsyncLogWriter::run, this);
+    }
+
+    // Drains everything still queued before returning
+    ~AsyncLogWriter() {
+        stopping.store(true, memory_order_release);
+        {
+            lock_guard<mutex> lock(wakeMutex);
+            wake.notify_one();
+        }
+        worker.join();
+    }
+
+    AsyncLogWriter(const AsyncLogWriter&) = delete;
+    AsyncLogWriter& operator=(const AsyncLogWriter&) = delete;
+
+    // Returns false if the record was dropped by the overflow policy. A line longer than
+    // LogRecord::MAX_TEXT takes several slots; one longer than the whole ring is cut to fit.
+    bool push(const char* text, int length) {
+        size_t count = LogRecord::segments(length);
+        if(count > ring.capacity()) count = ring.capacity();
+        auto fill = [&](LogRecord& rec, size_t i) { rec.assign(text, length, i, count); };
+        while(!ring.tryPush(count, fill)) {
+            if(policy != OverflowPolicy::BLOCK) {
+                dropped.fetch_add(1, memory_order_relaxed);
+                return false;
+            }
+            this_thread::yield();
+        }
+        if(sleeping.load(memory_order_seq_cst)) {
+            lock_guard<mutex> lock(wakeMutex);
+            wake.notify_one();
+        }
+        return true;
+    }
+
+    // Waits until every record pushed before the call has been written; the thread keeps running
+    void flush() {
+        size_t target = ring.claimed();
+        {
+            lock_guard<mutex> lock(wakeMutex);
+            wake.notify_one();
+        }
+        unique_lock<mutex> lock(flushMutex);
+        flushed.wait(lock, [&] { return written >= target; });
+    }
+
+    void setConsoleEcho(bool echo) { echoToConsole.store(echo, memory_order_relaxed); }
+
+    uint64_t getDroppedCount() const { return dropped.load(memory_order_relaxed); }
+    size_t getCapacity() const { return ring.capacity(); }
+};
+
+#endif
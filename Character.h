@@ -3,6 +3,7 @@
 
 #include "Entity.h"
 #include "Item.h"
+#include "CombatRules.h"
 #include "String.h"
 #include <vector>
 
@@ -39,30 +40,29 @@ public:
     
     // Override virtual functions
     virtual void display() const override {
-        cout << "Character: " << name << " (Level " << level << ")" << endl;
-        cout << "Health: " << health << "/" << maxHealth << endl;
-        cout << "Mana: " << mana << "/" << maxMana << endl;
-        cout << "Attack: " << attack << ", Defense: " << defense << endl;
-        cout << "Experience: " << experience << endl;
-        cout << "Inventory (" << inventory.size() << " items):" << endl;
+        gameOutput << "Character: " << name << " (Level " << level << ")\n";
+        gameOutput << "Health: " << health << "/" << maxHealth << "\n";
+        gameOutput << "Mana: " << mana << "/" << maxMana << "\n";
+        gameOutput << "Attack: " << attack << ", Defense: " << defense << "\n";
+        gameOutput << "Experience: " << experience << "\n";
+        gameOutput << "Inventory (" << inventory.size() << " items):\n";
         for(const Item* item : inventory) {
-            cout << "  - " << item->getName() << endl;
+            gameOutput << "  - " << item->getName() << "\n";
         }
     }
     
     virtual bool interact() override {
-        cout << "You examine yourself." << endl;
+        gameOutput << "You examine yourself.\n";
         display();
         return true;
     }
     
     // Combat methods
     void takeDamage(int damage) {
-        int actualDamage = damage - defense;
-        if (actualDamage < 0) actualDamage = 0;
-        health -= actualDamage;
-        if (health < 0) health = 0;
-        cout << name << " takes " << actualDamage << " damage! (Health: " << health << "/" << maxHealth << ")" << endl;
+        int actualDamage = CombatRules::absorb(damage, defense);
+        int left = health - actualDamage;
+        assign(health, left > 0 ? left : 0, StateHash::HEALTH);
+        gameOutput << name << " takes " << actualDamage << " damage! (Health: " << health << "/" << maxHealth << ")\n";
     }
     
     int dealDamage() const {
@@ -76,12 +76,14 @@ public:
     // Item management
     void addItem(Item* item) {
         inventory.push_back(item);
-        cout << "Added " << item->getName() << " to inventory." << endl;
+        if(stateHash) item->attachHash(stateHash, StateHash::subject(StateHash::CARRIED, item->getId()));
+        gameOutput << "Added " << item->getName() << " to inventory.\n";
     }
     
     bool removeItem(int itemId) {
         for(auto it = inventory.begin(); it != inventory.end(); ++it) {
             if((*it)->getId() == itemId) {
+                (*it)->attachHash(nullptr, 0);
                 delete *it;
                 inventory.erase(it);
                 return true;
@@ -112,21 +114,21 @@ public:
     bool useItem(const String& itemName) {
         Item* item = findItem(itemName);
         if(!item) {
-            cout << "Item not found in inventory." << endl;
+            gameOutput << "Item not found in inventory.\n";
             return false;
         }
         
         switch(item->getType()) {
             case ItemType::HEALTH_POTION:
                 heal(item->getValue());
-                cout << "Used " << itemName << " and restored " << item->getValue() << " health." << endl;
+                gameOutput << "Used " << itemName << " and restored " << item->getValue() << " health.\n";
                 break;
             case ItemType::MANA_POTION:
                 restoreMana(item->getValue());
-                cout << "Used " << itemName << " and restored " << item->getValue() << " mana." << endl;
+                gameOutput << "Used " << itemName << " and restored " << item->getValue() << " mana.\n";
                 break;
             default:
-                cout << "Cannot use " << itemName << " directly." << endl;
+                gameOutput << "Cannot use " << itemName << " directly.\n";
                 return false;
         }
         
@@ -138,19 +140,17 @@ public:
     
     // Healing and mana restoration
     void heal(int amount) {
-        health += amount;
-        if(health > maxHealth) health = maxHealth;
+        assign(health, health + amount < maxHealth ? health + amount : maxHealth, StateHash::HEALTH);
     }
     
     void restoreMana(int amount) {
-        mana += amount;
-        if(mana > maxMana) mana = maxMana;
+        assign(mana, mana + amount < maxMana ? mana + amount : maxMana, StateHash::MANA);
     }
     
     // Level up system
     void gainExperience(int exp) {
-        experience += exp;
-        cout << "Gained " << exp << " experience!" << endl;
+        assign(experience, experience + exp, StateHash::EXPERIENCE);
+        gameOutput << "Gained " << exp << " experience!\n";
         
         // Level up logic
         int expNeeded = level * 100;
@@ -160,21 +160,21 @@ public:
     }
     
     void levelUp() {
-        level++;
-        experience = 0;
-        maxHealth += 20;
-        maxMana += 10;
-        attack += 5;
-        defense += 3;
-        health = maxHealth; // Full heal on level up
-        mana = maxMana;
-        cout << "Level up! You are now level " << level << "!" << endl;
+        assign(level, level + 1, StateHash::LEVEL);
+        assign(experience, 0, StateHash::EXPERIENCE);
+        assign(maxHealth, maxHealth + 20, StateHash::MAX_HEALTH);
+        assign(maxMana, maxMana + 10, StateHash::MAX_MANA);
+        assign(attack, attack + 5, StateHash::ATTACK);
+        assign(defense, defense + 3, StateHash::DEFENSE);
+        assign(health, maxHealth, StateHash::HEALTH); // Full heal on level up
+        assign(mana, maxMana, StateHash::MANA);
+        gameOutput << "Level up! You are now level " << level << "!\n";
     }
     
     // Movement
     void move(int newX, int newY) {
         setPosition(newX, newY);
-        cout << name << " moved to (" << newX << ", " << newY << ")" << endl;
+        gameOutput << name << " moved to (" << newX << ", " << newY << ")\n";
     }
     
     // Getters
@@ -189,43 +189,62 @@ public:
     const vector<Item*>& getInventory() const { return inventory; }
     
     // Setters
-    void setHealth(int hp) { health = hp; }
-    void setMana(int mp) { mana = mp; }
-    void setAttack(int att) { attack = att; }
-    void setDefense(int def) { defense = def; }
+    void setHealth(int hp) { assign(health, hp, StateHash::HEALTH); }
+    void setMana(int mp) { assign(mana, mp, StateHash::MANA); }
+    void setAttack(int att) { assign(attack, att, StateHash::ATTACK); }
+    void setDefense(int def) { assign(defense, def, StateHash::DEFENSE); }
+    
+    virtual uint64_t hashContribution(uint64_t subject) const override {
+        StateHash::Keys key(subject);
+        return Entity::hashContribution(subject) ^
+               key(StateHash::HEALTH, StateHash::value(health)) ^
+               key(StateHash::MAX_HEALTH, StateHash::value(maxHealth)) ^
+               key(StateHash::MANA, StateHash::value(mana)) ^
+               key(StateHash::MAX_MANA, StateHash::value(maxMana)) ^
+               key(StateHash::ATTACK, StateHash::value(attack)) ^
+               key(StateHash::DEFENSE, StateHash::value(defense)) ^
+               key(StateHash::LEVEL, StateHash::value(level)) ^
+               key(StateHash::EXPERIENCE, StateHash::value(experience));
+    }
+    
+    // Carried items are counted in the same hash as their owner
+    virtual void attachHash(StateHash* hash, uint64_t subject) override {
+        Entity::attachHash(hash, subject);
+        for(Item* item : inventory) {
+            item->attachHash(hash, StateHash::subject(StateHash::CARRIED, item->getId()));
+        }
+    }
     
     // Serialization
-    virtual void serialize(ofstream& file) const override {
-        Entity::serialize(file);
-        file.write(reinterpret_cast<const char*>(&health), sizeof(health));
-        file.write(reinterpret_cast<const char*>(&maxHealth), sizeof(maxHealth));
-        file.write(reinterpret_cast<const char*>(&mana), sizeof(mana));
-        file.write(reinterpret_cast<const char*>(&maxMana), sizeof(maxMana));
-        file.write(reinterpret_cast<const char*>(&attack), sizeof(attack));
-        file.write(reinterpret_cast<const char*>(&defense), sizeof(defense));
-        file.write(reinterpret_cast<const char*>(&level), sizeof(level));
-        file.write(reinterpret_cast<const char*>(&experience), sizeof(experience));
+    virtual void serialize(SaveWriter& out) const override {
+        Entity::serialize(out);
+        out.writeI32(health);
+        out.writeI32(maxHealth);
+        out.writeI32(mana);
+        out.writeI32(maxMana);
+        out.writeI32(attack);
+        out.writeI32(defense);
+        out.writeI32(level);
+        out.writeI32(experience);
         
-        int inventorySize = inventory.size();
-        file.write(reinterpret_cast<const char*>(&inventorySize), sizeof(inventorySize));
+        out.writeU32((uint32_t)inventory.size());
         for(const Item* item : inventory) {
-            item->serialize(file);
+            item->serialize(out);
         }
     }
     
-    virtual void deserialize(ifstream& file) override {
-        Entity::deserialize(file);
-        file.read(reinterpret_cast<char*>(&health), sizeof(health));
-        file.read(reinterpret_cast<char*>(&maxHealth), sizeof(maxHealth));
-        file.read(reinterpret_cast<char*>(&mana), sizeof(mana));
-        file.read(reinterpret_cast<char*>(&maxMana), sizeof(maxMana));
-        file.read(reinterpret_cast<char*>(&attack), sizeof(attack));
-        file.read(reinterpret_cast<char*>(&defense), sizeof(defense));
-        file.read(reinterpret_cast<char*>(&level), sizeof(level));
-        file.read(reinterpret_cast<char*>(&experience), sizeof(experience));
+    virtual void deserialize(SaveReader& in) override {
+        Entity::deserialize(in);
+        health = in.readI32();
+        maxHealth = in.readI32();
+        mana = in.readI32();
+        maxMana = in.readI32();
+        attack = in.readI32();
+        defense = in.readI32();
+        level = in.readI32();
+        experience = in.readI32();
         
-        int inventorySize;
-        file.read(reinterpret_cast<char*>(&inventorySize), sizeof(inventorySize));
+        int inventorySize = in.readCount(1);
         
         // Clear existing inventory
         for(Item* item : inventory) {
@@ -233,10 +252,15 @@ public:
         }
         inventory.clear();
         
-        // Load inventory items
+        // Load inventory items; a partly read item is freed before the error propagates
         for(int i = 0; i < inventorySize; i++) {
             Item* item = new Item();
-            item->deserialize(file);
+            try {
+                item->deserialize(in);
+            } catch(...) {
+                delete item;
+                throw;
+            }
             inventory.push_back(item);
         }
     }
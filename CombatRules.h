@@ -0,0 +1,106 @@
+#ifndef COMBAT_RULES_H
+#define COMBAT_RULES_H
+
+enum CombatOutcome {
+    COMBAT_RUNNING,
+    COMBAT_WON,
+    COMBAT_LOST,
+    COMBAT_FLED,
+    COMBAT_STALEMATE, // Neither side can hurt the other
+    COMBAT_OUTCOMES
+};
+
+inline const char* outcomeName(int outcome) {
+    switch(outcome) {
+        case COMBAT_WON: return "won";
+        case COMBAT_LOST: return "lost";
+        case COMBAT_FLED: return "fled";
+        case COMBAT_STALEMATE: return "stalemate";
+        default: return "running";
+    }
+}
+
+// How a fight ended and after how many rounds (NEVER for a stalemate)
+struct FightResult {
+    int outcome;
+    int rounds;
+    int playerHealth;
+    int monsterHealth;
+};
+
+// Damage arithmetic, shared by the live combat loop and the combat simulator.
+// An attack is reduced by the defender's defense twice: once when the blow is struck
+// (never below 1) and again when it lands (never below 0).
+class CombatRules {
+public:
+    static const int NEVER = 1 << 30;
+
+    // What the attacker deals; GameEngine::calculateDamage
+    static int strike(int attack, int defense) {
+        int damage = attack - defense;
+        return damage > 0 ? damage : 1;
+    }
+
+    // How much of a blow gets through; Character/Monster::takeDamage
+    static int absorb(int damage, int defense) {
+        int actual = damage - defense;
+        return actual > 0 ? actual : 0;
+    }
+
+    // Health one round's blow takes off the defender
+    static int hit(int attack, int defense) {
+        return absorb(strike(attack, defense), defense);
+    }
+
+    // The end of a fight in which every round the player's blow takes playerHit off the
+    // monster and the monster's takes monsterHit off the player, worked out without
+    // playing the rounds. Same order as GameEngine::handleAttack: the player strikes, the
+    // monster strikes back, and then the player flees if health * 100 < fleeBelow (the
+    // CombatPolicy::FLEE_BELOW test, fleeBelow = percent * max health; 0 never flees).
+    //
+    // Branch-free so a loop over many fights vectorizes: choices go through masks, since
+    // the compiler will not speculate a division to turn ?: into a select. The divisions
+    // go through double, which is exact for operands below 2^26.
+    static FightResult resolve(int playerHealth, int playerHit, int monsterHealth, int monsterHit, int fleeBelow) {
+        int playerHits = -(playerHit > 0);
+        int monsterHits = -(monsterHit > 0);
+        int playerBy = choose(playerHits, playerHit, 1);
+        int monsterBy = choose(monsterHits, monsterHit, 1);
+
+        // Round in which the player's blow kills the monster (a monster at 0 still takes one)
+        int killAt = (int)((double)(monsterHealth + playerBy - 1) / playerBy);
+        killAt = choose(playerHits | -(monsterHealth <= 0), killAt > 1 ? killAt : 1, NEVER);
+
+        // Round in which the monster's blow kills the player
+        int deathAt = (int)((double)(playerHealth + monsterBy - 1) / monsterBy);
+        deathAt = choose(monsterHits, deathAt, NEVER);
+
+        // First round after which health * 100 < fleeBelow
+        int margin = playerHealth * 100 - fleeBelow;
+        int fleeAt = (int)((double)margin / (100.0 * monsterBy)) + 1;
+        fleeAt = choose(-(margin < 0), 1, choose(monsterHits, fleeAt, NEVER));
+
+        int won = -((killAt <= deathAt) & (killAt <= fleeAt) & (killAt < NEVER));
+        int lost = ~won & -((deathAt <= fleeAt) & (deathAt < NEVER));
+        int fled = ~won & ~lost & -(fleeAt < NEVER);
+        int ended = won | lost | fled;
+        int rounds = choose(won, killAt, choose(lost, deathAt, fleeAt));
+
+        FightResult result;
+        result.outcome = (won & COMBAT_WON) | (lost & COMBAT_LOST) | (fled & COMBAT_FLED) | (~ended & COMBAT_STALEMATE);
+        result.rounds = choose(ended, rounds, NEVER);
+        int monsterStrikes = choose(ended, rounds + won, 0); // won is -1: the killing round has no reply
+        int playerStrikes = choose(ended, rounds, 0);
+        result.playerHealth = choose(lost, 0, playerHealth - monsterStrikes * monsterHit);
+        result.monsterHealth = choose(won, 0, monsterHealth - playerStrikes * playerHit);
+        return result;
+    }
+
+private:
+    // a where mask is all ones, b where it is zero
+    static int choose(int mask, int a, int b) {
+        return (a & mask) | (b & ~mask);
+    }
+};
+
+#endif
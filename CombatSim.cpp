@@ -0,0 +1,133 @@
+// Combat balance by simulation: every player level up to [max level] against every
+// spawn table monster, with monster strength drawn over the generator's depth scaling
+// (100-200%) and the player arriving with 50-100% health. With a monster name it
+// instead sweeps player attack and defense bonuses against that monster and prints
+// the win rate for each cell.
+// Build with -O3 (the level at which GCC vectorizes the resolve loop) and -march=native.
+// Usage: CombatSim [fights per matchup] [max level] [flee percent] [threads] [seed] [grid monster]
+#include "CombatSimulator.h"
+#include "Character.h"
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+using namespace std;
+
+thread_local GameOutput gameOutput;
+
+struct PlayerStats
+{
+    int health, attack, defense;
+};
+
+// Stats at levels 1..maxLevel, levelled the way the game does it
+static vector<PlayerStats> playerLevels(int maxLevel)
+{
+    vector<PlayerStats> levels;
+    Character hero;
+    for(int level = 1; level <= maxLevel; level++)
+    {
+        levels.push_back(PlayerStats{hero.getMaxHealth(), hero.getAttack(), hero.getDefense()});
+        hero.levelUp();
+    }
+    return levels;
+}
+
+static CombatMatchup makeMatchup(const PlayerStats& player, const MonsterSpawn& monster, int fleePercent)
+{
+    CombatMatchup matchup;
+    matchup.playerHealth = player.health;
+    matchup.playerAttack = player.attack;
+    matchup.playerDefense = player.defense;
+    matchup.monster = monster;
+    matchup.minScale = 100;
+    matchup.maxScale = 200;
+    matchup.minStartPercent = 50;
+    matchup.fleePercent = fleePercent;
+    return matchup;
+}
+
+int main(int argc, char* argv[])
+{
+    long long fights = argc > 1 ? atoll(argv[1]) : 1000000;
+    int maxLevel = argc > 2 ? atoi(argv[2]) : 5;
+    int fleePercent = argc > 3 ? atoi(argv[3]) : 0;
+    int threads = argc > 4 ? atoi(argv[4]) : 0;
+    uint64_t seed = argc > 5 ? strtoull(argv[5], nullptr, 10) : 1;
+    const char* gridMonster = argc > 6 ? argv[6] : nullptr;
+    if(fights < 1 || maxLevel < 1 || fleePercent < 0 || fleePercent > 100 || threads < 0)
+    {
+        cerr << "Usage: " << argv[0] << " [fights per matchup >= 1] [max level >= 1] [flee percent 0-100]"
+             << " [threads, 0 = all] [seed] [grid monster]" << endl;
+        return 1;
+    }
+
+    const vector<MonsterSpawn>& table = SpawnTables::monsters();
+    const MonsterSpawn* monster = nullptr;
+    for(const MonsterSpawn& entry : table)
+    {
+        if(gridMonster && strcmp(entry.name, gridMonster) == 0) monster = &entry;
+    }
+    if(gridMonster && !monster)
+    {
+        cerr << "No monster called " << gridMonster << " in the spawn table" << endl;
+        return 1;
+    }
+
+    NullSink discard;
+    gameOutput.setSink(&discard);
+    vector<PlayerStats> levels = playerLevels(maxLevel);
+    CombatSimulator simulator(threads);
+    printf("%lld fights per matchup, flee below %d%%, %d threads\n", fights, fleePercent,
+           simulator.getThreadCount());
+
+    long long total = 0;
+    auto start = chrono::steady_clock::now();
+    if(monster)
+    {
+        // Rows add attack, columns add defense, on top of the player at max level
+        const PlayerStats& base = levels.back();
+        printf("Win rate, level %d (%d HP, %d attack, %d defense) vs %s\n", maxLevel, base.health,
+               base.attack, base.defense, monster->name);
+        printf("%8s", "att\\def");
+        for(int defense = 0; defense <= 15; defense += 3) printf("   %+4d", defense);
+        printf("\n");
+        for(int attack = 0; attack <= 30; attack += 5)
+        {
+            printf("%8d", attack);
+            for(int defense = 0; defense <= 15; defense += 3)
+            {
+                PlayerStats player = PlayerStats{base.health, base.attack + attack, base.defense + defense};
+                CombatReport report = simulator.run(makeMatchup(player, *monster, fleePercent), fights, seed);
+                printf("  %5.1f", report.rate(COMBAT_WON) * 100);
+                total += fights;
+            }
+            printf("\n");
+        }
+    }
+    else
+    {
+        printf("%-5s %-15s %6s %6s %6s %6s   %-17s %s\n", "Level", "Monster", "win", "loss", "fled", "stuck",
+               "turns p10/50/90", "HP left p10/50/90");
+        for(int level = 1; level <= maxLevel; level++)
+        {
+            for(const MonsterSpawn& entry : table)
+            {
+                CombatMatchup matchup = makeMatchup(levels[level - 1], entry, fleePercent);
+                CombatReport report = simulator.run(matchup, fights, seed);
+                printf("%-5d %-15s %5.1f%% %5.1f%% %5.1f%% %5.1f%%   %3d/%3d/%3d       %3d%%/%3d%%/%3d%%\n",
+                       level, entry.name, report.rate(COMBAT_WON) * 100, report.rate(COMBAT_LOST) * 100,
+                       report.rate(COMBAT_FLED) * 100, report.rate(COMBAT_STALEMATE) * 100,
+                       report.turnPercentile(0.1), report.turnPercentile(0.5), report.turnPercentile(0.9),
+                       report.healthPercentile(0.1), report.healthPercentile(0.5), report.healthPercentile(0.9));
+                total += fights;
+            }
+        }
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    printf("%lld fights in %.2f s (%.1f million fights/s)\n", total, seconds, total / seconds / 1e6);
+    gameOutput.setSink(nullptr);
+    return 0;
+}
@@ -0,0 +1,156 @@
+#ifndef COMBAT_SIMULATOR_H
+#define COMBAT_SIMULATOR_H
+
+#include "CombatRules.h"
+#include "DungeonGenerator.h"
+#include "JobSystem.h"
+#include <vector>
+#include <cstdint>
+#include <cstring>
+using namespace std;
+
+// A player build against one spawn table entry. The rules leave nothing to chance, so
+// what varies from fight to fight is what the dungeon varies: how strongly the monster
+// was scaled when it spawned, and how much health the player walks in with.
+struct CombatMatchup {
+    int playerHealth;    // Maximum
+    int playerAttack;
+    int playerDefense;
+    MonsterSpawn monster;
+    int minScale, maxScale; // Percent, applied as Dungeon::spawnMonster does
+    int minStartPercent;    // Starting health drawn from minStartPercent..100% of maximum
+    int fleePercent;        // As CombatPolicy::FLEE_BELOW; 0 fights to the end
+};
+
+// Outcome counts plus distributions over the fights the player won
+struct CombatReport {
+    static const int TURN_BINS = 256;  // The last bin also holds anything longer
+    static const int HEALTH_BINS = 101; // Percent of maximum health left
+
+    long long fights;
+    long long outcomes[COMBAT_OUTCOMES];
+    long long turns[TURN_BINS];
+    long long healthLeft[HEALTH_BINS];
+
+    void clear() {
+        memset(this, 0, sizeof(*this));
+    }
+
+    void add(const CombatReport& other) {
+        fights += other.fights;
+        for(int i = 0; i < COMBAT_OUTCOMES; i++) outcomes[i] += other.outcomes[i];
+        for(int i = 0; i < TURN_BINS; i++) turns[i] += other.turns[i];
+        for(int i = 0; i < HEALTH_BINS; i++) healthLeft[i] += other.healthLeft[i];
+    }
+
+    double rate(CombatOutcome outcome) const {
+        return fights > 0 ? (double)outcomes[outcome] / fights : 0;
+    }
+
+    // Smallest value with at least `fraction` of the wins at or below it; -1 without wins
+    int turnPercentile(double fraction) const { return percentile(turns, TURN_BINS, fraction); }
+    int healthPercentile(double fraction) const { return percentile(healthLeft, HEALTH_BINS, fraction); }
+
+private:
+    int percentile(const long long* bins, int count, double fraction) const {
+        long long wins = outcomes[COMBAT_WON];
+        if(wins == 0) return -1;
+        long long target = (long long)(fraction * wins);
+        if(target < 1) target = 1;
+        long long seen = 0;
+        for(int i = 0; i < count; i++) {
+            seen += bins[i];
+            if(seen >= target) return i;
+        }
+        return count - 1;
+    }
+};
+
+// Plays a matchup out many times over a work-stealing pool.
+//
+// Fights are handled LANES at a time as structure-of-arrays: one pass draws every
+// lane's monster and starting health, one resolves every lane with the branch-free
+// CombatRules::resolve (which the compiler turns into SIMD code), and one tallies. The
+// lane arrays live on the stack and the per-chunk tallies are kept between runs, so
+// nothing is allocated while fights are played. Each fight's draws come from a hash of
+// the seed and the fight's index, so a run gives the same report on any number of
+// threads, and every matchup run with one seed sees the same draws, which keeps the
+// differences between matchups down to the stats.
+class CombatSimulator {
+public:
+    static const int LANES = 256;
+    static const int CHUNK = 64 * LANES; // Fights per job
+
+private:
+    JobSystem jobs;
+    vector<CombatReport> tallies; // One per chunk
+
+    static void playLanes(const CombatMatchup& matchup, uint64_t seed, long long first, int count,
+                          CombatReport& tally) {
+        int32_t playerHp[LANES], monsterHp[LANES], playerHit[LANES], monsterHit[LANES];
+        int32_t outcome[LANES], rounds[LANES], healthLeft[LANES];
+        const MonsterSpawn& spawn = matchup.monster;
+        int maxHealth = matchup.playerHealth;
+        uint64_t scales = matchup.maxScale - matchup.minScale + 1;
+        uint64_t starts = 101 - matchup.minStartPercent;
+        int fleeBelow = matchup.fleePercent * maxHealth;
+
+        for(int i = 0; i < count; i++) {
+            uint64_t state = seed ^ ((uint64_t)(first + i) * 0xD1B54A32D192ED03ull);
+            uint64_t draw = Random::splitMix(state);
+            // Multiply-shift maps each 32-bit half onto its range without a division
+            int scale = matchup.minScale + (int)(((draw & 0xFFFFFFFF) * scales) >> 32);
+            int startPercent = matchup.minStartPercent + (int)(((draw >> 32) * starts) >> 32);
+            int start = maxHealth * startPercent / 100;
+            playerHp[i] = start > 0 ? start : 1;
+            monsterHp[i] = spawn.health * scale / 100;
+            playerHit[i] = CombatRules::hit(matchup.playerAttack, spawn.defense * scale / 100);
+            monsterHit[i] = CombatRules::hit(spawn.attack * scale / 100, matchup.playerDefense);
+        }
+
+        for(int i = 0; i < count; i++) {
+            FightResult result = CombatRules::resolve(playerHp[i], playerHit[i], monsterHp[i], monsterHit[i], fleeBelow);
+            outcome[i] = result.outcome;
+            rounds[i] = result.rounds;
+            healthLeft[i] = result.playerHealth;
+        }
+
+        for(int i = 0; i < count; i++) {
+            tally.outcomes[outcome[i]]++;
+            if(outcome[i] != COMBAT_WON) continue;
+            tally.turns[rounds[i] < CombatReport::TURN_BINS ? rounds[i] : CombatReport::TURN_BINS - 1]++;
+            tally.healthLeft[healthLeft[i] * 100 / maxHealth]++;
+        }
+        tally.fights += count;
+    }
+
+public:
+    // threads = total threads including the caller; 0 uses every core
+    explicit CombatSimulator(int threads = 0) : jobs(threads) {}
+
+    int getThreadCount() const { return jobs.getThreadCount(); }
+
+    CombatReport run(const CombatMatchup& matchup, long long fights, uint64_t seed) {
+        CombatReport total;
+        total.clear();
+        if(fights <= 0) return total;
+
+        int chunks = (int)((fights + CHUNK - 1) / CHUNK);
+        if((int)tallies.size() < chunks) tallies.resize(chunks);
+        jobs.parallelFor(chunks, 1, [&](int begin, int end) {
+            for(int c = begin; c < end; c++) {
+                CombatReport& tally = tallies[c];
+                tally.clear();
+                long long first = (long long)c * CHUNK;
+                long long last = first + CHUNK < fights ? first + CHUNK : fights;
+                for(long long f = first; f < last; f += LANES) {
+                    playLanes(matchup, seed, f, last - f < LANES ? (int)(last - f) : LANES, tally);
+                }
+            }
+        });
+        for(int c = 0; c < chunks; c++) total.add(tallies[c]);
+        return total;
+    }
+};
+
+#endif
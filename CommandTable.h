@@ -0,0 +1,144 @@
+#ifndef COMMAND_TABLE_H
+#define COMMAND_TABLE_H
+
+#include <vector>
+#include <cstring>
+using namespace std;
+
+// Arguments following the verb, as a view into the input line (leading and trailing blanks trimmed)
+struct CommandArgs {
+    const char* text;
+    int length;
+
+    bool empty() const { return length == 0; }
+};
+
+// Case-insensitive trie from verbs to handlers. A verb matches exactly, or by any prefix
+// that only one registered entry starts with ("inv" -> inventory, "loo" -> look). Verbs
+// added with addExact take no part in prefix matching and must be typed in full.
+// Matching walks the input in place and never allocates.
+template<typename Handler>
+class CommandTable {
+public:
+    enum MatchResult {
+        MATCHED,
+        UNKNOWN,
+        AMBIGUOUS,
+        EMPTY
+    };
+
+    struct Entry {
+        Handler handler;
+        const char* presetArgs; // Used instead of typed arguments (e.g. "n" -> move n), or nullptr
+    };
+
+private:
+    static const int LETTERS = 26;
+    static const int NONE = -1;
+    static const int SEVERAL = -2;
+
+    struct Node {
+        int child[LETTERS];
+        int exact;   // Entry whose verb ends here
+        int prefix;  // Entry every verb below starts with, SEVERAL if more than one
+    };
+
+    vector<Node> nodes;
+    vector<Entry> entries;
+
+    static bool isBlank(char c) {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+    }
+
+    static int letterIndex(char c) {
+        c |= 0x20; // ASCII lower case
+        return (c >= 'a' && c <= 'z') ? c - 'a' : -1;
+    }
+
+    int newNode() {
+        Node n;
+        for(int i = 0; i < LETTERS; i++) n.child[i] = NONE;
+        n.exact = NONE;
+        n.prefix = NONE;
+        nodes.push_back(n);
+        return (int)nodes.size() - 1;
+    }
+
+    bool insert(const char* verb, Handler handler, const char* presetArgs, bool byPrefix) {
+        int entry = addEntry(handler, presetArgs);
+        int node = 0;
+        for(const char* p = verb; *p; p++) {
+            int letter = letterIndex(*p);
+            if(letter < 0) return false;
+            if(nodes[node].child[letter] == NONE) {
+                int created = newNode();
+                nodes[node].child[letter] = created;
+            }
+            node = nodes[node].child[letter];
+            if(byPrefix) {
+                int& prefix = nodes[node].prefix;
+                prefix = (prefix == NONE || prefix == entry) ? entry : SEVERAL;
+            }
+        }
+        if(node == 0 || (nodes[node].exact != NONE && nodes[node].exact != entry)) return false;
+        nodes[node].exact = entry;
+        return true;
+    }
+
+    int addEntry(Handler handler, const char* presetArgs) {
+        for(size_t i = 0; i < entries.size(); i++) {
+            if(entries[i].handler == handler && entries[i].presetArgs == presetArgs) return (int)i;
+        }
+        entries.push_back(Entry{handler, presetArgs});
+        return (int)entries.size() - 1;
+    }
+
+public:
+    CommandTable() {
+        newNode();
+    }
+
+    // Verbs are letters only; returns false for anything else or a clashing exact verb
+    bool add(const char* verb, Handler handler, const char* presetArgs = nullptr) {
+        return insert(verb, handler, presetArgs, true);
+    }
+
+    // For verbs that should never run by accident (save, quit): no prefix reaches them
+    bool addExact(const char* verb, Handler handler, const char* presetArgs = nullptr) {
+        return insert(verb, handler, presetArgs, false);
+    }
+
+    MatchResult match(const char* input, int length, const Entry*& entry, CommandArgs& args) const {
+        int pos = 0;
+        while(pos < length && isBlank(input[pos])) pos++;
+        if(pos == length) return EMPTY;
+
+        int node = 0;
+        while(pos < length && !isBlank(input[pos])) {
+            int letter = letterIndex(input[pos]);
+            if(letter < 0 || nodes[node].child[letter] == NONE) return UNKNOWN;
+            node = nodes[node].child[letter];
+            pos++;
+        }
+
+        int found = nodes[node].exact != NONE ? nodes[node].exact : nodes[node].prefix;
+        if(found == SEVERAL) return AMBIGUOUS;
+        if(found == NONE) return UNKNOWN;
+        entry = &entries[found];
+
+        if(entry->presetArgs) {
+            args.text = entry->presetArgs;
+            args.length = (int)strlen(entry->presetArgs);
+            return MATCHED;
+        }
+
+        while(pos < length && isBlank(input[pos])) pos++;
+        int end = length;
+        while(end > pos && isBlank(input[end - 1])) end--;
+        args.text = input + pos;
+        args.length = end - pos;
+        return MATCHED;
+    }
+};
+
+#endif
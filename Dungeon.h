@@ -2,9 +2,17 @@
 #define DUNGEON_H
 
 #include "Location.h"
+#include "DungeonGenerator.h"
+#include "FieldOfView.h"
+#include "SpatialIndex.h"
 #include "Character.h"
+#include "StateHash.h"
 #include "String.h"
 #include <vector>
+#include <unordered_map>
+#include <atomic>
+#include <chrono>
+#include <functional>
 
 template<typename T>
 class GameContainer {
@@ -36,6 +44,13 @@ public:
         return false;
     }
     
+    // Deletes the most recently added one
+    void removeLast() {
+        if(items.empty()) return;
+        delete items.back();
+        items.pop_back();
+    }
+    
     const vector<T*>& getAll() const {
         return items;
     }
@@ -56,19 +71,99 @@ public:
     }
 };
 
+// One step of a batch for Dungeon::moveMonsters
+struct MonsterMove {
+    Monster* monster;
+    int fromY;    // The row it stands on, so the batch is split without touching the monster
+    int x, y;
+};
+
 class Dungeon {
+public:
+    // Rows per band of moveMonsters: whole blocks of the monster index, so two bands never
+    // share a cell, a bucket or a block count
+    static const int MOVE_BAND_ROWS = SpatialIndex<Monster>::BUCKET_SIZE << SpatialIndex<Monster>::BLOCK_SHIFT;
+
 private:
     int width, height;
     vector<vector<Location*>> grid; // 2D array of locations - Composition
     Character* player; // Association - Dungeon knows about player
+    SpatialIndex<Item> itemIndex; // Items and monsters lying in cells; declared first so it outlives them
+    SpatialIndex<Monster> monsterIndex;
     GameContainer<Item> allItems; // Template usage
     GameContainer<Monster> allMonsters; // Template usage
     String dungeonName;
     int nextId;
+    uint64_t seed; // 0 = the fixed hand-made layout
+    int entranceX, entranceY; // Where a new player starts
+    uint64_t layoutVersion; // Changes whenever a cell's accessibility may have changed
+    
+    // Unique across all dungeons, so a cache keyed on it never confuses two worlds
+    static uint64_t newLayoutVersion() {
+        static atomic<uint64_t> counter(0);
+        return ++counter;
+    }
+    vector<int> dirtyCells; // y * width + x of cells whose map symbol may have changed
+    vector<uint8_t> dirtyFlags; // One per cell, so each is listed once; bytes, so bands can set their own
+    FieldOfView sight;
+    int sightX, sightY;       // Where sight was last computed from
+    uint64_t sightVersion;    // Layout version it was computed for
+    StateHash stateHash;      // Everything a save holds, kept current by the setters once hashing
+    bool hashing;             // Started by the first getStateHash()
+    
+    static uint64_t dungeonSubject() { return StateHash::subject(StateHash::DUNGEON, 0); }
+    
+    // What one band of moveMonsters changed, merged once every band is done
+    struct MoveBand {
+        StateHash::Batch changes;
+        vector<int> dirty;
+        vector<const MonsterMove*> deferred; // Not standing where the batch said; moved afterwards
+    };
+    vector<MoveBand> moveBands;  // Kept between batches to reuse the memory
+    vector<const MonsterMove*> bandedMoves;
+    vector<int> bandStarts;
+    
+    uint64_t dungeonFieldsHash() const {
+        StateHash::Keys key(dungeonSubject());
+        return key(StateHash::WIDTH, StateHash::value(width)) ^
+               key(StateHash::HEIGHT, StateHash::value(height)) ^
+               key(StateHash::NAME, StateHash::value(dungeonName)) ^
+               key(StateHash::NEXT_ID, StateHash::value(nextId)) ^
+               key(StateHash::SEED, StateHash::value(seed)) ^
+               key(StateHash::ENTRANCE_X, StateHash::value(entranceX)) ^
+               key(StateHash::ENTRANCE_Y, StateHash::value(entranceY));
+    }
+    
+    // Counts everything in and has it report its changes from now on
+    void startHashing() {
+        hashing = true;
+        stateHash.clear();
+        stateHash.toggle(dungeonFieldsHash());
+        for(vector<Location*>& row : grid) {
+            for(Location* loc : row) {
+                loc->setStateHash(&stateHash);
+                stateHash.toggle(loc->hashContribution());
+            }
+        }
+        for(Item* item : allItems.getAll()) {
+            item->attachHash(&stateHash, StateHash::subject(StateHash::ITEM, item->getId()));
+        }
+        for(Monster* monster : allMonsters.getAll()) {
+            monster->attachHash(&stateHash, StateHash::subject(StateHash::MONSTER, monster->getId()));
+        }
+        if(player) player->attachHash(&stateHash, StateHash::subject(StateHash::PLAYER, player->getId()));
+    }
+    
+    int takeId() {
+        int id = nextId;
+        StateHash::assign(hashing ? &stateHash : nullptr, dungeonSubject(), StateHash::NEXT_ID, nextId, nextId + 1);
+        return id;
+    }
     
 public:
     Dungeon(int w = 10, int h = 10, const String& name = "Mysterious Dungeon") 
-        : width(w), height(h), dungeonName(name), nextId(1000) {
+        : width(w), height(h), dungeonName(name), nextId(1000), seed(0), entranceX(0), entranceY(0),
+          layoutVersion(newLayoutVersion()), sightX(-1), sightY(-1), sightVersion(0), hashing(false) {
         
         // Initialize grid
         grid.resize(height);
@@ -80,10 +175,34 @@ public:
         }
         
         player = nullptr;
+        dirtyFlags.assign(width * height, 0);
+        sight.resize(width, height);
+        itemIndex.reset(width, height);
+        monsterIndex.reset(width, height);
         generateDungeon();
     }
     
+    // Procedurally generated; the same size and seed always give the same dungeon.
+    // threads = 0 uses every core; the result does not depend on it
+    Dungeon(int w, int h, const String& name, uint64_t worldSeed, int threads = 0)
+        : width(w), height(h), dungeonName(name), nextId(1000), seed(worldSeed), entranceX(0), entranceY(0),
+          layoutVersion(newLayoutVersion()), sightX(-1), sightY(-1), sightVersion(0), hashing(false) {
+        grid.resize(height);
+        for(int i = 0; i < height; i++) {
+            grid[i].resize(width);
+        }
+        player = nullptr;
+        dirtyFlags.assign(width * height, 0);
+        sight.resize(width, height);
+        itemIndex.reset(width, height);
+        monsterIndex.reset(width, height);
+        buildFromLayout(DungeonGenerator::generate(width, height, seed, threads), threads);
+    }
+    
     ~Dungeon() {
+        // The player outlives the dungeon, so it must stop reporting to this hash
+        if(player) player->attachHash(nullptr, 0);
+        
         // Clean up grid
         for(int i = 0; i < height; i++) {
             for(int j = 0; j < width; j++) {
@@ -119,32 +238,192 @@ public:
         }
         
         // Add some items
-        addItem(new Item("Health Potion", 2, 2, nextId++, ItemType::HEALTH_POTION, 50));
-        addItem(new Item("Magic Sword", 3, 4, nextId++, ItemType::SWORD, 25, false));
-        addItem(new Item("Mana Potion", 5, 5, nextId++, ItemType::MANA_POTION, 30));
-        addItem(new Item("Shield", 6, 3, nextId++, ItemType::SHIELD, 15, false));
-        addItem(new Item("Dungeon Key", 7, 7, nextId++, ItemType::KEY, 1, false));
+        addItem(new Item("Health Potion", 2, 2, takeId(), ItemType::HEALTH_POTION, 50));
+        addItem(new Item("Magic Sword", 3, 4, takeId(), ItemType::SWORD, 25, false));
+        addItem(new Item("Mana Potion", 5, 5, takeId(), ItemType::MANA_POTION, 30));
+        addItem(new Item("Shield", 6, 3, takeId(), ItemType::SHIELD, 15, false));
+        addItem(new Item("Dungeon Key", 7, 7, takeId(), ItemType::KEY, 1, false));
         
         // Add some monsters
-        addMonster(new Monster("Goblin", 4, 4, nextId++, MonsterType::GOBLIN, 80, 15, 5, "Magic Sword"));
-        addMonster(new Monster("Orc Warrior", 6, 6, nextId++, MonsterType::ORC, 120, 20, 8, "Shield"));
-        addMonster(new Monster("Ancient Dragon", 8, 8, nextId++, MonsterType::DRAGON, 200, 35, 15, "Dungeon Key"));
+        addMonster(new Monster("Goblin", 4, 4, takeId(), MonsterType::GOBLIN, 80, 15, 5, "Magic Sword"));
+        addMonster(new Monster("Orc Warrior", 6, 6, takeId(), MonsterType::ORC, 120, 20, 8, "Shield"));
+        addMonster(new Monster("Ancient Dragon", 8, 8, takeId(), MonsterType::DRAGON, 200, 35, 15, "Dungeon Key"));
+    }
+    
+    static const char* describe(LocationType type) {
+        switch(type) {
+            case LocationType::ENTRANCE: return "The entrance to the dungeon. You can see light from outside.";
+            case LocationType::EXIT: return "The exit! Freedom awaits beyond this door.";
+            case LocationType::ROOM: return "A dimly lit room with stone walls.";
+            case LocationType::TREASURE_ROOM: return "A treasure room with golden gleams in the darkness.";
+            case LocationType::MONSTER_LAIR: return "A foul-smelling lair littered with bones.";
+            case LocationType::CORRIDOR: return "A narrow corridor with echoing footsteps.";
+            default: return "Solid rock.";
+        }
+    }
+    
+    // Creates the cells, items and monsters a generated layout describes
+    void buildFromLayout(const DungeonLayout& layout, int threads) {
+        DungeonGenerator::parallelFor(height, threads, [&](int i) {
+            for(int j = 0; j < width; j++) {
+                LocationType type = layout.at(j, i);
+                grid[i][j] = new Location(j, i, type, describe(type));
+                if(type == LocationType::EMPTY) grid[i][j]->setAccessible(false);
+            }
+        });
+        entranceX = layout.entranceX;
+        entranceY = layout.entranceY;
+        
+        for(const DungeonLayout::Spawn& spawn : layout.spawns) {
+            if(spawn.monster) {
+                spawnMonster(SpawnTables::monsters()[spawn.entry], spawn.x, spawn.y, spawn.scalePercent);
+            } else {
+                const ItemSpawn& it = SpawnTables::items()[spawn.entry];
+                addItem(new Item(it.name, spawn.x, spawn.y, takeId(), it.type, it.value));
+            }
+        }
     }
     
     void addItem(Item* item) {
         if(item && isValidPosition(item->getX(), item->getY())) {
-            allItems.add(item);
+            adoptItem(item);
             grid[item->getY()][item->getX()]->addItem(item);
         }
     }
     
     void addMonster(Monster* monster) {
         if(monster && isValidPosition(monster->getX(), monster->getY())) {
-            allMonsters.add(monster);
+            adoptMonster(monster);
             grid[monster->getY()][monster->getX()]->addMonster(monster);
         }
     }
     
+    // Takes ownership without putting it in a cell (it may have been picked up already)
+    void adoptItem(Item* item) {
+        allItems.add(item);
+        item->setTracker(&itemIndex);
+        if(hashing) item->attachHash(&stateHash, StateHash::subject(StateHash::ITEM, item->getId()));
+    }
+    
+    void adoptMonster(Monster* monster) {
+        allMonsters.add(monster);
+        monster->setTracker(&monsterIndex);
+        if(hashing) monster->attachHash(&stateHash, StateHash::subject(StateHash::MONSTER, monster->getId()));
+    }
+    
+    // New monster from a spawn table entry, stats scaled by scalePercent
+    Monster* spawnMonster(const MonsterSpawn& m, int x, int y, int scalePercent = 100) {
+        if(!isValidPosition(x, y)) return nullptr;
+        Monster* monster = new Monster(m.name, x, y, takeId(), m.type,
+                                       m.health * scalePercent / 100, m.attack * scalePercent / 100,
+                                       m.defense * scalePercent / 100, m.weakness);
+        addMonster(monster);
+        markDirty(x, y);
+        return monster;
+    }
+    
+    // Moves a monster one cell (or further) if the target is open; updates both cells
+    bool moveMonster(Monster* monster, int x, int y) {
+        if(!monster || !isAccessible(x, y)) return false;
+        int fromX = monster->getX();
+        int fromY = monster->getY();
+        Location* from = getLocation(fromX, fromY);
+        if(!from || !from->passMonster(monster->getId(), *grid[y][x])) {
+            grid[y][x]->addMonster(monster);
+        }
+        markDirty(fromX, fromY);
+        markDirty(x, y);
+        return true;
+    }
+    
+    // Applies a batch of moves as moveMonster would, spread over `jobs` (if given) by bands
+    // of MOVE_BAND_ROWS rows. Moves that stay inside one band are applied band by band, each
+    // band in list order; moves that cross into another band follow on the calling thread,
+    // in list order. The outcome depends only on the list, never on the thread count.
+    // bandSeconds, if given, gets the time the bands took: the part that runs in parallel.
+    void moveMonsters(const vector<MonsterMove>& moves, JobSystem* jobs, double* bandSeconds = nullptr) {
+        int bands = (height + MOVE_BAND_ROWS - 1) / MOVE_BAND_ROWS;
+        if((int)moveBands.size() < bands) moveBands.resize(bands);
+        
+        // Group the moves by band, keeping their order; crossings go last
+        bandStarts.assign(bands + 2, 0);
+        for(const MonsterMove& move : moves) {
+            int band = move.fromY / MOVE_BAND_ROWS;
+            bandStarts[(band == move.y / MOVE_BAND_ROWS ? band : bands) + 1]++;
+        }
+        for(int band = 0; band <= bands; band++) bandStarts[band + 1] += bandStarts[band];
+        bandedMoves.resize(moves.size());
+        vector<int> next(bandStarts.begin(), bandStarts.end() - 1);
+        for(const MonsterMove& move : moves) {
+            int band = move.fromY / MOVE_BAND_ROWS;
+            bandedMoves[next[band == move.y / MOVE_BAND_ROWS ? band : bands]++] = &move;
+        }
+        
+        function<void(int, int)> moveBandRange = [this](int begin, int end) {
+            for(int band = begin; band < end; band++) {
+                MoveBand& result = moveBands[band];
+                result.changes.target = &stateHash;
+                result.changes.hash = 0;
+                result.changes.subjects.clear();
+                result.dirty.clear();
+                result.deferred.clear();
+                StateHash::openBatch() = &result.changes;
+                for(int i = bandStarts[band]; i < bandStarts[band + 1]; i++) {
+                    const MonsterMove& move = *bandedMoves[i];
+                    Monster* monster = move.monster;
+                    int fromX = monster->getX();
+                    int fromY = monster->getY();
+                    if(!monster->isPlaced() || fromY / MOVE_BAND_ROWS != band || !isValidPosition(fromX, fromY)) {
+                        result.deferred.push_back(&move);
+                        continue;
+                    }
+                    if(!isAccessible(move.x, move.y)) continue;
+                    if(!grid[fromY][fromX]->passMonster(monster->getId(), *grid[move.y][move.x])) {
+                        result.deferred.push_back(&move);
+                        continue;
+                    }
+                    markDirty(fromX, fromY, result.dirty);
+                    markDirty(move.x, move.y, result.dirty);
+                }
+                StateHash::openBatch() = nullptr;
+            }
+        };
+        auto start = chrono::steady_clock::now();
+        if(jobs && bands > 1) {
+            jobs->parallelFor(bands, 1, moveBandRange);
+        } else {
+            moveBandRange(0, bands);
+        }
+        if(bandSeconds) *bandSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        
+        for(int band = 0; band < bands; band++) {
+            MoveBand& result = moveBands[band];
+            stateHash.absorb(result.changes);
+            dirtyCells.insert(dirtyCells.end(), result.dirty.begin(), result.dirty.end());
+        }
+        for(int band = 0; band < bands; band++) {
+            for(const MonsterMove* move : moveBands[band].deferred) moveMonster(move->monster, move->x, move->y);
+        }
+        for(int i = bandStarts[bands]; i < bandStarts[bands + 1]; i++) {
+            moveMonster(bandedMoves[i]->monster, bandedMoves[i]->x, bandedMoves[i]->y);
+        }
+    }
+    
+    // Live monsters within radius (straight-line distance) of (x, y)
+    void monstersWithin(int x, int y, int radius, vector<Monster*>& out) const {
+        out.clear();
+        monsterIndex.forEachWithin(x, y, radius, [&out](Monster* monster) {
+            if(monster->getActive() && !monster->getDefeated()) out.push_back(monster);
+        });
+    }
+    
+    // Closest item of the given type still lying in the dungeon, or nullptr
+    Item* nearestItem(int x, int y, ItemType type) const {
+        return itemIndex.nearest(x, y, [type](Item* item) {
+            return item->getType() == type && item->getActive();
+        });
+    }
+    
     bool isValidPosition(int x, int y) const {
         return x >= 0 && x < width && y >= 0 && y < height;
     }
@@ -157,7 +436,45 @@ public:
     }
     
     void setPlayer(Character* p) {
+        if(player) player->attachHash(nullptr, 0);
         player = p;
+        if(player && hashing) player->attachHash(&stateHash, StateHash::subject(StateHash::PLAYER, player->getId()));
+        updateSight();
+    }
+    
+    // Recomputes the player's field of view if they moved or a wall changed since last
+    // time, and marks the cells that came into or went out of view dirty
+    void updateSight() {
+        if(!player) return;
+        int x = player->getX();
+        int y = player->getY();
+        if(x == sightX && y == sightY && sightVersion == layoutVersion) return;
+        sightX = x;
+        sightY = y;
+        sightVersion = layoutVersion;
+        sight.compute(x, y, [this](int cx, int cy) { return !grid[cy][cx]->canAccess(); });
+        for(int cell : sight.getChangedCells()) {
+            markDirty(cell % width, cell / width);
+        }
+    }
+    
+    void setSightRadius(int radius) {
+        sight.setRadius(radius);
+        sightX = sightY = -1;
+        updateSight();
+    }
+    
+    int getSightRadius() const { return sight.getRadius(); }
+    bool isInSight(int x, int y) const { return isValidPosition(x, y) && sight.isVisible(x, y); }
+    
+    // Cells in view show what is there now; explored cells what was left there;
+    // cells only glimpsed their terrain; the rest are unknown
+    char getMapSymbol(int x, int y) const {
+        const Location* loc = grid[y][x];
+        if(sight.isVisible(x, y)) return loc->getVisibleSymbol();
+        if(loc->getVisited()) return loc->getMapSymbol();
+        if(sight.wasSeen(x, y)) return loc->getTerrainSymbol();
+        return '?';
     }
     
     Character* getPlayer() const {
@@ -165,35 +482,35 @@ public:
     }
     
     void displayMap() const {
-        cout << "\n=== " << dungeonName << " Map ===" << endl;
-        cout << "Legend: S=Start, E=Exit, R=Room, T=Treasure, M=Monster, I=Item, .=Corridor, ?=Unexplored" << endl;
+        gameOutput << "\n=== " << dungeonName << " Map ===\n";
+        gameOutput << "Legend: S=Start, E=Exit, R=Room, T=Treasure, L=Lair, M=Monster, I=Item, .=Corridor, #=Wall, ?=Unexplored\n";
         
         // Display player position
         if(player) {
-            cout << "Player position: (" << player->getX() << ", " << player->getY() << ")" << endl;
+            gameOutput << "Player position: (" << player->getX() << ", " << player->getY() << ")\n";
         }
         
-        cout << "\n  ";
+        gameOutput << "\n  ";
         for(int j = 0; j < width; j++) {
-            cout << j % 10;
+            gameOutput << j % 10;
         }
-        cout << endl;
+        gameOutput << "\n";
         
         for(int i = 0; i < height; i++) {
-            cout << i % 10 << " ";
+            gameOutput << i % 10 << " ";
             for(int j = 0; j < width; j++) {
-                char symbol = grid[i][j]->getMapSymbol();
+                char symbol = getMapSymbol(j, i);
                 
                 // Show player position
                 if(player && player->getX() == j && player->getY() == i) {
-                    cout << "P";
+                    gameOutput << "P";
                 } else {
-                    cout << symbol;
+                    gameOutput << symbol;
                 }
             }
-            cout << endl;
+            gameOutput << "\n";
         }
-        cout << endl;
+        gameOutput << "\n";
     }
     
     void displayCurrentLocation() const {
@@ -217,26 +534,66 @@ public:
             case 'e': case 'E': newX++; break;
             case 'w': case 'W': newX--; break;
             default:
-                cout << "Invalid direction! Use N/S/E/W" << endl;
+                gameOutput << "Invalid direction! Use N/S/E/W\n";
                 return false;
         }
         
         if(!isValidPosition(newX, newY)) {
-            cout << "Cannot move there - out of bounds!" << endl;
+            gameOutput << "Cannot move there - out of bounds!\n";
             return false;
         }
         
         Location* newLoc = getLocation(newX, newY);
         if(!newLoc->canAccess()) {
-            cout << "Cannot access this location!" << endl;
+            gameOutput << "Cannot access this location!\n";
             return false;
         }
         
+        markDirty(player->getX(), player->getY());
         player->move(newX, newY);
         newLoc->enter();
+        markDirty(newX, newY);
+        updateSight();
         return true;
     }
     
+    // Records that a cell's map symbol may have changed, for incremental map rendering
+    void markDirty(int x, int y) {
+        markDirty(x, y, dirtyCells);
+    }
+    
+    // The same, listing the cell in `dirty`; moveMonsters bands keep their own list
+    void markDirty(int x, int y, vector<int>& dirty) {
+        if(!isValidPosition(x, y)) return;
+        int cell = y * width + x;
+        if(!dirtyFlags[cell]) {
+            dirtyFlags[cell] = 1;
+            dirty.push_back(cell);
+        }
+    }
+    
+    const vector<int>& getDirtyCells() const { return dirtyCells; }
+    
+    // Opens or blocks a cell; use this rather than Location::setAccessible so caches notice
+    void setAccessible(int x, int y, bool accessible) {
+        if(!isValidPosition(x, y)) return;
+        grid[y][x]->setAccessible(accessible);
+        layoutVersion = newLayoutVersion();
+        markDirty(x, y);
+        updateSight();
+    }
+    
+    bool isAccessible(int x, int y) const {
+        return isValidPosition(x, y) && grid[y][x]->canAccess();
+    }
+    
+    uint64_t getLayoutVersion() const { return layoutVersion; }
+    
+    void clearDirty() {
+        for(int cell : dirtyCells) dirtyFlags[cell] = 0;
+        dirtyCells.clear();
+    }
+    
     // Getters
     int getWidth() const { return width; }
     int getHeight() const { return height; }
@@ -244,96 +601,257 @@ public:
     const GameContainer<Item>& getAllItems() const { return allItems; }
     const GameContainer<Monster>& getAllMonsters() const { return allMonsters; }
     
+    int getNextId() const { return nextId; }
+    int getEntranceX() const { return entranceX; }
+    int getEntranceY() const { return entranceY; }
+    uint64_t getSeed() const { return seed; }
+    
+    // Hash of the dungeon, its player and everything either holds; equal worlds hash equal.
+    // The first call counts the whole world in (O(cells)); from then on the setters keep it
+    // current and a call is O(1), so worlds nobody compares never pay for it.
+    uint64_t getStateHash() {
+        if(!hashing) startHashing();
+        return stateHash.get();
+    }
+    
+    // Subjects of every hashed change from now on go to `changes` (nullptr stops that)
+    void setChangeJournal(vector<uint64_t>* changes) {
+        if(!hashing) startHashing();
+        stateHash.setJournal(changes);
+    }
+    
+    // The same hash worked out from scratch, to check the running one against
+    uint64_t computeStateHash() const {
+        StateHash fresh;
+        fresh.toggle(dungeonFieldsHash());
+        for(const vector<Location*>& row : grid) {
+            for(const Location* loc : row) fresh.toggle(loc->hashContribution());
+        }
+        for(const Item* item : allItems.getAll()) {
+            fresh.toggle(item->hashContribution(StateHash::subject(StateHash::ITEM, item->getId())));
+        }
+        for(const Monster* monster : allMonsters.getAll()) {
+            fresh.toggle(monster->hashContribution(StateHash::subject(StateHash::MONSTER, monster->getId())));
+        }
+        if(player) {
+            fresh.toggle(player->hashContribution(StateHash::subject(StateHash::PLAYER, player->getId())));
+            for(const Item* item : player->getInventory()) {
+                fresh.toggle(item->hashContribution(StateHash::subject(StateHash::CARRIED, item->getId())));
+            }
+        }
+        return fresh.get();
+    }
+    
     // Check win condition
     bool isWinCondition() const {
         if(!player) return false;
-        return (player->getX() == width-1 && player->getY() == height-1);
+        Location* loc = getLocation(player->getX(), player->getY());
+        return loc && loc->getType() == LocationType::EXIT;
     }
     
     // Serialization
-    void serialize(ofstream& file) const {
-        file.write(reinterpret_cast<const char*>(&width), sizeof(width));
-        file.write(reinterpret_cast<const char*>(&height), sizeof(height));
-        file.write(reinterpret_cast<const char*>(&nextId), sizeof(nextId));
+    void serialize(SaveWriter& out) const {
+        out.writeI32(width);
+        out.writeI32(height);
+        out.writeI32(nextId);
+        out.writeString(dungeonName);
+        out.writeU64(seed);
+        out.writeI32(entranceX);
+        out.writeI32(entranceY);
         
-        int nameLen = dungeonName.size();
-        file.write(reinterpret_cast<const char*>(&nameLen), sizeof(nameLen));
-        for(int i = 0; i < nameLen; i++) {
-            file.write(&dungeonName[i], sizeof(char));
+        // Entities first, so cells can refer to them by id
+        out.writeU32((uint32_t)allItems.size());
+        for(const Item* item : allItems.getAll()) {
+            item->serialize(out);
+        }
+        out.writeU32((uint32_t)allMonsters.size());
+        for(const Monster* monster : allMonsters.getAll()) {
+            monster->serialize(out);
         }
         
-        // Serialize grid
         for(int i = 0; i < height; i++) {
             for(int j = 0; j < width; j++) {
-                grid[i][j]->serialize(file);
+                serializeCell(out, j, i);
             }
         }
-        
-        // Serialize items
-        int itemCount = allItems.size();
-        file.write(reinterpret_cast<const char*>(&itemCount), sizeof(itemCount));
-        for(const Item* item : allItems.getAll()) {
-            item->serialize(file);
+    }
+    
+    // One cell as a save holds it: its fields, then the ids of what lies in it
+    void serializeCell(SaveWriter& out, int x, int y) const {
+        const Location* loc = grid[y][x];
+        loc->serialize(out);
+        out.writeU32((uint32_t)loc->getItems().size());
+        for(const Item* item : loc->getItems()) {
+            out.writeI32(item->getId());
         }
-        
-        // Serialize monsters
-        int monsterCount = allMonsters.size();
-        file.write(reinterpret_cast<const char*>(&monsterCount), sizeof(monsterCount));
-        for(const Monster* monster : allMonsters.getAll()) {
-            monster->serialize(file);
+        out.writeU32((uint32_t)loc->getMonsters().size());
+        for(const Monster* monster : loc->getMonsters()) {
+            out.writeI32(monster->getId());
         }
     }
     
-    void deserialize(ifstream& file) {
-        // Clean up existing data
-        for(int i = 0; i < height; i++) {
-            for(int j = 0; j < width; j++) {
-                delete grid[i][j];
-            }
+    // Undo puts earlier state back into this same world piece by piece (see WorldHistory.h).
+    // Entities are overwritten in place, so cells, indices and the hash keep pointing at
+    // them; one that moves must have been taken out of its cells first.
+    void restoreItem(Item* item, SaveReader& in) {
+        item->attachHash(nullptr, 0);
+        item->deserialize(in);
+        if(hashing) item->attachHash(&stateHash, StateHash::subject(StateHash::ITEM, item->getId()));
+    }
+    
+    void restoreMonster(Monster* monster, SaveReader& in) {
+        monster->attachHash(nullptr, 0);
+        monster->deserialize(in);
+        if(hashing) monster->attachHash(&stateHash, StateHash::subject(StateHash::MONSTER, monster->getId()));
+    }
+    
+    void restorePlayer(SaveReader& in) {
+        if(!player) return;
+        markDirty(player->getX(), player->getY());
+        player->attachHash(nullptr, 0);
+        player->deserialize(in);
+        if(hashing) player->attachHash(&stateHash, StateHash::subject(StateHash::PLAYER, player->getId()));
+        markDirty(player->getX(), player->getY());
+        updateSight();
+    }
+    
+    void restoreNextId(int id) {
+        StateHash::assign(hashing ? &stateHash : nullptr, dungeonSubject(), StateHash::NEXT_ID, nextId, id);
+    }
+    
+    // Deletes the newest item or monster, taking it out of its cell first
+    void dropLastItem() {
+        if(allItems.size() == 0) return;
+        Item* item = allItems.getAll().back();
+        if(item->isPlaced()) grid[item->getY()][item->getX()]->removeItem(item->getId());
+        item->attachHash(nullptr, 0);
+        allItems.removeLast();
+    }
+    
+    void dropLastMonster() {
+        if(allMonsters.size() == 0) return;
+        Monster* monster = allMonsters.getAll().back();
+        if(monster->isPlaced()) grid[monster->getY()][monster->getX()]->removeMonster(monster->getId());
+        monster->attachHash(nullptr, 0);
+        allMonsters.removeLast();
+    }
+    
+    // Builds the whole world aside and only replaces the current one once every field checked out
+    void deserialize(SaveReader& in) {
+        int newWidth = in.readI32();
+        int newHeight = in.readI32();
+        int newNextId = in.readI32();
+        String newName = in.readString();
+        uint64_t newSeed = in.readU64();
+        int newEntranceX = in.readI32();
+        int newEntranceY = in.readI32();
+        // Each cell takes at least 20 bytes, which bounds the grid by the section size
+        if(newWidth <= 0 || newHeight <= 0 ||
+           (uint64_t)newWidth * (uint64_t)newHeight > in.remaining() / 20) {
+            throw SaveLoadException("invalid dungeon dimensions");
+        }
+        if(newEntranceX < 0 || newEntranceX >= newWidth || newEntranceY < 0 || newEntranceY >= newHeight) {
+            throw SaveLoadException("entrance outside the dungeon");
         }
-        allItems.clear();
-        allMonsters.clear();
-        
-        file.read(reinterpret_cast<char*>(&width), sizeof(width));
-        file.read(reinterpret_cast<char*>(&height), sizeof(height));
-        file.read(reinterpret_cast<char*>(&nextId), sizeof(nextId));
         
-        int nameLen;
-        file.read(reinterpret_cast<char*>(&nameLen), sizeof(nameLen));
-        dungeonName.clear();
-        for(int i = 0; i < nameLen; i++) {
-            char ch;
-            file.read(&ch, sizeof(char));
-            dungeonName.push_back(ch);
+        vector<Item*> newItems;
+        vector<Monster*> newMonsters;
+        vector<vector<Location*>> newGrid;
+        try {
+            unordered_map<int, Item*> itemsById;
+            int itemCount = in.readCount(1);
+            for(int i = 0; i < itemCount; i++) {
+                newItems.push_back(new Item());
+                newItems.back()->deserialize(in);
+                itemsById[newItems.back()->getId()] = newItems.back();
+            }
+            
+            unordered_map<int, Monster*> monstersById;
+            int monsterCount = in.readCount(1);
+            for(int i = 0; i < monsterCount; i++) {
+                newMonsters.push_back(new Monster());
+                newMonsters.back()->deserialize(in);
+                monstersById[newMonsters.back()->getId()] = newMonsters.back();
+            }
+            
+            newGrid.resize(newHeight);
+            for(int i = 0; i < newHeight; i++) {
+                newGrid[i].reserve(newWidth);
+                for(int j = 0; j < newWidth; j++) {
+                    newGrid[i].push_back(new Location());
+                    Location* loc = newGrid[i][j];
+                    loc->deserialize(in);
+                    if(loc->getX() != j || loc->getY() != i) {
+                        throw SaveLoadException("cell position mismatch");
+                    }
+                    
+                    int cellItems = in.readCount(4);
+                    for(int k = 0; k < cellItems; k++) {
+                        auto found = itemsById.find(in.readI32());
+                        if(found == itemsById.end()) {
+                            throw SaveLoadException("cell refers to unknown item");
+                        }
+                        loc->addItem(found->second);
+                    }
+                    int cellMonsters = in.readCount(4);
+                    for(int k = 0; k < cellMonsters; k++) {
+                        auto found = monstersById.find(in.readI32());
+                        if(found == monstersById.end()) {
+                            throw SaveLoadException("cell refers to unknown monster");
+                        }
+                        loc->addMonster(found->second);
+                    }
+                }
+            }
+            if(!in.atEnd()) {
+                throw SaveLoadException("trailing bytes in dungeon section");
+            }
+        } catch(...) {
+            for(vector<Location*>& row : newGrid) {
+                for(Location* loc : row) delete loc;
+            }
+            for(Item* item : newItems) delete item;
+            for(Monster* monster : newMonsters) delete monster;
+            throw;
         }
         
-        // Deserialize grid
-        grid.resize(height);
+        // Commit: release the old world and adopt the new one
         for(int i = 0; i < height; i++) {
-            grid[i].resize(width);
             for(int j = 0; j < width; j++) {
-                grid[i][j] = new Location();
-                grid[i][j]->deserialize(file);
+                delete grid[i][j];
             }
         }
+        allItems.clear();
+        allMonsters.clear();
         
-        // Deserialize items
-        int itemCount;
-        file.read(reinterpret_cast<char*>(&itemCount), sizeof(itemCount));
-        for(int i = 0; i < itemCount; i++) {
-            Item* item = new Item();
-            item->deserialize(file);
+        width = newWidth;
+        height = newHeight;
+        nextId = newNextId;
+        dungeonName = newName;
+        seed = newSeed;
+        entranceX = newEntranceX;
+        entranceY = newEntranceY;
+        grid.swap(newGrid);
+        layoutVersion = newLayoutVersion();
+        dirtyCells.clear();
+        dirtyFlags.assign(width * height, 0);
+        sight.resize(width, height);
+        sightX = sightY = -1;
+        itemIndex.reset(width, height);
+        monsterIndex.reset(width, height);
+        for(Item* item : newItems) {
+            item->setTracker(&itemIndex);
             allItems.add(item);
         }
-        
-        // Deserialize monsters
-        int monsterCount;
-        file.read(reinterpret_cast<char*>(&monsterCount), sizeof(monsterCount));
-        for(int i = 0; i < monsterCount; i++) {
-            Monster* monster = new Monster();
-            monster->deserialize(file);
+        for(Monster* monster : newMonsters) {
+            monster->setTracker(&monsterIndex);
             allMonsters.add(monster);
         }
+        if(hashing) {
+            // The player stays, but the hash it is counted in starts over
+            if(player) player->attachHash(nullptr, 0);
+            startHashing();
+        }
     }
 };
 
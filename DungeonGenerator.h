@@ -0,0 +1,414 @@
+#ifndef DUNGEON_GENERATOR_H
+#define DUNGEON_GENERATOR_H
+
+#include "Location.h"
+#include "Item.h"
+#include "Monster.h"
+#include "JobSystem.h"
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include <mutex>
+using namespace std;
+
+// xoshiro256** seeded through splitmix64. Small, fast, and the same sequence on every
+// platform, which std::mt19937 plus the std distributions do not guarantee.
+class Random {
+private:
+    uint64_t state[4];
+
+    static uint64_t rotl(uint64_t x, int k) {
+        return (x << k) | (x >> (64 - k));
+    }
+
+public:
+    static uint64_t splitMix(uint64_t& x) {
+        uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    explicit Random(uint64_t seed) {
+        for(int i = 0; i < 4; i++) state[i] = splitMix(seed);
+    }
+
+    uint64_t next() {
+        uint64_t result = rotl(state[1] * 5, 7) * 9;
+        uint64_t t = state[1] << 17;
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= t;
+        state[3] = rotl(state[3], 45);
+        return result;
+    }
+
+    // Uniform in [low, high] (multiply-shift; the bias is far below anything visible here)
+    int range(int low, int high) {
+        if(high <= low) return low;
+        uint64_t span = (uint64_t)(high - low) + 1;
+        return low + (int)(((next() >> 32) * span) >> 32);
+    }
+
+    bool chance(int percent) {
+        return range(0, 99) < percent;
+    }
+};
+
+// What may spawn, how often (weight), and base strength; monsters are scaled up
+// the further their room is from the entrance
+struct ItemSpawn {
+    const char* name;
+    ItemType type;
+    int value;
+    int weight;
+};
+
+struct MonsterSpawn {
+    const char* name;
+    MonsterType type;
+    int health;
+    int attack;
+    int defense;
+    const char* weakness;
+    int weight;
+};
+
+class SpawnTables {
+public:
+    static const vector<ItemSpawn>& items() {
+        static const vector<ItemSpawn> table = {
+            {"Health Potion", ItemType::HEALTH_POTION, 50, 40},
+            {"Mana Potion", ItemType::MANA_POTION, 30, 25},
+            {"Gold Coins", ItemType::TREASURE, 100, 15},
+            {"Shield", ItemType::SHIELD, 15, 9},
+            {"Magic Sword", ItemType::SWORD, 25, 7},
+            {"Dungeon Key", ItemType::KEY, 1, 4}
+        };
+        return table;
+    }
+
+    static const vector<MonsterSpawn>& monsters() {
+        static const vector<MonsterSpawn> table = {
+            {"Goblin", MonsterType::GOBLIN, 80, 15, 5, "Magic Sword", 40},
+            {"Skeleton", MonsterType::SKELETON, 70, 18, 4, "Shield", 25},
+            {"Orc Warrior", MonsterType::ORC, 120, 20, 8, "Shield", 20},
+            {"Cave Troll", MonsterType::TROLL, 160, 26, 10, "Magic Sword", 10},
+            {"Ancient Dragon", MonsterType::DRAGON, 200, 35, 15, "Dungeon Key", 5}
+        };
+        return table;
+    }
+
+    // Index into a table, chosen by weight
+    template<typename Entry>
+    static int pick(const vector<Entry>& table, Random& rng) {
+        int total = 0;
+        for(const Entry& e : table) total += e.weight;
+        int roll = rng.range(0, total - 1);
+        for(size_t i = 0; i < table.size(); i++) {
+            roll -= table[i].weight;
+            if(roll < 0) return (int)i;
+        }
+        return (int)table.size() - 1;
+    }
+};
+
+// Layout produced by the generator: one LocationType per cell (EMPTY = solid rock)
+// plus where things spawn. Dungeon turns it into Locations, Items and Monsters.
+struct DungeonLayout {
+    struct Spawn {
+        bool monster;
+        int entry;         // Index into the item or monster table
+        int x, y;
+        int scalePercent;  // Monster strength relative to the table, 100 = as listed
+    };
+
+    int width;
+    int height;
+    vector<uint8_t> cells;
+    int entranceX, entranceY;
+    int exitX, exitY;
+    vector<Spawn> spawns;
+
+    LocationType at(int x, int y) const {
+        return (LocationType)cells[(size_t)y * width + x];
+    }
+
+    void set(int x, int y, LocationType type) {
+        cells[(size_t)y * width + x] = (uint8_t)type;
+    }
+};
+
+// Binary space partition: split the map into leaves, put a room in each leaf and join
+// sibling subtrees with L-shaped corridors, so every room is reachable. Large maps are
+// cut into chunks that are partitioned independently and joined through a door on each
+// seam. The same seed and size always give the same layout.
+class DungeonGenerator {
+public:
+    static const int MIN_LEAF = 8;        // Smallest side a split may leave
+    static const int MAX_LEAF = 18;       // Leaves larger than this are always split
+    static const int CELLS_PER_ITEM = 28; // Spawn density, in room cells
+    static const int CELLS_PER_MONSTER = 40;
+    static const int CHUNK_SIZE = 256;    // Side of the squares generated in parallel
+
+private:
+    struct Room {
+        int x, y, width, height;
+
+        int centerX() const { return x + width / 2; }
+        int centerY() const { return y + height / 2; }
+    };
+
+    DungeonLayout& layout;
+    Random& rng;
+    vector<Room> rooms;
+
+    void carveRoom(const Room& room) {
+        int roll = rng.range(0, 99);
+        LocationType type = roll < 10 ? LocationType::TREASURE_ROOM
+                          : roll < 18 ? LocationType::MONSTER_LAIR
+                          : LocationType::ROOM;
+        for(int y = room.y; y < room.y + room.height; y++) {
+            for(int x = room.x; x < room.x + room.width; x++) {
+                layout.set(x, y, type);
+            }
+        }
+    }
+
+    void carveCorridorCell(int x, int y) {
+        if(layout.at(x, y) == LocationType::EMPTY) layout.set(x, y, LocationType::CORRIDOR);
+    }
+
+    void carveRow(int x1, int x2, int y) {
+        for(int x = min(x1, x2); x <= max(x1, x2); x++) carveCorridorCell(x, y);
+    }
+
+    void carveColumn(int y1, int y2, int x) {
+        for(int y = min(y1, y2); y <= max(y1, y2); y++) carveCorridorCell(x, y);
+    }
+
+    // Horizontal then vertical, or the other way round
+    void carveCorridor(int x1, int y1, int x2, int y2) {
+        if(rng.chance(50)) {
+            carveRow(x1, x2, y1);
+            carveColumn(y1, y2, x2);
+        } else {
+            carveColumn(y1, y2, x1);
+            carveRow(x1, x2, y2);
+        }
+    }
+
+    // Splits the region and returns the index of one room inside it, for joining
+    int split(int x, int y, int width, int height) {
+        bool canSplitX = width >= 2 * MIN_LEAF;
+        bool canSplitY = height >= 2 * MIN_LEAF;
+        bool mustSplit = width > MAX_LEAF || height > MAX_LEAF;
+        if((canSplitX || canSplitY) && (mustSplit || rng.chance(30))) {
+            bool vertical = canSplitX && (!canSplitY || width > height || (width == height && rng.chance(50)));
+            int first, second;
+            if(vertical) {
+                int cut = rng.range(MIN_LEAF, width - MIN_LEAF);
+                first = split(x, y, cut, height);
+                second = split(x + cut, y, width - cut, height);
+            } else {
+                int cut = rng.range(MIN_LEAF, height - MIN_LEAF);
+                first = split(x, y, width, cut);
+                second = split(x, y + cut, width, height - cut);
+            }
+            carveCorridor(rooms[first].centerX(), rooms[first].centerY(),
+                          rooms[second].centerX(), rooms[second].centerY());
+            return rng.chance(50) ? first : second;
+        }
+
+        // Leaf: a room with at least one cell of rock around it where the leaf allows
+        Room room;
+        int maxWidth = width > 3 ? width - 2 : width;
+        int maxHeight = height > 3 ? height - 2 : height;
+        room.width = rng.range(min(3, maxWidth), maxWidth);
+        room.height = rng.range(min(3, maxHeight), maxHeight);
+        room.x = x + rng.range(width > 3 ? 1 : 0, width - room.width - (width > 3 ? 1 : 0));
+        room.y = y + rng.range(height > 3 ? 1 : 0, height - room.height - (height > 3 ? 1 : 0));
+        carveRoom(room);
+        rooms.push_back(room);
+        return (int)rooms.size() - 1;
+    }
+
+    // Corridor from a seam door on the chunk border to the nearest room of this chunk
+    void connectDoor(int doorX, int doorY) {
+        int best = 0;
+        int bestDistance = -1;
+        for(size_t r = 0; r < rooms.size(); r++) {
+            int distance = abs(rooms[r].centerX() - doorX) + abs(rooms[r].centerY() - doorY);
+            if(bestDistance < 0 || distance < bestDistance) {
+                best = (int)r;
+                bestDistance = distance;
+            }
+        }
+        carveCorridor(doorX, doorY, rooms[best].centerX(), rooms[best].centerY());
+    }
+
+    // Monster strength is filled in once the entrance is known
+    void placeSpawns(vector<DungeonLayout::Spawn>& spawns, bool startChunk) {
+        for(size_t r = 0; r < rooms.size(); r++) {
+            const Room& room = rooms[r];
+            int area = room.width * room.height;
+            bool lair = layout.at(room.x, room.y) == LocationType::MONSTER_LAIR;
+            bool treasure = layout.at(room.x, room.y) == LocationType::TREASURE_ROOM;
+
+            // Fractional expected counts round up by chance, so small rooms still get some
+            int items = area * (treasure ? 2 : 1);
+            int monsters = (startChunk && r == 0) ? 0 : area * (lair ? 3 : 1);
+            int itemCount = items / CELLS_PER_ITEM + (rng.range(0, CELLS_PER_ITEM - 1) < items % CELLS_PER_ITEM ? 1 : 0);
+            int monsterCount = monsters / CELLS_PER_MONSTER +
+                               (rng.range(0, CELLS_PER_MONSTER - 1) < monsters % CELLS_PER_MONSTER ? 1 : 0);
+
+            for(int i = 0; i < itemCount + monsterCount; i++) {
+                DungeonLayout::Spawn spawn;
+                spawn.monster = i >= itemCount;
+                spawn.entry = spawn.monster ? SpawnTables::pick(SpawnTables::monsters(), rng)
+                                            : SpawnTables::pick(SpawnTables::items(), rng);
+                spawn.x = rng.range(room.x, room.x + room.width - 1);
+                spawn.y = rng.range(room.y, room.y + room.height - 1);
+                spawn.scalePercent = 100;
+                spawns.push_back(spawn);
+            }
+        }
+    }
+
+    DungeonGenerator(DungeonLayout& target, Random& random) : layout(target), rng(random) {}
+
+    // Splits the map into roughly CHUNK_SIZE squares; borders depend only on the map size
+    struct ChunkGrid {
+        int width, height;
+        int countX, countY;
+
+        ChunkGrid(int w, int h)
+            : width(w), height(h), countX((w + CHUNK_SIZE - 1) / CHUNK_SIZE), countY((h + CHUNK_SIZE - 1) / CHUNK_SIZE) {}
+
+        int startX(int cx) const { return (int)((int64_t)cx * width / countX); }
+        int startY(int cy) const { return (int)((int64_t)cy * height / countY); }
+    };
+
+    // Independent stream for each chunk or seam, so no result depends on generation order
+    static uint64_t subSeed(uint64_t seed, uint64_t kind, int a, int b) {
+        uint64_t x = seed ^ (kind * 0xD6E8FEB86659FD93ull) ^ ((uint64_t)(uint32_t)a << 32 | (uint32_t)b);
+        Random::splitMix(x);
+        return Random::splitMix(x);
+    }
+
+    // Door cell on the seam between two chunks, away from the corners
+    static int doorOffset(uint64_t seed, uint64_t kind, int a, int b, int span) {
+        if(span <= 2) return 0;
+        Random rng(subSeed(seed, kind, a, b));
+        return rng.range(1, span - 2);
+    }
+
+    struct ChunkResult {
+        vector<DungeonLayout::Spawn> spawns;
+        Room firstRoom;
+        Room lastRoom;
+        bool singleRoom;
+    };
+
+    static void generateChunk(DungeonLayout& layout, const ChunkGrid& grid, uint64_t seed,
+                              int cx, int cy, ChunkResult& result) {
+        int x0 = grid.startX(cx), x1 = grid.startX(cx + 1);
+        int y0 = grid.startY(cy), y1 = grid.startY(cy + 1);
+
+        Random rng(subSeed(seed, 1, cx, cy));
+        DungeonGenerator generator(layout, rng);
+        generator.split(x0, y0, x1 - x0, y1 - y0);
+
+        // Both sides of a seam derive the same door, so corridors meet at the border
+        if(cx > 0) generator.connectDoor(x0, y0 + doorOffset(seed, 2, cx - 1, cy, y1 - y0));
+        if(cx + 1 < grid.countX) generator.connectDoor(x1 - 1, y0 + doorOffset(seed, 2, cx, cy, y1 - y0));
+        if(cy > 0) generator.connectDoor(x0 + doorOffset(seed, 3, cx, cy - 1, x1 - x0), y0);
+        if(cy + 1 < grid.countY) generator.connectDoor(x0 + doorOffset(seed, 3, cx, cy, x1 - x0), y1 - 1);
+
+        generator.placeSpawns(result.spawns, cx == 0 && cy == 0);
+        result.firstRoom = generator.rooms.front();
+        result.lastRoom = generator.rooms.back();
+        result.singleRoom = generator.rooms.size() == 1;
+    }
+
+public:
+    // One pool per process, started by the first parallel generation and reused after
+    static JobSystem& sharedJobs() {
+        static JobSystem jobs;
+        return jobs;
+    }
+
+    static mutex& sharedJobsMutex() {
+        static mutex m;
+        return m;
+    }
+
+    // Runs task(i) for every i in [0, count) on up to `threads` threads (0 = every pool thread).
+    // The range is cut into one piece per thread, so no more threads than pieces take part.
+    // The pool runs one loop at a time; a dungeon built while another is using it runs serially.
+    template<typename Task>
+    static void parallelFor(int count, int threads, const Task& task) {
+        unique_lock<mutex> lock;
+        if(threads != 1 && count > 1) {
+            lock = unique_lock<mutex>(sharedJobsMutex(), try_to_lock);
+        }
+        if(!lock.owns_lock()) {
+            for(int i = 0; i < count; i++) task(i);
+            return;
+        }
+        JobSystem& jobs = sharedJobs();
+        if(threads <= 0 || threads > jobs.getThreadCount()) threads = jobs.getThreadCount();
+        int grain = (count + threads - 1) / threads;
+        jobs.parallelFor(count, grain, [&](int begin, int end) {
+            for(int i = begin; i < end; i++) task(i);
+        });
+    }
+
+    // Chunks are generated in parallel, each from its own sub-seed, so the layout is
+    // identical for any thread count
+    static DungeonLayout generate(int width, int height, uint64_t seed, int threads = 0) {
+        DungeonLayout layout;
+        layout.width = width;
+        layout.height = height;
+        layout.cells.assign((size_t)width * height, (uint8_t)LocationType::EMPTY);
+
+        ChunkGrid grid(width, height);
+        int chunkCount = grid.countX * grid.countY;
+        vector<ChunkResult> chunks(chunkCount);
+        parallelFor(chunkCount, threads, [&](int index) {
+            generateChunk(layout, grid, seed, index % grid.countX, index / grid.countX, chunks[index]);
+        });
+
+        // Entrance in the first room, exit in the last (opposite corners of one room if only one)
+        const Room& first = chunks.front().firstRoom;
+        const Room& last = chunks.back().lastRoom;
+        bool oneRoom = chunkCount == 1 && chunks.front().singleRoom;
+        layout.entranceX = oneRoom ? first.x : first.centerX();
+        layout.entranceY = oneRoom ? first.y : first.centerY();
+        layout.exitX = oneRoom ? last.x + last.width - 1 : last.centerX();
+        layout.exitY = oneRoom ? last.y + last.height - 1 : last.centerY();
+        layout.set(layout.entranceX, layout.entranceY, LocationType::ENTRANCE);
+        layout.set(layout.exitX, layout.exitY, LocationType::EXIT);
+
+        // Monsters get tougher the further they are from the entrance
+        int maxDistance = width + height;
+        for(const ChunkResult& chunk : chunks) {
+            for(const DungeonLayout::Spawn& spawn : chunk.spawns) {
+                bool onStairs = (spawn.x == layout.entranceX && spawn.y == layout.entranceY) ||
+                                (spawn.x == layout.exitX && spawn.y == layout.exitY);
+                if(onStairs) continue;
+                layout.spawns.push_back(spawn);
+                if(spawn.monster) {
+                    int distance = abs(spawn.x - layout.entranceX) + abs(spawn.y - layout.entranceY);
+                    layout.spawns.back().scalePercent = 100 + 100 * distance / maxDistance;
+                }
+            }
+        }
+        return layout;
+    }
+};
+
+#endif
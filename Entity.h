@@ -2,10 +2,24 @@
 #define ENTITY_H
 
 #include "String.h"
+#include "SaveFormat.h"
+#include "OutputSink.h"
+#include "StateHash.h"
 #include <iostream>
 #include <fstream>
 using namespace std;
 
+class Entity;
+
+// Told when a tracked entity appears on the map, moves, or leaves it (see SpatialIndex.h)
+class EntityTracker {
+public:
+    virtual ~EntityTracker() {}
+    virtual void entityPlaced(Entity& entity) = 0;
+    virtual void entityMoved(Entity& entity, int oldX, int oldY) = 0;
+    virtual void entityRemoved(Entity& entity) = 0;
+};
+
 // Base Entity class - demonstrates inheritance hierarchy
 class Entity {
 protected:
@@ -13,16 +27,44 @@ protected:
     int x, y;  // Position coordinates
     int id;
     bool isActive;
+    EntityTracker* tracker; // Index kept informed of this entity's position, if any
+    bool placed;            // Lying in a dungeon cell (as opposed to e.g. carried)
+    int trackerSlot;        // Where the tracker keeps this entity, so it finds it without searching
+    StateHash* stateHash;   // World hash this entity is counted in, if any
+    uint64_t hashSubject;   // Under which name
+    
+    // Hashed fields are written through here so the world's hash follows them
+    template<typename T>
+    void assign(T& field, const T& value, StateHash::Field which) {
+        StateHash::assign(stateHash, hashSubject, which, field, value);
+    }
 
 public:
-    Entity() : x(0), y(0), id(0), isActive(true) {
+    Entity() : x(0), y(0), id(0), isActive(true), tracker(nullptr), placed(false), trackerSlot(-1),
+               stateHash(nullptr), hashSubject(0) {
         name = "Unknown";
     }
     
     Entity(const String& entityName, int posX, int posY, int entityId) 
-        : name(entityName), x(posX), y(posY), id(entityId), isActive(true) {}
+        : name(entityName), x(posX), y(posY), id(entityId), isActive(true), tracker(nullptr), placed(false),
+          trackerSlot(-1), stateHash(nullptr), hashSubject(0) {}
     
-    virtual ~Entity() {}
+    // A copy is a new entity: it is not on the map and nothing tracks or hashes it
+    Entity(const Entity& other)
+        : name(other.name), x(other.x), y(other.y), id(other.id), isActive(other.isActive),
+          tracker(nullptr), placed(false), trackerSlot(-1), stateHash(nullptr), hashSubject(0) {}
+    
+    Entity& operator=(const Entity& other) {
+        assign(name, other.name, StateHash::NAME);
+        setPosition(other.x, other.y);
+        id = other.id;
+        assign(isActive, other.isActive, StateHash::ACTIVE);
+        return *this;
+    }
+    
+    virtual ~Entity() {
+        setTracker(nullptr);
+    }
     
     // Pure virtual function for polymorphism
     virtual void display() const = 0;
@@ -30,40 +72,75 @@ public:
     
     // Getters and Setters
     String getName() const { return name; }
-    void setName(const String& newName) { name = newName; }
+    void setName(const String& newName) { assign(name, newName, StateHash::NAME); }
     int getX() const { return x; }
     int getY() const { return y; }
-    void setPosition(int newX, int newY) { x = newX; y = newY; }
+    void setPosition(int newX, int newY) {
+        int oldX = x, oldY = y;
+        assign(x, newX, StateHash::X);
+        assign(y, newY, StateHash::Y);
+        if(placed && tracker && (oldX != newX || oldY != newY)) tracker->entityMoved(*this, oldX, oldY);
+    }
     int getId() const { return id; }
     bool getActive() const { return isActive; }
-    void setActive(bool active) { isActive = active; }
+    void setActive(bool active) { assign(isActive, active, StateHash::ACTIVE); }
     
-    // Virtual functions for polymorphism
-    virtual void serialize(ofstream& file) const {
-        int nameLen = name.size();
-        file.write(reinterpret_cast<const char*>(&nameLen), sizeof(nameLen));
-        for(int i = 0; i < nameLen; i++) {
-            file.write(&name[i], sizeof(char));
+    // Location calls this as the entity is put into or taken out of a cell
+    void setPlaced(bool onMap) {
+        if(onMap == placed) return;
+        placed = onMap;
+        if(tracker) {
+            if(placed) tracker->entityPlaced(*this);
+            else tracker->entityRemoved(*this);
         }
-        file.write(reinterpret_cast<const char*>(&x), sizeof(x));
-        file.write(reinterpret_cast<const char*>(&y), sizeof(y));
-        file.write(reinterpret_cast<const char*>(&id), sizeof(id));
-        file.write(reinterpret_cast<const char*>(&isActive), sizeof(isActive));
     }
     
-    virtual void deserialize(ifstream& file) {
-        int nameLen;
-        file.read(reinterpret_cast<char*>(&nameLen), sizeof(nameLen));
-        name.clear();
-        for(int i = 0; i < nameLen; i++) {
-            char ch;
-            file.read(&ch, sizeof(char));
-            name.push_back(ch);
-        }
-        file.read(reinterpret_cast<char*>(&x), sizeof(x));
-        file.read(reinterpret_cast<char*>(&y), sizeof(y));
-        file.read(reinterpret_cast<char*>(&id), sizeof(id));
-        file.read(reinterpret_cast<char*>(&isActive), sizeof(isActive));
+    bool isPlaced() const { return placed; }
+    
+    int getTrackerSlot() const { return trackerSlot; }
+    void setTrackerSlot(int slot) { trackerSlot = slot; }
+    
+    void setTracker(EntityTracker* newTracker) {
+        if(newTracker == tracker) return;
+        if(placed && tracker) tracker->entityRemoved(*this);
+        tracker = newTracker;
+        if(placed && tracker) tracker->entityPlaced(*this);
+    }
+    
+    // This entity's share of the state hash when counted as `subject`
+    virtual uint64_t hashContribution(uint64_t subject) const {
+        StateHash::Keys key(subject);
+        return key(StateHash::NAME, StateHash::value(name)) ^
+               key(StateHash::X, StateHash::value(x)) ^
+               key(StateHash::Y, StateHash::value(y)) ^
+               key(StateHash::ACTIVE, StateHash::value(isActive));
+    }
+    
+    // Counts this entity into `hash` as `subject`, taking it out of the hash it was in
+    // (nullptr just takes it out). Deleting an entity leaves the hash alone, so whoever
+    // takes it out of the world detaches it first. deserialize fills only detached ones.
+    virtual void attachHash(StateHash* hash, uint64_t subject) {
+        if(stateHash) stateHash->change(hashSubject, hashContribution(hashSubject));
+        stateHash = hash;
+        hashSubject = subject;
+        if(stateHash) stateHash->change(hashSubject, hashContribution(hashSubject));
+    }
+    
+    // Virtual functions for polymorphism
+    virtual void serialize(SaveWriter& out) const {
+        out.writeString(name);
+        out.writeI32(x);
+        out.writeI32(y);
+        out.writeI32(id);
+        out.writeBool(isActive);
+    }
+    
+    virtual void deserialize(SaveReader& in) {
+        name = in.readString();
+        x = in.readI32();
+        y = in.readI32();
+        id = in.readI32();
+        isActive = in.readBool();
     }
     
     // Operator overloading
@@ -0,0 +1,185 @@
+#ifndef EVENT_BUS_H
+#define EVENT_BUS_H
+
+#include "Entity.h"
+#include "Item.h"
+#include "String.h"
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <functional>
+#include <cstring>
+using namespace std;
+
+// Typed publish/subscribe with one queue per event type.
+//
+// publish() only appends to the type's queue, so gameplay code states what happened and
+// moves on. dispatch() hands each queue to its subscribers as one contiguous array, in
+// the order the types were first subscribed to, and then empties it. Queues keep their
+// capacity between dispatches, so once the busiest turn has been seen publishing never
+// allocates. Events published by a subscriber go out in the next round of the same
+// dispatch.
+class EventBus {
+public:
+    static const int MAX_ROUNDS = 8; // Bounds subscribers that keep publishing to each other
+
+private:
+    struct QueueBase {
+        virtual ~QueueBase() {}
+        virtual size_t size() const = 0;
+        virtual void deliver() = 0;
+        virtual void clear() = 0;
+    };
+
+    template<typename E>
+    struct Queue : QueueBase {
+        vector<E> events;
+        vector<E> delivering; // Swapped in while subscribers run, so they may publish more
+        vector<function<void(const E*, size_t)>> subscribers;
+
+        size_t size() const override { return events.size(); }
+
+        void deliver() override {
+            events.swap(delivering);
+            for(const auto& subscriber : subscribers) {
+                subscriber(delivering.data(), delivering.size());
+            }
+            delivering.clear();
+        }
+
+        void clear() override { events.clear(); }
+    };
+
+    vector<unique_ptr<QueueBase>> queues; // Indexed by typeIndex<E>()
+    vector<QueueBase*> order;             // Delivery order
+
+    static int nextTypeIndex() {
+        static atomic<int> counter(0);
+        return counter++;
+    }
+
+    // Dense per-type number shared by every bus in the process
+    template<typename E>
+    static int typeIndex() {
+        static const int index = nextTypeIndex();
+        return index;
+    }
+
+    template<typename E>
+    Queue<E>& queue() {
+        size_t index = (size_t)typeIndex<E>();
+        if(index >= queues.size()) queues.resize(index + 1);
+        if(!queues[index]) {
+            queues[index].reset(new Queue<E>());
+            order.push_back(queues[index].get());
+        }
+        return *static_cast<Queue<E>*>(queues[index].get());
+    }
+
+public:
+    EventBus() {}
+
+    EventBus(const EventBus&) = delete;
+    EventBus& operator=(const EventBus&) = delete;
+
+    // handler(events, count) sees every E published since the last dispatch
+    template<typename E>
+    void subscribe(function<void(const E*, size_t)> handler) {
+        queue<E>().subscribers.push_back(handler);
+    }
+
+    template<typename E>
+    void publish(const E& event) {
+        queue<E>().events.push_back(event);
+    }
+
+    // Room for `count` events of type E, so even the first busy turn does not grow the queue
+    template<typename E>
+    void reserve(size_t count) {
+        Queue<E>& q = queue<E>();
+        q.events.reserve(count);
+        q.delivering.reserve(count);
+    }
+
+    void dispatch() {
+        for(int round = 0; round < MAX_ROUNDS; round++) {
+            bool delivered = false;
+            for(QueueBase* q : order) {
+                if(q->size() == 0) continue;
+                q->deliver();
+                delivered = true;
+            }
+            if(!delivered) return;
+        }
+        discard();
+    }
+
+    // Drops everything undelivered, e.g. when the world it refers to is replaced
+    void discard() {
+        for(QueueBase* q : order) q->clear();
+    }
+
+    // Events published but not yet delivered, over all types
+    size_t getPending() const {
+        size_t count = 0;
+        for(const QueueBase* q : order) count += q->size();
+        return count;
+    }
+};
+
+// Gameplay events. They are plain values: entities are referenced by pointer (they outlive
+// the turn they were published in) and names of items that may be consumed are copied.
+static const int EVENT_NAME_SIZE = 32;
+
+inline void copyEventName(char (&dest)[EVENT_NAME_SIZE], const String& name) {
+    strncpy(dest, name.c_str(), EVENT_NAME_SIZE - 1);
+    dest[EVENT_NAME_SIZE - 1] = '\0';
+}
+
+struct PlayerMoved {
+    const Entity* player;
+    int x, y;
+};
+
+struct ItemPickedUp {
+    const Entity* player;
+    int itemId;
+    ItemType type;
+    int x, y;         // Cell the item was lying in
+    char name[EVENT_NAME_SIZE];
+};
+
+struct ItemUsed {
+    const Entity* player;
+    int itemId;
+    ItemType type;
+    int value;
+    char name[EVENT_NAME_SIZE];
+};
+
+struct CombatHit {
+    const Entity* attacker;
+    const Entity* defender;
+    int damage;
+    int healthAfter;  // Defender's
+    bool byPlayer;
+};
+
+// A fight settled in one step (CombatPolicy::resolveAtOnce) instead of round by round
+struct CombatResolved {
+    const Entity* player;
+    const Entity* monster;
+    int outcome;      // CombatOutcome
+    int rounds;
+    int damageDealt;
+    int damageTaken;
+};
+
+struct EntityDied {
+    const Entity* victim;
+    const Entity* killer;
+    int x, y;
+    int experience;   // Reward for the killer
+};
+
+#endif
@@ -0,0 +1,92 @@
+// Offline decoder for the binary event log written by EventLog
+// Usage: EventDecoder <events.bin> [--csv]
+#include "EventLog.h"
+#include "CombatRules.h"
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+using namespace std;
+
+EventLog* gameEvents = nullptr;
+
+int main(int argc, char* argv[])
+{
+    if(argc < 2)
+    {
+        cerr << "Usage: " << argv[0] << " <events.bin> [--csv]" << endl;
+        return 1;
+    }
+    bool csv = argc > 2 && strcmp(argv[2], "--csv") == 0;
+
+    ifstream input(argv[1], ios::binary);
+    if(!input.is_open())
+    {
+        cerr << "Cannot open " << argv[1] << endl;
+        return 1;
+    }
+
+    EventLogReader reader(input);
+    if(!reader.isValid())
+    {
+        cerr << argv[1] << " is not an event log" << endl;
+        return 1;
+    }
+
+    if(csv)
+    {
+        cout << "timestamp_ns,event,subject,a,b,c\n";
+    }
+
+    GameEvent event;
+    long long count = 0;
+    char line[160];
+    while(reader.next(event))
+    {
+        if(csv)
+        {
+            snprintf(line, sizeof(line), "%llu,%s,%d,%d,%d,%d\n", (unsigned long long)event.timestampNs,
+                     eventName(event.id), event.subject, event.a, event.b, event.c);
+        }
+        else
+        {
+            double ms = event.timestampNs / 1e6;
+            switch((GameEventId)event.id)
+            {
+                case GameEventId::MOVE:
+                    snprintf(line, sizeof(line), "%12.3f ms  MOVE        entity %d -> (%d, %d)\n",
+                             ms, event.subject, event.a, event.b);
+                    break;
+                case GameEventId::PICKUP:
+                    snprintf(line, sizeof(line), "%12.3f ms  PICKUP      entity %d took item %d (type %d)\n",
+                             ms, event.subject, event.a, event.b);
+                    break;
+                case GameEventId::USE_ITEM:
+                    snprintf(line, sizeof(line), "%12.3f ms  USE_ITEM    entity %d used item %d (type %d, value %d)\n",
+                             ms, event.subject, event.a, event.b, event.c);
+                    break;
+                case GameEventId::COMBAT_HIT:
+                    snprintf(line, sizeof(line), "%12.3f ms  COMBAT_HIT  entity %d hit %d for %d (health left %d)\n",
+                             ms, event.subject, event.a, event.b, event.c);
+                    break;
+                case GameEventId::DEATH:
+                    snprintf(line, sizeof(line), "%12.3f ms  DEATH       entity %d killed by %d\n",
+                             ms, event.subject, event.a);
+                    break;
+                case GameEventId::COMBAT:
+                    snprintf(line, sizeof(line), "%12.3f ms  COMBAT      entity %d vs %d: %s after %d rounds\n",
+                             ms, event.subject, event.a, outcomeName(event.b), event.c);
+                    break;
+                default:
+                    snprintf(line, sizeof(line), "%12.3f ms  EVENT %-5u  %d %d %d %d\n",
+                             ms, (unsigned)event.id, event.subject, event.a, event.b, event.c);
+                    break;
+            }
+        }
+        cout << line;
+        count++;
+    }
+
+    cerr << count << " events" << endl;
+    return 0;
+}
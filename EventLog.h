@@ -0,0 +1,223 @@
+#ifndef EVENT_LOG_H
+#define EVENT_LOG_H
+
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <mutex>
+#include <cstdint>
+#include <cstring>
+using namespace std;
+
+// Typed gameplay events for analytics; numbering is part of the file format
+enum class GameEventId : uint16_t {
+    MOVE = 1,        // subject=player, a=x, b=y
+    PICKUP = 2,      // subject=player, a=item id, b=item type
+    USE_ITEM = 3,    // subject=player, a=item id, b=item type, c=value
+    COMBAT_HIT = 4,  // subject=attacker, a=defender, b=damage, c=defender health after
+    DEATH = 5,       // subject=entity that died, a=killer
+    COMBAT = 6       // subject=player, a=monster, b=outcome (CombatOutcome), c=rounds; a fight resolved at once
+};
+
+inline const char* eventName(uint16_t id) {
+    switch(id) {
+        case (uint16_t)GameEventId::MOVE: return "MOVE";
+        case (uint16_t)GameEventId::PICKUP: return "PICKUP";
+        case (uint16_t)GameEventId::USE_ITEM: return "USE_ITEM";
+        case (uint16_t)GameEventId::COMBAT_HIT: return "COMBAT_HIT";
+        case (uint16_t)GameEventId::DEATH: return "DEATH";
+        case (uint16_t)GameEventId::COMBAT: return "COMBAT";
+        default: return "UNKNOWN";
+    }
+}
+
+// One decoded record
+struct GameEvent {
+    uint64_t timestampNs; // steady_clock, relative to the file's start time
+    uint16_t id;
+    int32_t subject;
+    int32_t a, b, c;
+};
+
+// File layout (little-endian):
+//   header: "DCEV" | version u16 | recordSize u16 | startTime u64 (steady_clock ns)
+//   records of RECORD_SIZE bytes: timestamp u64 | id u16 | reserved u16 | subject i32 | a i32 | b i32 | c i32
+class EventFormat {
+public:
+    static const uint16_t VERSION = 1;
+    static const int HEADER_SIZE = 16;
+    static const int RECORD_SIZE = 32;
+
+    static const char* magic() { return "DCEV"; }
+
+    static void put16(uint8_t* p, uint16_t v) {
+        p[0] = (uint8_t)v;
+        p[1] = (uint8_t)(v >> 8);
+    }
+
+    static void put32(uint8_t* p, uint32_t v) {
+        for(int i = 0; i < 4; i++) p[i] = (uint8_t)(v >> (8 * i));
+    }
+
+    static void put64(uint8_t* p, uint64_t v) {
+        for(int i = 0; i < 8; i++) p[i] = (uint8_t)(v >> (8 * i));
+    }
+
+    static uint16_t get16(const uint8_t* p) {
+        return (uint16_t)(p[0] | (p[1] << 8));
+    }
+
+    static uint32_t get32(const uint8_t* p) {
+        return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+
+    static uint64_t get64(const uint8_t* p) {
+        return (uint64_t)get32(p) | ((uint64_t)get32(p + 4) << 32);
+    }
+};
+
+// Appends fixed-size records to an in-memory block and writes whole blocks to disk
+class EventLog {
+private:
+    static const int BUFFERED_RECORDS = 2048;
+
+    ofstream file;
+    uint8_t buffer[BUFFERED_RECORDS * EventFormat::RECORD_SIZE];
+    int pending;
+    uint64_t startNs;
+    uint64_t written;
+    mutex writeMutex; // Sessions on several threads share one sink
+
+    static uint64_t nowNs() {
+        return (uint64_t)chrono::duration_cast<chrono::nanoseconds>(
+            chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Caller holds writeMutex
+    void flushLocked() {
+        if(pending == 0) return;
+        if(file.is_open()) {
+            file.write(reinterpret_cast<const char*>(buffer), pending * EventFormat::RECORD_SIZE);
+            file.flush();
+        }
+        written += pending;
+        pending = 0;
+    }
+
+    // Caller holds writeMutex
+    void appendLocked(uint64_t timestampNs, GameEventId id, int subject, int a, int b, int c) {
+        if(pending == BUFFERED_RECORDS) flushLocked();
+        uint8_t* p = buffer + pending * EventFormat::RECORD_SIZE;
+        EventFormat::put64(p, timestampNs);
+        EventFormat::put16(p + 8, (uint16_t)id);
+        EventFormat::put16(p + 10, 0);
+        EventFormat::put32(p + 12, (uint32_t)subject);
+        EventFormat::put32(p + 16, (uint32_t)a);
+        EventFormat::put32(p + 20, (uint32_t)b);
+        EventFormat::put32(p + 24, (uint32_t)c);
+        EventFormat::put32(p + 28, 0);
+        pending++;
+    }
+
+public:
+    EventLog(const char* fileName = "events.bin") : pending(0), written(0) {
+        startNs = nowNs();
+        file.open(fileName, ios::binary | ios::trunc);
+        if(!file.is_open()) {
+            cerr << "Warning: Could not open event log " << fileName << endl;
+            return;
+        }
+        uint8_t header[EventFormat::HEADER_SIZE];
+        memcpy(header, EventFormat::magic(), 4);
+        EventFormat::put16(header + 4, EventFormat::VERSION);
+        EventFormat::put16(header + 6, EventFormat::RECORD_SIZE);
+        EventFormat::put64(header + 8, startNs);
+        file.write(reinterpret_cast<const char*>(header), sizeof(header));
+    }
+
+    ~EventLog() {
+        flush();
+    }
+
+    EventLog(const EventLog&) = delete;
+    EventLog& operator=(const EventLog&) = delete;
+
+    void record(GameEventId id, int subject, int a = 0, int b = 0, int c = 0) {
+        lock_guard<mutex> lock(writeMutex);
+        appendLocked(nowNs() - startNs, id, subject, a, b, c);
+    }
+
+    // Appends `count` records under one lock and one timestamp. describe(i, record) fills
+    // in id, subject, a, b and c of record i.
+    template<typename Describe>
+    void recordBatch(size_t count, Describe describe) {
+        if(count == 0) return;
+        lock_guard<mutex> lock(writeMutex);
+        uint64_t timestampNs = nowNs() - startNs;
+        for(size_t i = 0; i < count; i++) {
+            GameEvent event = GameEvent{timestampNs, 0, 0, 0, 0, 0};
+            describe(i, event);
+            appendLocked(timestampNs, (GameEventId)event.id, event.subject, event.a, event.b, event.c);
+        }
+    }
+
+    void flush() {
+        lock_guard<mutex> lock(writeMutex);
+        flushLocked();
+    }
+
+    uint64_t getRecordCount() {
+        lock_guard<mutex> lock(writeMutex);
+        return written + pending;
+    }
+};
+
+// Sequential reader used by the offline decoder
+class EventLogReader {
+private:
+    istream& in;
+    uint16_t recordSize;
+    uint64_t startNs;
+    bool valid;
+
+public:
+    EventLogReader(istream& input) : in(input), recordSize(0), startNs(0), valid(false) {
+        uint8_t header[EventFormat::HEADER_SIZE];
+        in.read(reinterpret_cast<char*>(header), sizeof(header));
+        if(in.gcount() != (streamsize)sizeof(header) || memcmp(header, EventFormat::magic(), 4) != 0) {
+            return;
+        }
+        // Newer versions may only grow the record, so anything at least as large is readable
+        recordSize = EventFormat::get16(header + 6);
+        startNs = EventFormat::get64(header + 8);
+        valid = EventFormat::get16(header + 4) >= 1 && recordSize >= EventFormat::RECORD_SIZE;
+    }
+
+    bool isValid() const { return valid; }
+    uint64_t getStartNs() const { return startNs; }
+
+    bool next(GameEvent& event) {
+        if(!valid) return false;
+        uint8_t raw[256];
+        if(recordSize > sizeof(raw)) return false;
+        in.read(reinterpret_cast<char*>(raw), recordSize);
+        if(in.gcount() != recordSize) return false;
+        event.timestampNs = EventFormat::get64(raw);
+        event.id = EventFormat::get16(raw + 8);
+        event.subject = (int32_t)EventFormat::get32(raw + 12);
+        event.a = (int32_t)EventFormat::get32(raw + 16);
+        event.b = (int32_t)EventFormat::get32(raw + 20);
+        event.c = (int32_t)EventFormat::get32(raw + 24);
+        return true;
+    }
+};
+
+// Global event sink, created by GameEngine
+extern EventLog* gameEvents;
+
+#define RECORD_EVENT(...) \
+    do { \
+        if(gameEvents) gameEvents->record(__VA_ARGS__); \
+    } while(0)
+
+#endif
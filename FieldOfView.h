@@ -0,0 +1,184 @@
+#ifndef FIELD_OF_VIEW_H
+#define FIELD_OF_VIEW_H
+
+#include <vector>
+#include <cstdint>
+using namespace std;
+
+// One bit per cell
+class BitGrid {
+private:
+    int width;
+    vector<uint64_t> words;
+
+public:
+    BitGrid() : width(0) {}
+
+    void reset(int w, int h) {
+        width = w;
+        words.assign(((size_t)w * h + 63) / 64, 0);
+    }
+
+    bool test(int x, int y) const {
+        size_t bit = (size_t)y * width + x;
+        return (words[bit >> 6] >> (bit & 63)) & 1;
+    }
+
+    void set(int x, int y) {
+        size_t bit = (size_t)y * width + x;
+        words[bit >> 6] |= 1ull << (bit & 63);
+    }
+
+    void clear(int x, int y) {
+        size_t bit = (size_t)y * width + x;
+        words[bit >> 6] &= ~(1ull << (bit & 63));
+    }
+};
+
+// Symmetric shadowcasting (if A can see B, B can see A) over the four quadrants.
+// Slopes are exact fractions, so there is no floating point drift on large radii.
+// Only cells within the radius are touched: the previous visible set is cleared from
+// its own cell list rather than by wiping the grid.
+class FieldOfView {
+private:
+    struct Slope {
+        long long num, den; // den > 0
+    };
+
+    struct Row {
+        int depth;
+        Slope start, end;
+    };
+
+    int width, height;
+    int radius;
+    BitGrid visible;
+    BitGrid seen;                 // Everything ever visible; never cleared by recompute
+    vector<int> visibleCells;     // y * width + x of the cells in `visible`
+    vector<int> changedCells;     // Cells whose visibility changed in the last compute
+    int originX, originY;
+    int quadrant;
+
+    static long long floorDiv(long long a, long long b) {
+        long long q = a / b;
+        return (a % b != 0 && ((a < 0) != (b < 0))) ? q - 1 : q;
+    }
+
+    // floor(depth * slope + 1/2) and ceil(depth * slope - 1/2)
+    static int roundTiesUp(int depth, Slope s) {
+        return (int)floorDiv(2 * depth * s.num + s.den, 2 * s.den);
+    }
+
+    static int roundTiesDown(int depth, Slope s) {
+        return (int)-floorDiv(-(2 * depth * s.num - s.den), 2 * s.den);
+    }
+
+    // Quadrant-local (depth, column) to map coordinates
+    void toMap(int depth, int col, int& x, int& y) const {
+        switch(quadrant) {
+            case 0: x = originX + col; y = originY - depth; break; // North
+            case 1: x = originX + col; y = originY + depth; break; // South
+            case 2: x = originX + depth; y = originY + col; break; // East
+            default: x = originX - depth; y = originY + col; break; // West
+        }
+    }
+
+    void reveal(int x, int y) {
+        if(visible.test(x, y)) return;
+        visible.set(x, y);
+        seen.set(x, y);
+        visibleCells.push_back(y * width + x);
+    }
+
+    template<typename Blocked>
+    bool isWall(int depth, int col, const Blocked& blocked) const {
+        int x, y;
+        toMap(depth, col, x, y);
+        return x < 0 || y < 0 || x >= width || y >= height || blocked(x, y);
+    }
+
+    bool inRadius(int depth, int col) const {
+        return depth * depth + col * col <= radius * radius + radius;
+    }
+
+    template<typename Blocked>
+    void scan(Row row, const Blocked& blocked) {
+        if(row.depth > radius) return;
+        int minCol = roundTiesUp(row.depth, row.start);
+        int maxCol = roundTiesDown(row.depth, row.end);
+        bool hasPrevious = false;
+        bool previousWall = false;
+        for(int col = minCol; col <= maxCol; col++) {
+            bool wall = isWall(row.depth, col, blocked);
+            // Floors only count as visible when the centre lies inside the view (symmetry)
+            bool symmetric = col * row.start.den >= row.depth * row.start.num &&
+                             col * row.end.den <= row.depth * row.end.num;
+            if((wall || symmetric) && inRadius(row.depth, col)) {
+                int x, y;
+                toMap(row.depth, col, x, y);
+                if(x >= 0 && y >= 0 && x < width && y < height) reveal(x, y);
+            }
+            if(hasPrevious && previousWall && !wall) {
+                row.start = Slope{2 * col - 1, 2 * row.depth};
+            }
+            if(hasPrevious && !previousWall && wall) {
+                Row next{row.depth + 1, row.start, Slope{2 * col - 1, 2 * row.depth}};
+                scan(next, blocked);
+            }
+            hasPrevious = true;
+            previousWall = wall;
+        }
+        if(hasPrevious && !previousWall) {
+            scan(Row{row.depth + 1, row.start, row.end}, blocked);
+        }
+    }
+
+public:
+    FieldOfView(int viewRadius = 8) : width(0), height(0), radius(viewRadius), originX(0), originY(0), quadrant(0) {}
+
+    // New map: forget everything seen
+    void resize(int w, int h) {
+        width = w;
+        height = h;
+        visible.reset(w, h);
+        seen.reset(w, h);
+        visibleCells.clear();
+        changedCells.clear();
+    }
+
+    void setRadius(int viewRadius) {
+        radius = viewRadius > 0 ? viewRadius : 0;
+    }
+
+    int getRadius() const { return radius; }
+
+    // Recomputes what is visible from (x, y); blocked(x, y) says whether a cell stops sight.
+    // Afterwards getChangedCells() lists every cell that became visible or stopped being visible.
+    template<typename Blocked>
+    void compute(int x, int y, const Blocked& blocked) {
+        changedCells.clear();
+        for(int cell : visibleCells) {
+            visible.clear(cell % width, cell / width);
+            changedCells.push_back(cell);
+        }
+        visibleCells.clear();
+        if(x < 0 || y < 0 || x >= width || y >= height) return;
+
+        originX = x;
+        originY = y;
+        reveal(x, y);
+        for(quadrant = 0; quadrant < 4; quadrant++) {
+            scan(Row{1, Slope{-1, 1}, Slope{1, 1}}, blocked);
+        }
+        // Cells visible both before and after are listed twice; harmless for dirty marking
+        changedCells.insert(changedCells.end(), visibleCells.begin(), visibleCells.end());
+    }
+
+    bool isVisible(int x, int y) const { return visible.test(x, y); }
+    bool wasSeen(int x, int y) const { return seen.test(x, y); }
+
+    const vector<int>& getVisibleCells() const { return visibleCells; }
+    const vector<int>& getChangedCells() const { return changedCells; }
+};
+
+#endif
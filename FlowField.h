@@ -0,0 +1,143 @@
+#ifndef FLOW_FIELD_H
+#define FLOW_FIELD_H
+
+#include "Dungeon.h"
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+using namespace std;
+
+// Dijkstra map toward one target (the player): every reachable cell within `radius`
+// steps stores its distance and the direction of its next step, so any number of
+// chasing monsters each read their move in O(1).
+//
+// The field is rebuilt only when the target moves or the dungeon's layout version
+// changes. A rebuild is a breadth-first search bounded by the radius, so it touches
+// O(radius^2) cells however large the map is; per-cell state is validated by a
+// generation stamp instead of being cleared.
+class FlowField {
+public:
+    static const uint16_t UNREACHED = 0xFFFF;
+
+    enum Direction : uint8_t {
+        NORTH,
+        SOUTH,
+        EAST,
+        WEST,
+        STAY // The target itself
+    };
+
+private:
+    int width, height;
+    int radius;
+    int targetX, targetY;
+    uint64_t layoutVersion;
+    bool valid;
+
+    vector<uint16_t> distance; // Valid where stamp == generation
+    vector<uint8_t> toward;
+    vector<uint32_t> stamp;
+    uint32_t generation;
+    vector<int> reached;       // Cells of the last rebuild in order of distance; doubles as the BFS queue
+    long long rebuilds;
+
+    void rebuild(const Dungeon& dungeon) {
+        if(dungeon.getWidth() != width || dungeon.getHeight() != height) {
+            width = dungeon.getWidth();
+            height = dungeon.getHeight();
+            size_t cells = (size_t)width * height;
+            distance.assign(cells, (uint16_t)UNREACHED);
+            toward.assign(cells, STAY);
+            stamp.assign(cells, 0);
+            generation = 0;
+        }
+        if(++generation == 0) {
+            fill(stamp.begin(), stamp.end(), 0);
+            generation = 1;
+        }
+        reached.clear();
+        rebuilds++;
+        if(!dungeon.isAccessible(targetX, targetY)) return;
+
+        int origin = targetY * width + targetX;
+        stamp[origin] = generation;
+        distance[origin] = 0;
+        toward[origin] = STAY;
+        reached.push_back(origin);
+
+        // A monster on the neighbour reached through this edge steps back the way we came
+        static const int dx[4] = {0, 0, 1, -1};
+        static const int dy[4] = {-1, 1, 0, 0};
+        static const uint8_t back[4] = {SOUTH, NORTH, WEST, EAST};
+        for(size_t head = 0; head < reached.size(); head++) {
+            int cell = reached[head];
+            uint16_t next = distance[cell] + 1;
+            if(next > radius) continue;
+            int x = cell % width;
+            int y = cell / width;
+            for(int d = 0; d < 4; d++) {
+                int nx = x + dx[d];
+                int ny = y + dy[d];
+                if(nx < 0 || ny < 0 || nx >= width || ny >= height) continue;
+                int neighbour = ny * width + nx;
+                if(stamp[neighbour] == generation || !dungeon.isAccessible(nx, ny)) continue;
+                stamp[neighbour] = generation;
+                distance[neighbour] = next;
+                toward[neighbour] = back[d];
+                reached.push_back(neighbour);
+            }
+        }
+    }
+
+public:
+    FlowField(int chaseRadius = 24)
+        : width(0), height(0), radius(chaseRadius), targetX(-1), targetY(-1), layoutVersion(0),
+          valid(false), generation(0), rebuilds(0) {
+        if(radius < 1) radius = 1;
+        if(radius > UNREACHED - 1) radius = UNREACHED - 1;
+    }
+
+    // Brings the field up to date; returns true if it had to be rebuilt
+    bool update(const Dungeon& dungeon, int x, int y) {
+        if(valid && x == targetX && y == targetY && dungeon.getLayoutVersion() == layoutVersion &&
+           dungeon.getWidth() == width && dungeon.getHeight() == height) {
+            return false;
+        }
+        targetX = x;
+        targetY = y;
+        layoutVersion = dungeon.getLayoutVersion();
+        rebuild(dungeon);
+        valid = true;
+        return true;
+    }
+
+    void invalidate() {
+        valid = false;
+    }
+
+    uint16_t distanceAt(int x, int y) const {
+        if(x < 0 || y < 0 || x >= width || y >= height) return UNREACHED;
+        size_t cell = (size_t)y * width + x;
+        return stamp[cell] == generation ? distance[cell] : UNREACHED;
+    }
+
+    // Cell one step closer to the target; false if out of range or already there
+    bool nextStep(int x, int y, int& nextX, int& nextY) const {
+        if(distanceAt(x, y) == UNREACHED) return false;
+        switch(toward[(size_t)y * width + x]) {
+            case NORTH: nextX = x; nextY = y - 1; return true;
+            case SOUTH: nextX = x; nextY = y + 1; return true;
+            case EAST: nextX = x + 1; nextY = y; return true;
+            case WEST: nextX = x - 1; nextY = y; return true;
+            default: return false;
+        }
+    }
+
+    // Every cell in range, nearest first
+    const vector<int>& getReachedCells() const { return reached; }
+
+    int getRadius() const { return radius; }
+    long long getRebuildCount() const { return rebuilds; }
+};
+
+#endif
@@ -4,16 +4,36 @@
 #include "Dungeon.h"
 #include "Character.h"
 #include "Logger.h"
+#include "EventLog.h"
 #include "GameExceptions.h"
+#include "SaveCompression.h"
+#include "SaveFormat.h"
+#include "CommandTable.h"
+#include "Headless.h"
+#include "MapRenderer.h"
+#include "Pathfinder.h"
+#include "WorldSimulation.h"
+#include "EventBus.h"
+#include "Replay.h"
+#include "WorldHistory.h"
 #include "String.h"
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <chrono>
+#include <memory>
+#include <mutex>
 using namespace std;
 
 // Initialize global logger
 Logger<String>* gameLogger = nullptr;
 
+// Initialize global event sink
+EventLog* gameEvents = nullptr;
+
+// Per-thread response buffer for everything the game prints
+thread_local GameOutput gameOutput;
+
 class GameEngine {
 private:
     Dungeon* dungeon;
@@ -21,12 +41,39 @@ private:
     bool gameRunning;
     bool gameWon;
     String saveFileName;
+    bool compressSaves;
+    unsigned sessionId; // Tags this engine's log lines when several run in one process
+    CombatPolicy combatPolicy;
+    MapRenderer mapRenderer;
+    uint64_t worldSeed; // 0 = the fixed hand-made dungeon
+    int worldWidth, worldHeight;
+    Pathfinder pathfinder;
+    vector<GridPoint> route; // Reused by goto
+    WorldSimulation world;   // Monsters act, heal and spawn as game time passes
+    EventBus eventBus;       // What each command did, delivered to the systems below once it ends
+    unique_ptr<SessionRecorder> recorder;   // Set while a session is being recorded
+    const vector<uint8_t>* replayAnswers;   // Combat prompt answers while a recording is replayed
+    size_t nextAnswer;
+    const SessionLog* replayLoads;          // Files loads read while a recording is replayed
+    size_t nextLoad;
+    WorldHistory history;    // Undo steps, one per command that changed the game
+    bool turnTaken;          // Cleared by commands that do not let game time pass
+    
+    // The logger and event sink are shared by every engine in the process
+    static mutex& sharedSinkMutex() {
+        static mutex m;
+        return m;
+    }
+    
+    static int& liveEngines() {
+        static int count = 0;
+        return count;
+    }
     
     // Template function for combat calculations
     template<typename T1, typename T2>
     int calculateDamage(const T1& attacker, const T2& defender) {
-        int damage = attacker->getAttack() - defender->getDefense();
-        return (damage > 0) ? damage : 1; // Minimum 1 damage
+        return CombatRules::strike(attacker->getAttack(), defender->getDefense());
     }
     
     // Helper function to convert std::string to String
@@ -43,20 +90,464 @@ private:
         return result;
     }
     
+    void writeGameState(ostream& out) const {
+        vector<SaveSchema::Section> sections(3);
+        
+        SaveWriter game;
+        game.writeBool(gameWon);
+        sections[0].id = SaveSchema::SECTION_GAME;
+        sections[0].payload = game.release();
+        
+        SaveWriter hero;
+        player->serialize(hero);
+        sections[1].id = SaveSchema::SECTION_PLAYER;
+        sections[1].payload = hero.release();
+        
+        SaveWriter world;
+        dungeon->serialize(world);
+        sections[2].id = SaveSchema::SECTION_DUNGEON;
+        sections[2].payload = world.release();
+        
+        SaveSchema::write(out, sections);
+    }
+    
+    // Builds a complete game from the stream; throws without touching the running game
+    void readGameState(istream& in, bool& loadedWon, Character*& loadedPlayer, Dungeon*& loadedDungeon) {
+        uint16_t version;
+        vector<SaveSchema::Section> sections = SaveSchema::read(in, version);
+        
+        SaveReader game(SaveSchema::require(sections, SaveSchema::SECTION_GAME).payload, version);
+        loadedWon = game.readBool();
+        
+        Character* hero = new Character();
+        Dungeon* world = nullptr;
+        try {
+            SaveReader heroIn(SaveSchema::require(sections, SaveSchema::SECTION_PLAYER).payload, version);
+            hero->deserialize(heroIn);
+            
+            world = new Dungeon();
+            SaveReader worldIn(SaveSchema::require(sections, SaveSchema::SECTION_DUNGEON).payload, version);
+            world->deserialize(worldIn);
+            if(!world->isValidPosition(hero->getX(), hero->getY())) {
+                throw SaveLoadException("player outside the dungeon");
+            }
+        } catch(...) {
+            delete world;
+            delete hero;
+            throw;
+        }
+        
+        world->setPlayer(hero);
+        loadedPlayer = hero;
+        loadedDungeon = world;
+    }
+    
+    uint64_t wonKey() const {
+        return StateHash::key(StateHash::subject(StateHash::GAME, 0), StateHash::WON, StateHash::value(gameWon));
+    }
+    
+    // Reads a save, compressed or not; throws without touching the running game
+    void readSave(istream& in, bool& loadedWon, Character*& loadedPlayer, Dungeon*& loadedDungeon,
+                  long long& rawBytes, long long& storedBytes) {
+        if(SaveContainer::detect(in)) {
+            CompressedInBuf unpacker(in);
+            istream packed(&unpacker);
+            readGameState(packed, loadedWon, loadedPlayer, loadedDungeon);
+            // Reading up to the terminator also verifies the trailing blocks
+            bool complete = packed.good() && packed.peek() == char_traits<char>::eof();
+            if(!complete || unpacker.isCorrupt()) {
+                delete loadedDungeon;
+                delete loadedPlayer;
+                throw SaveLoadException("corrupt or truncated save file");
+            }
+            rawBytes = unpacker.getRawBytes();
+            storedBytes = unpacker.getStoredBytes();
+        } else {
+            readGameState(in, loadedWon, loadedPlayer, loadedDungeon);
+            rawBytes = storedBytes = (long long)in.tellg();
+        }
+    }
+    
+    // Swaps in a game that readSave built
+    void replaceGame(bool loadedWon, Character* loadedPlayer, Dungeon* loadedDungeon) {
+        cleanup();
+        gameWon = loadedWon;
+        player = loadedPlayer;
+        dungeon = loadedDungeon;
+        world.reset(dungeon, player);
+        mapRenderer.invalidate();
+    }
+    
+    // The current game as a compressed save, in memory
+    vector<uint8_t> snapshotGame() const {
+        ostringstream out;
+        {
+            CompressedOutBuf packer(out);
+            ostream packed(&packer);
+            writeGameState(packed);
+            if(!packed.good() || !packer.finish()) {
+                throw SaveLoadException("could not snapshot the game");
+            }
+        }
+        string bytes = out.str();
+        return vector<uint8_t>(bytes.begin(), bytes.end());
+    }
+    
+    // Writes the recording's header: a snapshot of the game plus what saves leave out.
+    // The world simulation restarts its schedule, as it does on load, so a replay
+    // starting from the snapshot sees the same one.
+    void beginRecording() {
+        world.reset(dungeon, player);
+        SessionSettings settings;
+        settings.seed = dungeon->getSeed();
+        settings.living = world.isEnabled();
+        settings.chase = world.isChasing();
+        settings.policy = combatPolicy;
+        settings.undoLimit = (int)history.getLimit();
+        recorder->start(settings, stateHash(), snapshotGame());
+    }
+    
+    // A "Continue fighting?" prompt, answered from the recording during a replay
+    bool askKeepFighting() {
+        gameOutput << "Continue fighting? (y/n): ";
+        gameOutput.commit();
+        bool keepFighting;
+        if(replayAnswers) {
+            // A recording cut short mid-fight keeps fighting, as an empty line would
+            keepFighting = nextAnswer >= replayAnswers->size() || (*replayAnswers)[nextAnswer] != 0;
+            nextAnswer++;
+        } else {
+            string choice;
+            getline(cin, choice);
+            keepFighting = !(choice == "n" || choice == "N");
+        }
+        if(recorder) recorder->answer(keepFighting);
+        return keepFighting;
+    }
+    
+    typedef void (GameEngine::*CommandHandler)(const CommandArgs& args);
+    
+    // Verbs, aliases and direction shortcuts; built once and shared by every engine.
+    // Save, load and quit overwrite or drop the game, so only the full word runs them.
+    static const CommandTable<CommandHandler>& commandTable() {
+        static const CommandTable<CommandHandler> table = [] {
+            CommandTable<CommandHandler> t;
+            t.add("move", &GameEngine::commandMove);
+            t.add("go", &GameEngine::commandMove);
+            t.add("north", &GameEngine::commandMove, "n");
+            t.add("south", &GameEngine::commandMove, "s");
+            t.add("east", &GameEngine::commandMove, "e");
+            t.add("west", &GameEngine::commandMove, "w");
+            t.add("n", &GameEngine::commandMove, "n");
+            t.add("s", &GameEngine::commandMove, "s");
+            t.add("e", &GameEngine::commandMove, "e");
+            t.add("w", &GameEngine::commandMove, "w");
+            t.add("goto", &GameEngine::commandGoto);
+            t.add("look", &GameEngine::commandLook);
+            t.add("l", &GameEngine::commandLook);
+            t.add("inventory", &GameEngine::commandInventory);
+            t.add("i", &GameEngine::commandInventory);
+            t.add("use", &GameEngine::commandUse);
+            t.add("u", &GameEngine::commandUse); // Still short for use now that undo shares the letter
+            t.add("pickup", &GameEngine::commandPickup);
+            t.add("get", &GameEngine::commandPickup);
+            t.add("take", &GameEngine::commandPickup);
+            t.add("attack", &GameEngine::commandAttack);
+            t.add("fight", &GameEngine::commandAttack);
+            t.add("map", &GameEngine::commandMap);
+            t.add("status", &GameEngine::commandStatus);
+            t.add("wait", &GameEngine::commandWait);
+            t.add("world", &GameEngine::commandWorld);
+            t.addExact("save", &GameEngine::commandSave);
+            t.addExact("load", &GameEngine::commandLoad);
+            t.add("undo", &GameEngine::commandUndo);
+            t.add("redo", &GameEngine::commandRedo);
+            t.add("help", &GameEngine::commandHelp);
+            t.addExact("quit", &GameEngine::commandQuit);
+            t.addExact("exit", &GameEngine::commandQuit);
+            return t;
+        }();
+        return table;
+    }
+    
+    // Item names are the remaining words joined by single spaces
+    String argsToName(const CommandArgs& args) const {
+        String name;
+        bool pendingSpace = false;
+        for(int i = 0; i < args.length; i++) {
+            char c = args.text[i];
+            if(c == ' ' || c == '\t') {
+                pendingSpace = true;
+                continue;
+            }
+            if(pendingSpace && !name.empty()) name.push_back(' ');
+            pendingSpace = false;
+            name.push_back(c);
+        }
+        return name;
+    }
+    
+    void commandMove(const CommandArgs& args) {
+        if(args.empty()) {
+            gameOutput << "Move where? (N/S/E/W)\n";
+        } else {
+            handleMove(args.text[0]);
+        }
+    }
+    
+    void commandGoto(const CommandArgs& args) {
+        int x, y;
+        String target = argsToName(args);
+        if(sscanf(target.c_str(), "%d %d", &x, &y) != 2) {
+            gameOutput << "Go to where? (goto <x> <y>)\n";
+        } else {
+            handleGoto(x, y);
+        }
+    }
+    
+    void commandLook(const CommandArgs&) { handleLook(); }
+    void commandInventory(const CommandArgs&) { handleInventory(); }
+    
+    void commandUse(const CommandArgs& args) {
+        if(args.empty()) {
+            gameOutput << "Use what item?\n";
+        } else {
+            handleUseItem(argsToName(args));
+        }
+    }
+    
+    void commandPickup(const CommandArgs& args) {
+        if(args.empty()) {
+            gameOutput << "Pick up what?\n";
+        } else {
+            handlePickup(argsToName(args));
+        }
+    }
+    
+    void commandAttack(const CommandArgs&) { handleAttack(); }
+    // map | map live | map off | map view <radius>
+    void commandMap(const CommandArgs& args) {
+        String option = argsToName(args);
+        if(option.empty()) {
+            handleMap();
+        } else if(option == "live") {
+            mapRenderer.startLive(*dungeon, gameOutput);
+        } else if(option == "off") {
+            mapRenderer.stopLive(gameOutput);
+        } else if(option.size() > 5 && option.substr(0, 5) == "view ") {
+            int radius = atoi(option.c_str() + 5);
+            mapRenderer.setViewRadius(radius);
+            if(mapRenderer.isLive()) mapRenderer.update(*dungeon, gameOutput);
+            gameOutput << (radius > 0 ? "Map view limited to the area around you.\n" : "Map view shows the whole dungeon.\n");
+        } else {
+            gameOutput << "Map options: live, off, view <radius>\n";
+        }
+    }
+    void commandStatus(const CommandArgs&) { handleStatus(); }
+    
+    // wait [turns]; the command's own turn counts as the first
+    void commandWait(const CommandArgs& args) {
+        int turns = args.empty() ? 1 : atoi(argsToName(args).c_str());
+        if(turns < 1 || turns > 100) {
+            gameOutput << "Wait how long? (wait [1-100])\n";
+            return;
+        }
+        world.advance((turns - 1) * WorldSimulation::TURN_MS);
+        gameOutput << "Time passes...\n";
+    }
+    
+    void commandWorld(const CommandArgs&) { handleWorld(); }
+    void commandSave(const CommandArgs&) { handleSave(); }
+    void commandLoad(const CommandArgs&) { handleLoad(); }
+    void commandHelp(const CommandArgs&) { displayWelcome(); }
+    
+    // undo / redo step the whole game back or forward one command; no time passes
+    void commandUndo(const CommandArgs&) {
+        turnTaken = false;
+        if(!history.undo(*dungeon, gameWon)) {
+            gameOutput << "Nothing to undo.\n";
+            return;
+        }
+        afterRestore();
+        gameOutput << "Undone. (" << history.getCurrent() << " more step"
+                   << (history.getCurrent() == 1 ? "" : "s") << " can be undone)\n";
+    }
+    
+    void commandRedo(const CommandArgs&) {
+        turnTaken = false;
+        if(!history.redo(*dungeon, gameWon)) {
+            gameOutput << "Nothing to redo.\n";
+            return;
+        }
+        afterRestore();
+        gameOutput << "Redone.\n";
+    }
+    
+    // As after a load, the world simulation starts its schedule over and the map is redrawn
+    void afterRestore() {
+        world.reset(dungeon, player);
+        mapRenderer.invalidate();
+        Location* here = dungeon->getLocation(player->getX(), player->getY());
+        if(here) here->display();
+    }
+    
+    void commandQuit(const CommandArgs&) {
+        gameRunning = false;
+        gameOutput << "Thanks for playing!\n";
+    }
+    
+    // Side effects of gameplay events. Each system takes a whole turn's events of one type;
+    // types are delivered in the order they are subscribed here.
+    void subscribeSystems() {
+        eventBus.subscribe<PlayerMoved>([this](const PlayerMoved* events, size_t count) {
+            for(size_t i = 0; i < count; i++) LOG_INFO("Player moved successfully");
+            if(gameEvents) gameEvents->recordBatch(count, [events](size_t i, GameEvent& record) {
+                record.id = (uint16_t)GameEventId::MOVE;
+                record.subject = events[i].player->getId();
+                record.a = events[i].x;
+                record.b = events[i].y;
+            });
+        });
+        
+        eventBus.subscribe<ItemPickedUp>([this](const ItemPickedUp* events, size_t count) {
+            for(size_t i = 0; i < count; i++) LOG_INFO(String("Player picked up: ") + events[i].name);
+            if(gameEvents) gameEvents->recordBatch(count, [events](size_t i, GameEvent& record) {
+                record.id = (uint16_t)GameEventId::PICKUP;
+                record.subject = events[i].player->getId();
+                record.a = events[i].itemId;
+                record.b = (int)events[i].type;
+            });
+            // The player holds a copy now; take the original off the floor
+            for(size_t i = 0; i < count; i++) {
+                Location* cell = dungeon->getLocation(events[i].x, events[i].y);
+                if(cell) cell->removeItem(events[i].itemId);
+                dungeon->markDirty(events[i].x, events[i].y);
+            }
+        });
+        
+        eventBus.subscribe<ItemUsed>([this](const ItemUsed* events, size_t count) {
+            for(size_t i = 0; i < count; i++) LOG_INFO(String("Player used item: ") + events[i].name);
+            if(gameEvents) gameEvents->recordBatch(count, [events](size_t i, GameEvent& record) {
+                record.id = (uint16_t)GameEventId::USE_ITEM;
+                record.subject = events[i].player->getId();
+                record.a = events[i].itemId;
+                record.b = (int)events[i].type;
+                record.c = events[i].value;
+            });
+        });
+        
+        eventBus.subscribe<CombatHit>([this](const CombatHit* events, size_t count) {
+            for(size_t i = 0; i < count; i++) {
+                if(events[i].byPlayer) {
+                    LOG_INFO(String("Player attacks ") + events[i].defender->getName() + String(" for damage"));
+                } else {
+                    LOG_INFO(events[i].attacker->getName() + String(" attacks player for damage"));
+                }
+            }
+            if(gameEvents) gameEvents->recordBatch(count, [events](size_t i, GameEvent& record) {
+                record.id = (uint16_t)GameEventId::COMBAT_HIT;
+                record.subject = events[i].attacker->getId();
+                record.a = events[i].defender->getId();
+                record.b = events[i].damage;
+                record.c = events[i].healthAfter;
+            });
+        });
+        
+        eventBus.subscribe<CombatResolved>([](const CombatResolved* events, size_t count) {
+            for(size_t i = 0; i < count; i++) {
+                LOG_INFO(String("Quick combat with ") + events[i].monster->getName() + ": " +
+                         outcomeName(events[i].outcome) + " after " + String(to_string(events[i].rounds).c_str()) + " rounds");
+            }
+            if(gameEvents) gameEvents->recordBatch(count, [events](size_t i, GameEvent& record) {
+                record.id = (uint16_t)GameEventId::COMBAT;
+                record.subject = events[i].player->getId();
+                record.a = events[i].monster->getId();
+                record.b = events[i].outcome;
+                record.c = events[i].rounds;
+            });
+        });
+        
+        eventBus.subscribe<EntityDied>([this](const EntityDied* events, size_t count) {
+            if(gameEvents) gameEvents->recordBatch(count, [events](size_t i, GameEvent& record) {
+                record.id = (uint16_t)GameEventId::DEATH;
+                record.subject = events[i].victim->getId();
+                record.a = events[i].killer->getId();
+            });
+            for(size_t i = 0; i < count; i++) {
+                dungeon->markDirty(events[i].x, events[i].y);
+                if(events[i].killer == player && events[i].experience > 0) {
+                    player->gainExperience(events[i].experience);
+                }
+            }
+        });
+        
+        // A long goto publishes a move per step; a fight a hit per round
+        eventBus.reserve<PlayerMoved>(256);
+        eventBus.reserve<CombatHit>(64);
+    }
+    
+    // Size and throughput summary for save/load, e.g. "12034 -> 2301 bytes (5.23x), 180.4 MB/s"
+    String describeTransfer(long long rawBytes, long long storedBytes, double seconds) const {
+        ostringstream report;
+        report.setf(ios::fixed);
+        report.precision(2);
+        report << rawBytes << " -> " << storedBytes << " bytes";
+        if(storedBytes > 0) {
+            report << " (" << (double)rawBytes / storedBytes << "x)";
+        }
+        if(seconds > 0) {
+            report << ", " << (rawBytes / (1024.0 * 1024.0)) / seconds << " MB/s";
+        }
+        return String(report.str().c_str());
+    }
+    
 public:
-    GameEngine() : dungeon(nullptr), player(nullptr), gameRunning(true), gameWon(false) {
+    // A non-zero seed generates a worldWidth x worldHeight dungeon; the same seed gives the same world
+    explicit GameEngine(uint64_t seed = 0, int width = 10, int height = 10)
+        : dungeon(nullptr), player(nullptr), gameRunning(true), gameWon(false), compressSaves(true),
+          worldSeed(seed), worldWidth(width), worldHeight(height), replayAnswers(nullptr), nextAnswer(0),
+          replayLoads(nullptr), nextLoad(0),
+          turnTaken(true) {
         saveFileName = String("savegame.dat");
+        sessionId = LogSession::next();
         
-        // Initialize logger
-        if(!gameLogger) {
-            gameLogger = new Logger<String>("game.log", LogLevel::INFO);
+        {
+            lock_guard<mutex> lock(sharedSinkMutex());
+            liveEngines()++;
+            
+            // Initialize logger
+            if(!gameLogger) {
+                gameLogger = new Logger<String>("game.log", LogLevel::INFO);
+                // Roll over at 10 MB or daily, keeping five old files
+                gameLogger->setRotation(10ull * 1024 * 1024, 24 * 60 * 60, 5);
+                // Each game thread logs into its own buffer, merged off-thread
+                gameLogger->enableThreadBuffers();
+            }
+            
+            if(!gameEvents) {
+                gameEvents = new EventLog("events.bin");
+            }
         }
         
+        LogSession::set(sessionId);
+        subscribeSystems();
         initializeGame();
     }
     
     ~GameEngine() {
+        mapRenderer.stopLive(gameOutput);
+        stopRecording();
         cleanup();
+        gameOutput.commit();
+        
+        // The last engine out tears down the shared sinks
+        lock_guard<mutex> lock(sharedSinkMutex());
+        if(--liveEngines() > 0) return;
+        
+        if(gameEvents) {
+            delete gameEvents;
+            gameEvents = nullptr;
+        }
         
         if(gameLogger) {
             delete gameLogger;
@@ -66,27 +557,36 @@ public:
     
     void initializeGame() {
         try {
-            String logMsg("Initializing new game");
-            LOG_INFO(logMsg);
+            LOG_INFO("Initializing new game");
             
             // Create dungeon
-            dungeon = new Dungeon(10, 10, "The Cursed Dungeon");
+            if(worldSeed == 0) {
+                dungeon = new Dungeon(10, 10, "The Cursed Dungeon");
+            } else {
+                auto start = chrono::steady_clock::now();
+                dungeon = new Dungeon(worldWidth, worldHeight, "The Cursed Dungeon", worldSeed);
+                double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+                LOG_INFO(String("Generated dungeon from seed ") + String(to_string(worldSeed).c_str()) + " in " +
+                         String(to_string((long long)(seconds * 1000)).c_str()) + " ms");
+            }
             
             // Create player
-            player = new Character("Hero", 0, 0, 1);
+            player = new Character("Hero", dungeon->getEntranceX(), dungeon->getEntranceY(), 1);
             dungeon->setPlayer(player);
+            world.reset(dungeon, player);
             
-            String successMsg("Game initialized successfully");
-            LOG_INFO(successMsg);
+            LOG_INFO("Game initialized successfully");
             
         } catch(const exception& e) {
-            String errorMsg("Failed to initialize game");
-            LOG_ERROR(errorMsg);
+            LOG_ERROR("Failed to initialize game");
             throw GameStateException("Game initialization failed");
         }
     }
     
     void cleanup() {
+        // Undelivered events and undo steps point into the world being torn down
+        eventBus.discard();
+        history.clear();
         if(dungeon) {
             delete dungeon;
             dungeon = nullptr;
@@ -98,174 +598,352 @@ public:
     }
     
     void displayWelcome() {
-        cout << "========================================" << endl;
-        cout << "    WELCOME TO THE DUNGEON CRAWLER!" << endl;
-        cout << "========================================" << endl;
-        cout << "You are a brave adventurer who has entered" << endl;
-        cout << "a mysterious dungeon filled with monsters," << endl;
-        cout << "treasures, and dangers. Your goal is to" << endl;
-        cout << "reach the exit at the far corner while" << endl;
-        cout << "collecting items and defeating monsters." << endl;
-        cout << "========================================" << endl;
-        cout << "Commands:" << endl;
-        cout << "  move <direction> - Move N/S/E/W" << endl;
-        cout << "  look - Examine current location" << endl;
-        cout << "  inventory - Check your items" << endl;
-        cout << "  use <item> - Use an item" << endl;
-        cout << "  pickup <item> - Pick up an item" << endl;
-        cout << "  attack - Attack a monster" << endl;
-        cout << "  map - Display the dungeon map" << endl;
-        cout << "  status - Show character status" << endl;
-        cout << "  save - Save the game" << endl;
-        cout << "  load - Load a saved game" << endl;
-        cout << "  help - Show this help" << endl;
-        cout << "  quit - Exit the game" << endl;
-        cout << "========================================" << endl;
+        gameOutput << "========================================\n";
+        gameOutput << "    WELCOME TO THE DUNGEON CRAWLER!\n";
+        gameOutput << "========================================\n";
+        gameOutput << "You are a brave adventurer who has entered\n";
+        gameOutput << "a mysterious dungeon filled with monsters,\n";
+        gameOutput << "treasures, and dangers. Your goal is to\n";
+        gameOutput << "reach the exit at the far corner while\n";
+        gameOutput << "collecting items and defeating monsters.\n";
+        gameOutput << "========================================\n";
+        gameOutput << "Commands:\n";
+        gameOutput << "  move <direction> - Move N/S/E/W\n";
+        gameOutput << "  goto <x> <y> - Walk the shortest path to a cell\n";
+        gameOutput << "  look - Examine current location\n";
+        gameOutput << "  inventory - Check your items\n";
+        gameOutput << "  use <item> - Use an item\n";
+        gameOutput << "  pickup <item> - Pick up an item\n";
+        gameOutput << "  attack - Attack a monster\n";
+        gameOutput << "  map - Display the dungeon map\n";
+        gameOutput << "  map live/off - Keep the map pinned on screen\n";
+        gameOutput << "  map view <n> - Show only n cells around you (0 = all)\n";
+        gameOutput << "  status - Show character status\n";
+        gameOutput << "  wait [n] - Let n turns pass\n";
+        gameOutput << "  world - Show world simulation statistics\n";
+        gameOutput << "  save - Save the game\n";
+        gameOutput << "  load - Load a saved game\n";
+        gameOutput << "  undo / redo - Take back the last command, or bring it back\n";
+        gameOutput << "  help - Show this help\n";
+        gameOutput << "  quit - Exit the game\n";
+        gameOutput << "  Shortcuts: n/s/e/w move, l looks, i lists items, u uses, get picks up,\n";
+        gameOutput << "  and a unique prefix runs a command (\"inv\"), except save/load/quit\n";
+        gameOutput << "========================================\n";
     }
     
     void run() {
+        LogSession::set(sessionId);
         displayWelcome();
         dungeon->displayCurrentLocation();
         
         while(gameRunning) {
-            try {
-                cout << "\n> ";
-                string input;
-                getline(cin, input);
-                
-                if(input.empty()) continue;
-                
-                processCommand(stdStringToString(input));
-                
-                // Check win condition
-                if(dungeon->isWinCondition()) {
-                    gameWon = true;
-                    gameRunning = false;
-                    cout << "\n*** CONGRATULATIONS! ***" << endl;
-                    cout << "You have reached the exit and won the game!" << endl;
-                    String winMsg("Player won the game!");
-                    LOG_INFO(winMsg);
-                }
-                
-                // Check if player is dead
-                if(!player->isAlive()) {
-                    gameRunning = false;
-                    cout << "\n*** GAME OVER ***" << endl;
-                    cout << "You have died. Better luck next time!" << endl;
-                    String deathMsg("Player died - game over");
-                    LOG_INFO(deathMsg);
-                }
-                
-            } catch(const GameException& e) {
-                handleGameException(e, "main game loop");
-            } catch(const exception& e) {
-                cout << "Unexpected error: " << e.what() << endl;
-                String errorMsg("Unexpected error in main loop");
-                LOG_ERROR(errorMsg);
+            gameOutput << "\n> ";
+            gameOutput.commit();
+            string input;
+            if(!getline(cin, input)) {
+                // End of input (closed pipe, Ctrl-D) ends the session instead of spinning
+                gameRunning = false;
+                break;
             }
+            
+            if(input.empty()) continue;
+            
+            executeCommand(input.c_str(), input.size());
         }
+        mapRenderer.stopLive(gameOutput);
+        gameOutput.commit();
     }
     
-    void processCommand(const String& input) {
-        // Use String's tokenize method to parse command
-        int tokenCount;
-        String* tokens = input.tokenize(" \t", tokenCount);
+    // Runs commands from a source at full speed. Game output goes to `output`
+    // (a null sink when not given) and combat prompts are answered by `policy`.
+    // Log echo is left as it is; callers that want a quiet console turn it off once
+    // with setLogEcho rather than per run, since the logger is shared by every session.
+    HeadlessReport runHeadless(CommandSource& source, ostream* output = nullptr,
+                               CombatPolicy policy = CombatPolicy(CombatPolicy::FIGHT_TO_END)) {
+        LogSession::set(sessionId);
         
-        if(tokenCount == 0) {
-            delete[] tokens;
-            return;
+        NullSink discard;
+        StreamSink redirected(output ? *output : cout);
+        gameOutput.commit();
+        OutputSink* previousSink = gameOutput.setSink(output ? (OutputSink*)&redirected : &discard);
+        CombatPolicy previousPolicy = combatPolicy;
+        combatPolicy = policy;
+        if(combatPolicy.mode == CombatPolicy::ASK) combatPolicy.mode = CombatPolicy::FIGHT_TO_END;
+        
+        HeadlessReport report;
+        report.commands = 0;
+        auto start = chrono::steady_clock::now();
+        const char* text;
+        int length;
+        while(gameRunning && source.next(text, length)) {
+            executeCommand(text, length);
+            gameOutput.commit();
+            report.commands++;
         }
+        report.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
         
-        String command = tokens[0];
-        command.tolower(); // Convert to lowercase using String method
+        combatPolicy = previousPolicy;
+        gameOutput.setSink(previousSink);
         
-        if(command == String("move")) {
-            if(tokenCount > 1) {
-                String direction = tokens[1];
-                handleMove(direction[0]);
-            } else {
-                cout << "Move where? (N/S/E/W)" << endl;
-            }
-        }
-        else if(command == String("look")) {
-            handleLook();
-        }
-        else if(command == String("inventory")) {
-            handleInventory();
+        LOG_INFO(String("Headless run: ") + describeRate(report));
+        return report;
+    }
+    
+    // One command plus the end-of-game checks that follow it
+    void executeCommand(const char* text, int length) {
+        if(recorder) {
+            if(!recorder->isStarted()) beginRecording();
+            recorder->command(text, length);
         }
-        else if(command == String("use")) {
-            if(tokenCount > 1) {
-                // Join remaining tokens as item name
-                String* itemTokens = new String[tokenCount - 1];
-                for(int i = 1; i < tokenCount; i++) {
-                    itemTokens[i - 1] = tokens[i];
-                }
-                String itemName = String::join(" ", itemTokens, tokenCount - 1);
-                handleUseItem(itemName);
-                delete[] itemTokens;
-            } else {
-                cout << "Use what item?" << endl;
+        try {
+            // What the last command did becomes an undo step; the first one copies the world
+            if(history.getLimit() > 0) history.capture(*dungeon, gameWon, stateHash());
+            
+            turnTaken = true;
+            processCommand(text, length);
+            eventBus.dispatch();
+            
+            // Every command takes one turn of game time, except undo and redo
+            if(gameRunning && turnTaken) world.advance(WorldSimulation::TURN_MS);
+            
+            mapRenderer.update(*dungeon, gameOutput);
+            
+            // Check win condition
+            if(dungeon->isWinCondition()) {
+                gameWon = true;
+                gameRunning = false;
+                gameOutput << "\n*** CONGRATULATIONS! ***\n";
+                gameOutput << "You have reached the exit and won the game!\n";
+                LOG_INFO("Player won the game!");
             }
-        }
-        else if(command == String("pickup")) {
-            if(tokenCount > 1) {
-                // Join remaining tokens as item name
-                String* itemTokens = new String[tokenCount - 1];
-                for(int i = 1; i < tokenCount; i++) {
-                    itemTokens[i - 1] = tokens[i];
-                }
-                String itemName = String::join(" ", itemTokens, tokenCount - 1);
-                handlePickup(itemName);
-                delete[] itemTokens;
-            } else {
-                cout << "Pick up what?" << endl;
+            
+            // Check if player is dead
+            if(!player->isAlive()) {
+                gameRunning = false;
+                gameOutput << "\n*** GAME OVER ***\n";
+                gameOutput << "You have died. Better luck next time!\n";
+                LOG_INFO("Player died - game over");
             }
+            
+        } catch(const GameException& e) {
+            handleGameException(e, "main game loop");
+        } catch(const exception& e) {
+            gameOutput << "Unexpected error: " << e.what() << "\n";
+            LOG_ERROR("Unexpected error in main loop");
         }
-        else if(command == String("attack")) {
-            handleAttack();
-        }
-        else if(command == String("map")) {
-            handleMap();
-        }
-        else if(command == String("status")) {
-            handleStatus();
-        }
-        else if(command == String("save")) {
-            handleSave();
-        }
-        else if(command == String("load")) {
-            handleLoad();
-        }
-        else if(command == String("help")) {
-            displayWelcome();
-        }
-        else if(command == String("quit") || command == String("exit")) {
-            gameRunning = false;
-            cout << "Thanks for playing!" << endl;
+    }
+    
+    // Off by default: the classic dungeon's monsters guard their rooms
+    void setMonsterChase(bool enabled) {
+        world.setChase(enabled);
+    }
+    
+    // Monsters wander, regenerate and respawn as turns pass
+    void setWorldSimulation(bool enabled) {
+        world.setEnabled(enabled);
+    }
+    
+    // Threads that share big world ticks; 0 = every core
+    void setWorldThreads(int threads) {
+        world.setThreads(threads);
+    }
+    
+    // e.g. "120000 commands in 0.84 s (142857 commands/s)"
+    String describeRate(const HeadlessReport& report) const {
+        ostringstream text;
+        text.setf(ios::fixed);
+        text.precision(2);
+        text << report.commands << " commands in " << report.seconds << " s (";
+        text.precision(0);
+        text << report.commandsPerSecond() << " commands/s)";
+        return String(text.str().c_str());
+    }
+    
+    void setCombatPolicy(const CombatPolicy& policy) {
+        combatPolicy = policy;
+    }
+    
+    // Commands that can be undone, counting back from the latest; 0 turns undo off.
+    // Loading a game starts a new history.
+    void setUndoLimit(int steps) {
+        history.setLimit(steps > 0 ? (size_t)steps : 0);
+    }
+    
+    // Whether log lines are also printed on the console; this is the process-wide logger's
+    // setting, shared by every session
+    void setLogEcho(bool echo) {
+        if(gameLogger) gameLogger->setConsoleEcho(echo);
+    }
+    
+    // Memory the undo history takes, shared chunks counted once
+    HistoryStats getHistoryStats() const {
+        return history.measure();
+    }
+    
+    // Zobrist hash of everything a save holds, kept current as the game changes, so
+    // comparing two games (after a replay, between replicas, around a load) is O(1)
+    uint64_t stateHash() const {
+        return dungeon->getStateHash() ^ wonKey();
+    }
+    
+    // The same hash worked out from scratch; differs from stateHash() only if some
+    // change bypassed the setters
+    uint64_t computeStateHash() const {
+        return dungeon->computeStateHash() ^ wonKey();
+    }
+    
+    // Writes every command from here on, and every combat prompt answer, to fileName.
+    // The starting state is captured when the first command arrives, so whatever happens
+    // before it (the welcome screen marks the entrance visited, a headless run sets its
+    // combat policy) is part of it.
+    void startRecording(const String& fileName) {
+        stopRecording();
+        recorder.reset(new SessionRecorder(fileName));
+        LOG_INFO(String("Recording session to ") + fileName);
+    }
+    
+    // Ends the recording with the hash of the final state; also done on destruction
+    void stopRecording() {
+        if(!recorder) return;
+        if(!recorder->isStarted()) beginRecording();
+        recorder->finish(stateHash());
+        LOG_INFO(String("Recorded ") + String(to_string(recorder->getCommandCount()).c_str()) + " commands");
+        recorder.reset();
+    }
+    
+    // Replaces the game with a recording's snapshot and re-executes its commands at full
+    // speed, timing each one. Game output goes to `output` (a null sink when not given).
+    // With verify the final state is checked against the recorded hash.
+    ReplayReport replay(const SessionLog& log, ostream* output = nullptr, bool verify = false) {
+        LogSession::set(sessionId);
+        stopRecording();
+    
+        istringstream snapshot(string(log.snapshot.begin(), log.snapshot.end()));
+        bool loadedWon = false;
+        Character* loadedPlayer = nullptr;
+        Dungeon* loadedDungeon = nullptr;
+        long long rawBytes, storedBytes;
+        readSave(snapshot, loadedWon, loadedPlayer, loadedDungeon, rawBytes, storedBytes);
+        world.setEnabled(log.settings.living);
+        world.setChase(log.settings.chase);
+        // Undo commands only replay the same way with the same number of steps to go back
+        setUndoLimit(log.settings.undoLimit);
+        replaceGame(loadedWon, loadedPlayer, loadedDungeon);
+        gameRunning = true;
+        if(stateHash() != log.startHash) {
+            throw SaveLoadException("recording does not match its snapshot");
         }
-        else {
-            cout << "Unknown command. Type 'help' for available commands." << endl;
+    
+        NullSink discard;
+        StreamSink redirected(output ? *output : cout);
+        gameOutput.commit();
+        OutputSink* previousSink = gameOutput.setSink(output ? (OutputSink*)&redirected : &discard);
+        CombatPolicy previousPolicy = combatPolicy;
+        combatPolicy = log.settings.policy;
+        replayAnswers = &log.answers;
+        nextAnswer = 0;
+        replayLoads = &log;
+        nextLoad = 0;
+    
+        ReplayReport report;
+        report.commandSeconds.reserve(log.commands.size());
+        auto start = chrono::steady_clock::now();
+        auto before = start;
+        for(size_t i = 0; i < log.commands.size() && gameRunning; i++) {
+            executeCommand(log.commandText(i), log.commandLength(i));
+            gameOutput.commit();
+            auto after = chrono::steady_clock::now();
+            report.commandSeconds.push_back(chrono::duration<double>(after - before).count());
+            before = after;
         }
+        report.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    
+        replayAnswers = nullptr;
+        replayLoads = nullptr;
+        combatPolicy = previousPolicy;
+        gameOutput.setSink(previousSink);
+    
+        report.verified = verify && log.complete;
+        report.expectedHash = log.finalHash;
+        report.actualHash = stateHash();
+        report.matched = !report.verified || report.actualHash == report.expectedHash;
+        LOG_INFO(String("Replayed ") + String(to_string(report.commandSeconds.size()).c_str()) + " commands in " +
+                 String(to_string(report.seconds).c_str()) + " s" +
+                 (report.verified ? (report.matched ? ", final state matches" : ", final state differs") : ""));
+        return report;
+    }
+    
+    void processCommand(const String& input) {
+        processCommand(input.c_str(), input.size());
+    }
+    
+    void processCommand(const char* input, int length) {
+        // One clock read per command; every log line for it reuses the cached time
+        CoarseClock::tick();
+        LogSession::set(sessionId);
         
-        delete[] tokens;
+        const CommandTable<CommandHandler>::Entry* entry = nullptr;
+        CommandArgs args;
+        switch(commandTable().match(input, length, entry, args)) {
+            case CommandTable<CommandHandler>::MATCHED:
+                (this->*(entry->handler))(args);
+                break;
+            case CommandTable<CommandHandler>::AMBIGUOUS:
+                gameOutput << "Ambiguous command. Type more letters, or 'help' for available commands.\n";
+                break;
+            case CommandTable<CommandHandler>::UNKNOWN:
+                gameOutput << "Unknown command. Type 'help' for available commands.\n";
+                break;
+            case CommandTable<CommandHandler>::EMPTY:
+                break;
+        }
+    }
+    
+    // Looks a line up without running it, so dispatch can be timed on its own
+    static bool resolvesToCommand(const char* input, int length) {
+        const CommandTable<CommandHandler>::Entry* entry = nullptr;
+        CommandArgs args;
+        return commandTable().match(input, length, entry, args) == CommandTable<CommandHandler>::MATCHED;
     }
     
     void handleMove(char direction) {
         try {
             if(dungeon->movePlayer(direction)) {
-                String moveMsg("Player moved successfully");
-                LOG_INFO(moveMsg);
+                eventBus.publish(PlayerMoved{player, player->getX(), player->getY()});
                 // Check for monsters at new location
                 Location* currentLoc = dungeon->getLocation(player->getX(), player->getY());
                 if(currentLoc && currentLoc->hasMonsters()) {
                     Monster* monster = currentLoc->getAliveMonster();
                     if(monster) {
-                        cout << "A wild " << monster->getName() << " blocks your path!" << endl;
+                        gameOutput << "A wild " << monster->getName() << " blocks your path!\n";
                     }
                 }
             }
         } catch(const InvalidPositionException& e) {
-            cout << e.what() << endl;
+            gameOutput << e.what() << "\n";
+        }
+    }
+    
+    // Walks the shortest path one move at a time, stopping early for monsters or the exit
+    void handleGoto(int x, int y) {
+        if(x == player->getX() && y == player->getY()) {
+            gameOutput << "You are already there.\n";
+            return;
+        }
+        if(!pathfinder.findPath(*dungeon, player->getX(), player->getY(), x, y, route)) {
+            gameOutput << "There is no way to reach (" << x << ", " << y << ") from here.\n";
+            return;
+        }
+        gameOutput << "Heading to (" << x << ", " << y << "), " << route.size() << " steps away.\n";
+        for(const GridPoint& step : route) {
+            int px = player->getX();
+            int py = player->getY();
+            char direction = step.x > px ? 'e' : step.x < px ? 'w' : step.y > py ? 's' : 'n';
+            handleMove(direction);
+            if(player->getX() != step.x || player->getY() != step.y) break;
+            
+            Location* here = dungeon->getLocation(step.x, step.y);
+            if(here->getAliveMonster() || dungeon->isWinCondition()) break;
         }
     }
     
@@ -279,12 +957,20 @@ public:
     
     void handleUseItem(const String& itemName) {
         try {
+            // Capture the item before useItem may consume it
+            Item* item = player->findItem(itemName);
+            ItemUsed used = ItemUsed{player, 0, ItemType::HEALTH_POTION, 0, ""};
+            if(item) {
+                used.itemId = item->getId();
+                used.type = item->getType();
+                used.value = item->getValue();
+            }
+            copyEventName(used.name, itemName);
             if(player->useItem(itemName)) {
-                String logMsg = String("Player used item: ") + itemName;
-                LOG_INFO(logMsg);
+                eventBus.publish(used);
             }
         } catch(const ItemNotFoundException& e) {
-            cout << e.what() << endl;
+            gameOutput << e.what() << "\n";
         }
     }
     
@@ -316,13 +1002,15 @@ public:
                                     targetItem->getValue(), targetItem->getConsumable());
             
             player->addItem(itemCopy);
-            currentLoc->removeItem(targetItem->getId());
             
-            String logMsg = String("Player picked up: ") + targetItem->getName();
-            LOG_INFO(logMsg);
+            // The original leaves the floor when the turn's events are dispatched
+            ItemPickedUp picked = ItemPickedUp{player, targetItem->getId(), targetItem->getType(),
+                                               player->getX(), player->getY(), ""};
+            copyEventName(picked.name, targetItem->getName());
+            eventBus.publish(picked);
             
         } catch(const GameException& e) {
-            cout << e.what() << endl;
+            gameOutput << e.what() << "\n";
         }
     }
     
@@ -342,125 +1030,253 @@ public:
                 throw MonsterDefeatedException(monster->getName());
             }
             
+            // When neither blow gets through the rounds would repeat forever, whatever the policy
+            int playerHit = CombatRules::absorb(calculateDamage(player, monster), monster->getDefense());
+            int monsterHit = CombatRules::absorb(calculateDamage(monster, player), player->getDefense());
+            if(playerHit == 0 && monsterHit == 0) {
+                eventBus.publish(CombatResolved{player, monster, COMBAT_STALEMATE, 0, 0, 0});
+                gameOutput << "Neither of you can hurt the other; you back away from " << monster->getName() << ".\n";
+                return;
+            }
+            
+            if(combatPolicy.resolveAtOnce && combatPolicy.mode != CombatPolicy::ASK) {
+                resolveCombat(monster);
+                world.noteWounded(monster);
+                return;
+            }
+            
             // Combat loop
-            cout << "Combat begins with " << monster->getName() << "!" << endl;
+            gameOutput << "Combat begins with " << monster->getName() << "!\n";
             
             while(player->isAlive() && !monster->getDefeated()) {
                 // Player attacks
                 int playerDamage = calculateDamage(player, monster);
+                int monsterHealthBefore = monster->getHealth();
                 monster->takeDamage(playerDamage);
-                String attackMsg = String("Player attacks ") + monster->getName() + String(" for damage");
-                LOG_INFO(attackMsg);
+                eventBus.publish(CombatHit{player, monster, monsterHealthBefore - monster->getHealth(),
+                                           monster->getHealth(), true});
                 
                 if(monster->getDefeated()) {
-                    cout << "You defeated " << monster->getName() << "!" << endl;
-                    player->gainExperience(50 + monster->getAttack());
+                    gameOutput << "You defeated " << monster->getName() << "!\n";
+                    eventBus.publish(EntityDied{monster, player, monster->getX(), monster->getY(),
+                                                50 + monster->getAttack()});
                     break;
                 }
                 
                 // Monster attacks back
                 int monsterDamage = calculateDamage(monster, player);
+                int playerHealthBefore = player->getHealth();
                 player->takeDamage(monsterDamage);
-                String counterMsg = monster->getName() + String(" attacks player for damage");
-                LOG_INFO(counterMsg);
+                eventBus.publish(CombatHit{monster, player, playerHealthBefore - player->getHealth(),
+                                           player->getHealth(), false});
                 
                 if(!player->isAlive()) {
+                    eventBus.publish(EntityDied{player, monster, player->getX(), player->getY(), 0});
                     throw PlayerDeathException();
                 }
                 
                 // Show current status
-                cout << "Your health: " << player->getHealth() << "/" << player->getMaxHealth() << endl;
-                cout << monster->getName() << " health: " << monster->getHealth() << "/" << monster->getMaxHealth() << endl;
+                gameOutput << "Your health: " << player->getHealth() << "/" << player->getMaxHealth() << "\n";
+                gameOutput << monster->getName() << " health: " << monster->getHealth() << "/" << monster->getMaxHealth() << "\n";
                 
-                // Ask if player wants to continue or flee
-                cout << "Continue fighting? (y/n): ";
-                string choice;
-                getline(cin, choice);
-                if(choice == "n" || choice == "N") {
-                    cout << "You flee from combat!" << endl;
+                // Ask if player wants to continue or flee, unless a policy decides
+                bool keepFighting;
+                if(combatPolicy.mode == CombatPolicy::ASK) {
+                    keepFighting = askKeepFighting();
+                } else {
+                    keepFighting = combatPolicy.keepFighting(player->getHealth(), player->getMaxHealth());
+                }
+                if(!keepFighting) {
+                    gameOutput << "You flee from combat!\n";
                     break;
                 }
             }
+            world.noteWounded(monster);
             
         } catch(const GameException& e) {
-            cout << e.what() << endl;
+            gameOutput << e.what() << "\n";
+        }
+    }
+    
+    // The whole fight in one step: the outcome comes from CombatRules::resolve, so there is
+    // no per-round output, prompt or event, just one summary
+    void resolveCombat(Monster* monster) {
+        int playerHit = CombatRules::absorb(calculateDamage(player, monster), monster->getDefense());
+        int monsterHit = CombatRules::absorb(calculateDamage(monster, player), player->getDefense());
+        int fleeBelow = combatPolicy.mode == CombatPolicy::FLEE_BELOW ?
+            combatPolicy.fleeHealthPercent * player->getMaxHealth() : 0;
+        FightResult result = CombatRules::resolve(player->getHealth(), playerHit, monster->getHealth(),
+                                                  monsterHit, fleeBelow);
+        
+        int damageDealt = monster->getHealth() - result.monsterHealth;
+        int damageTaken = player->getHealth() - result.playerHealth;
+        int rounds = result.outcome == COMBAT_STALEMATE ? 0 : result.rounds;
+        player->setHealth(result.playerHealth);
+        monster->setHealth(result.monsterHealth);
+        eventBus.publish(CombatResolved{player, monster, result.outcome, rounds, damageDealt, damageTaken});
+        const char* roundsText = rounds == 1 ? " round" : " rounds";
+        
+        switch(result.outcome) {
+            case COMBAT_WON:
+                monster->setDefeated(true);
+                gameOutput << "You defeated " << monster->getName() << " in " << rounds << roundsText << ", taking "
+                           << damageTaken << " damage.\n";
+                eventBus.publish(EntityDied{monster, player, monster->getX(), monster->getY(),
+                                            50 + monster->getAttack()});
+                break;
+            case COMBAT_LOST:
+                gameOutput << monster->getName() << " overwhelms you after " << rounds << roundsText << ".\n";
+                eventBus.publish(EntityDied{player, monster, player->getX(), player->getY(), 0});
+                throw PlayerDeathException();
+            case COMBAT_FLED:
+                gameOutput << "You flee from " << monster->getName() << " after " << rounds << roundsText << ". (Health: "
+                           << player->getHealth() << "/" << player->getMaxHealth() << ")\n";
+                break;
+            default:
+                gameOutput << "Neither of you can hurt the other; you back away from " << monster->getName() << ".\n";
+                break;
         }
     }
     
     void handleMap() {
-        dungeon->displayMap();
+        mapRenderer.renderText(*dungeon, gameOutput);
+    }
+    
+    // Tick-time statistics of the world simulation
+    void handleWorld() {
+        if(!world.isEnabled()) {
+            gameOutput << "The world only changes when you act (start with --living or --chase).\n";
+            return;
+        }
+        const TickStats& stats = world.getStats();
+        ostringstream text;
+        text.setf(ios::fixed);
+        text.precision(2);
+        text << "World: " << stats.ticks << " ticks, " << stats.events << " events ("
+             << (stats.ticks ? (double)stats.events / stats.ticks : 0.0) << " per tick, at most " << stats.busiest << ")\n";
+        text << "Tick time: " << (stats.ticks ? stats.seconds * 1e6 / stats.ticks : 0.0) << " us average, "
+             << stats.maxSeconds * 1e6 << " us slowest\n";
+        gameOutput << text.str();
+        gameOutput << "Monsters alive: " << world.getLiveMonsters() << ", actions scheduled: " << world.getPendingEvents() << "\n";
     }
     
     void handleStatus() {
         player->display();
-        cout << "\nCurrent Location: (" << player->getX() << ", " << player->getY() << ")" << endl;
+        gameOutput << "\nCurrent Location: (" << player->getX() << ", " << player->getY() << ")\n";
     }
     
     void handleSave() {
         try {
             string filename = stringToStdString(saveFileName);
-            ofstream saveFile(filename.c_str(), ios::binary);
-            if(!saveFile.is_open()) {
-                throw FileOperationException("save", saveFileName);
+            auto start = chrono::steady_clock::now();
+            // A replay saves into memory and drops it, so it never overwrites the player's file;
+            // its loads read what the recording captured instead
+            ofstream saveFile;
+            ostringstream discarded;
+            ostream* target = &discarded;
+            if(!replayLoads) {
+                saveFile.open(filename.c_str(), ios::binary);
+                if(!saveFile.is_open()) {
+                    throw FileOperationException("save", saveFileName);
+                }
+                target = &saveFile;
             }
             
-            // Save game state
-            saveFile.write(reinterpret_cast<const char*>(&gameWon), sizeof(gameWon));
-            
-            // Save player
-            player->serialize(saveFile);
+            long long rawBytes, storedBytes;
+            if(compressSaves) {
+                // The sections are already whole in memory (see SaveSchema); the compressor
+                // packs them into the file a block at a time
+                CompressedOutBuf packer(*target);
+                ostream packed(&packer);
+                writeGameState(packed);
+                if(!packed.good() || !packer.finish()) {
+                    throw FileOperationException("save", saveFileName);
+                }
+                rawBytes = packer.getRawBytes();
+                storedBytes = packer.getStoredBytes();
+            } else {
+                writeGameState(*target);
+                rawBytes = storedBytes = (long long)target->tellp();
+            }
             
-            // Save dungeon
-            dungeon->serialize(saveFile);
+            if(saveFile.is_open()) {
+                saveFile.close();
+                if(saveFile.fail()) {
+                    throw FileOperationException("save", saveFileName);
+                }
+            }
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
             
-            saveFile.close();
-            cout << "Game saved successfully!" << endl;
-            String logMsg = String("Game saved to ") + saveFileName;
-            LOG_INFO(logMsg);
+            gameOutput << "Game saved successfully!\n";
+            LOG_INFO(String("Game saved to ") + saveFileName + ": " +
+                     describeTransfer(rawBytes, storedBytes, seconds));
             
         } catch(const GameException& e) {
-            cout << e.what() << endl;
+            gameOutput << e.what() << "\n";
         }
     }
     
     void handleLoad() {
         try {
             string filename = stringToStdString(saveFileName);
-            ifstream loadFile(filename.c_str(), ios::binary);
-            if(!loadFile.is_open()) {
-                throw FileOperationException("load", saveFileName);
+            auto start = chrono::steady_clock::now();
+            bool loadedWon = false;
+            Character* loadedPlayer = nullptr;
+            Dungeon* loadedDungeon = nullptr;
+            long long rawBytes, storedBytes;
+            if(replayLoads || recorder) {
+                // The file passes through memory: a recording keeps it, a replay reads it back from there
+                string bytes;
+                bool found = false;
+                if(replayLoads) {
+                    if(nextLoad < replayLoads->loads.size()) {
+                        const SessionLog::LoadedFile& file = replayLoads->loads[nextLoad];
+                        found = file.found;
+                        bytes.assign(replayLoads->loadedBytes.data() + file.offset, file.length);
+                    }
+                    nextLoad++;
+                } else {
+                    ifstream loadFile(filename.c_str(), ios::binary);
+                    found = loadFile.is_open();
+                    if(found) bytes.assign(istreambuf_iterator<char>(loadFile), istreambuf_iterator<char>());
+                    recorder->loaded(found ? &bytes : nullptr);
+                }
+                if(!found) {
+                    throw FileOperationException("load", saveFileName);
+                }
+                istringstream loadFile(bytes);
+                readSave(loadFile, loadedWon, loadedPlayer, loadedDungeon, rawBytes, storedBytes);
+            } else {
+                ifstream loadFile(filename.c_str(), ios::binary);
+                if(!loadFile.is_open()) {
+                    throw FileOperationException("load", saveFileName);
+                }
+                readSave(loadFile, loadedWon, loadedPlayer, loadedDungeon, rawBytes, storedBytes);
             }
             
-            // Clean up current game
-            cleanup();
-            
-            // Load game state
-            loadFile.read(reinterpret_cast<char*>(&gameWon), sizeof(gameWon));
+            // Only now replace the current game
+            replaceGame(loadedWon, loadedPlayer, loadedDungeon);
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
             
-            // Load player
-            player = new Character();
-            player->deserialize(loadFile);
-            
-            // Load dungeon
-            dungeon = new Dungeon();
-            dungeon->deserialize(loadFile);
-            dungeon->setPlayer(player);
-            
-            loadFile.close();
-            cout << "Game loaded successfully!" << endl;
-            String logMsg = String("Game loaded from ") + saveFileName;
-            LOG_INFO(logMsg);
+            gameOutput << "Game loaded successfully!\n";
+            LOG_INFO(String("Game loaded from ") + saveFileName + ": " +
+                     describeTransfer(rawBytes, storedBytes, seconds));
             
             // Display current location after loading
             dungeon->displayCurrentLocation();
             
         } catch(const GameException& e) {
-            cout << e.what() << endl;
-            // Reinitialize game if load fails
-            initializeGame();
+            // The running game was never touched, so play simply continues
+            gameOutput << e.what() << "\n";
+            LOG_WARNING(String("Rejected save file ") + saveFileName + ": " + e.getMessage());
         }
     }
     
+    // Uncompressed saves are kept for benchmarking against the compressed container
+    void setSaveCompression(bool enabled) {
+        compressSaves = enabled;
+    }
+    
     bool isRunning() const {
         return gameRunning;
     }
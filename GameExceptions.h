@@ -4,6 +4,7 @@
 #include <iostream>
 #include <exception>
 #include "String.h"
+#include "OutputSink.h"
 
 using namespace std;
 
@@ -166,7 +167,7 @@ inline void handleGameException(const GameException& e, const String& context =
     }
     fullMessage = fullMessage + ": " + e.getMessage();
 
-    cout << "ERROR: " << fullMessage << endl;
+    gameOutput << "ERROR: " << fullMessage << "\n";
 
 #ifdef LOG_ERROR
     LOG_ERROR(fullMessage);
@@ -0,0 +1,91 @@
+// Dungeon generation speed against thread count: the same seed is generated at every
+// count, timing the chunked layout on its own and the whole Dungeon built from it. The
+// layout must not depend on the thread count, which the checksum column confirms.
+// Usage: GenerateBenchmark [size] [rounds] [seed] [max threads]
+#include "Dungeon.h"
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+using namespace std;
+
+thread_local GameOutput gameOutput;
+
+static double median(vector<double> seconds)
+{
+    sort(seconds.begin(), seconds.end());
+    return seconds[seconds.size() / 2];
+}
+
+static uint64_t checksum(const DungeonLayout& layout)
+{
+    uint64_t sum = 1469598103934665603ull;
+    for(uint8_t cell : layout.cells) sum = (sum ^ cell) * 1099511628211ull;
+    for(const DungeonLayout::Spawn& spawn : layout.spawns)
+    {
+        sum = (sum ^ (uint64_t)(spawn.y * layout.width + spawn.x)) * 1099511628211ull;
+        sum = (sum ^ (uint64_t)spawn.entry) * 1099511628211ull;
+    }
+    return sum;
+}
+
+int main(int argc, char* argv[])
+{
+    int size = argc > 1 ? atoi(argv[1]) : 2048;
+    int rounds = argc > 2 ? atoi(argv[2]) : 5;
+    uint64_t seed = argc > 3 ? strtoull(argv[3], nullptr, 10) : 1;
+    int maxThreads = argc > 4 ? atoi(argv[4]) : 32;
+    if(size < 16 || rounds < 1 || maxThreads < 1)
+    {
+        cerr << "Usage: " << argv[0] << " [size >= 16] [rounds >= 1] [seed] [max threads >= 1]" << endl;
+        return 1;
+    }
+
+    NullSink discard;
+    gameOutput.setSink(&discard);
+    int chunks = ((size + DungeonGenerator::CHUNK_SIZE - 1) / DungeonGenerator::CHUNK_SIZE) *
+                 ((size + DungeonGenerator::CHUNK_SIZE - 1) / DungeonGenerator::CHUNK_SIZE);
+    printf("%dx%d map, %d chunks, %d rounds, %u hardware threads\n", size, size, chunks, rounds,
+           thread::hardware_concurrency());
+    printf("threads  layout Mcells/s  dungeon Mcells/s  speed-up  checksum\n");
+
+    // One untimed build first, so the allocator and page cache start warm for every count
+    {
+        Dungeon warmUp(size, size, "Benchmark", seed, 1);
+    }
+
+    double cells = (double)size * size;
+    double baseline = 0;
+    for(int threads = 1; threads <= maxThreads; threads *= 2)
+    {
+        vector<double> layoutSeconds, dungeonSeconds;
+        uint64_t sum = 0;
+        // Layouts first: freeing a whole Dungeon hands memory back, which would land in the next layout
+        for(int round = 0; round < rounds; round++)
+        {
+            auto start = chrono::steady_clock::now();
+            DungeonLayout layout = DungeonGenerator::generate(size, size, seed, threads);
+            layoutSeconds.push_back(chrono::duration<double>(chrono::steady_clock::now() - start).count());
+            sum = checksum(layout);
+        }
+        for(int round = 0; round < rounds; round++)
+        {
+            auto start = chrono::steady_clock::now();
+            {
+                Dungeon dungeon(size, size, "Benchmark", seed, threads);
+            }
+            dungeonSeconds.push_back(chrono::duration<double>(chrono::steady_clock::now() - start).count());
+        }
+
+        double layout = median(layoutSeconds);
+        double dungeon = median(dungeonSeconds);
+        if(threads == 1) baseline = layout;
+        printf("%7d  %15.1f  %16.1f  %7.2fx  %016llx\n", threads, cells / layout / 1e6, cells / dungeon / 1e6,
+               baseline / layout, (unsigned long long)sum);
+    }
+    gameOutput.setSink(nullptr);
+    return 0;
+}
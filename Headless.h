@@ -0,0 +1,89 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <iostream>
+#include <fstream>
+#include <string>
+using namespace std;
+
+// How combat answers "Continue fighting? (y/n)"
+struct CombatPolicy {
+    enum Mode {
+        ASK,            // Prompt on stdin (interactive play)
+        FIGHT_TO_END,   // Always keep fighting
+        FLEE_BELOW      // Flee once health drops under fleeHealthPercent of max
+    };
+
+    Mode mode;
+    int fleeHealthPercent;
+    bool resolveAtOnce; // Settle the whole fight in one step with a single summary (not with ASK)
+
+    CombatPolicy(Mode m = ASK, int percent = 0, bool atOnce = false)
+        : mode(m), fleeHealthPercent(percent), resolveAtOnce(atOnce) {}
+
+    // Decides without prompting; only valid when mode != ASK
+    bool keepFighting(int health, int maxHealth) const {
+        if(mode == FLEE_BELOW) {
+            return (long long)health * 100 >= (long long)fleeHealthPercent * maxHealth;
+        }
+        return true;
+    }
+};
+
+// Supplies command lines to a headless run, one at a time
+class CommandSource {
+public:
+    virtual ~CommandSource() {}
+
+    // Points text/length at the next line (without its newline); false at the end
+    virtual bool next(const char*& text, int& length) = 0;
+};
+
+// Lines from any stream: a script file, a pipe, or stdin
+class StreamCommandSource : public CommandSource {
+private:
+    istream& in;
+    string line;
+
+public:
+    StreamCommandSource(istream& input) : in(input) {}
+
+    virtual bool next(const char*& text, int& length) override {
+        if(!getline(in, line)) return false;
+        text = line.data();
+        length = (int)line.size();
+        return true;
+    }
+};
+
+// Lines from a memory buffer; returns views into it, so replay does not copy or allocate
+class BufferCommandSource : public CommandSource {
+private:
+    const char* cur;
+    const char* end;
+
+public:
+    BufferCommandSource(const char* data, size_t size) : cur(data), end(data + size) {}
+
+    virtual bool next(const char*& text, int& length) override {
+        if(cur >= end) return false;
+        const char* lineEnd = cur;
+        while(lineEnd < end && *lineEnd != '\n') lineEnd++;
+        text = cur;
+        length = (int)(lineEnd - cur);
+        cur = lineEnd < end ? lineEnd + 1 : end;
+        return true;
+    }
+};
+
+// Outcome of a headless run
+struct HeadlessReport {
+    long long commands;
+    double seconds;
+
+    double commandsPerSecond() const {
+        return seconds > 0 ? commands / seconds : 0;
+    }
+};
+
+#endif
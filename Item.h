@@ -59,11 +59,11 @@ public:
     
     // Override virtual functions
     virtual void display() const override {
-        cout << "Item: " << name << " - " << description << " (Value: " << value << ")" << endl;
+        gameOutput << "Item: " << name << " - " << description << " (Value: " << value << ")\n";
     }
     
     virtual bool interact() override {
-        cout << "You picked up: " << name << endl;
+        gameOutput << "You picked up: " << name << "\n";
         return true;
     }
     
@@ -74,37 +74,33 @@ public:
     bool getConsumable() const { return isConsumable; }
     
     // Setters
-    void setValue(int newValue) { value = newValue; }
-    void setDescription(const String& desc) { description = desc; }
+    void setValue(int newValue) { assign(value, newValue, StateHash::VALUE); }
+    void setDescription(const String& desc) { assign(description, desc, StateHash::DESCRIPTION); }
+    
+    virtual uint64_t hashContribution(uint64_t subject) const override {
+        StateHash::Keys key(subject);
+        return Entity::hashContribution(subject) ^
+               key(StateHash::TYPE, StateHash::value(type)) ^
+               key(StateHash::VALUE, StateHash::value(value)) ^
+               key(StateHash::CONSUMABLE, StateHash::value(isConsumable)) ^
+               key(StateHash::DESCRIPTION, StateHash::value(description));
+    }
     
     // Serialization
-    virtual void serialize(ofstream& file) const override {
-        Entity::serialize(file);
-        file.write(reinterpret_cast<const char*>(&type), sizeof(type));
-        file.write(reinterpret_cast<const char*>(&value), sizeof(value));
-        file.write(reinterpret_cast<const char*>(&isConsumable), sizeof(isConsumable));
-        
-        int descLen = description.size();
-        file.write(reinterpret_cast<const char*>(&descLen), sizeof(descLen));
-        for(int i = 0; i < descLen; i++) {
-            file.write(&description[i], sizeof(char));
-        }
+    virtual void serialize(SaveWriter& out) const override {
+        Entity::serialize(out);
+        out.writeEnum(type);
+        out.writeI32(value);
+        out.writeBool(isConsumable);
+        out.writeString(description);
     }
     
-    virtual void deserialize(ifstream& file) override {
-        Entity::deserialize(file);
-        file.read(reinterpret_cast<char*>(&type), sizeof(type));
-        file.read(reinterpret_cast<char*>(&value), sizeof(value));
-        file.read(reinterpret_cast<char*>(&isConsumable), sizeof(isConsumable));
-        
-        int descLen;
-        file.read(reinterpret_cast<char*>(&descLen), sizeof(descLen));
-        description.clear();
-        for(int i = 0; i < descLen; i++) {
-            char ch;
-            file.read(&ch, sizeof(char));
-            description.push_back(ch);
-        }
+    virtual void deserialize(SaveReader& in) override {
+        Entity::deserialize(in);
+        type = in.readEnum(ItemType::TREASURE);
+        value = in.readI32();
+        isConsumable = in.readBool();
+        description = in.readString();
     }
 };
 
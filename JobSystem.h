@@ -0,0 +1,171 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <functional>
+using namespace std;
+
+// Work-stealing thread pool for data-parallel loops.
+//
+// parallelFor hands out its range as tasks. Every worker has its own deque: it takes
+// tasks from the back of its own deque, and when that is empty it steals from the front
+// of someone else's. A task bigger than the grain splits itself, leaving the other half
+// on the owner's deque for thieves, so an uneven loop still spreads across all workers.
+// Idle workers park on a condition variable instead of spinning.
+//
+// The thread calling parallelFor works too and returns once every index has run. Only
+// one parallelFor may be in flight per pool, and the body must not throw.
+class JobSystem {
+private:
+    struct Batch {
+        const function<void(int, int)>* body;
+        int grain;
+        atomic<int> remaining; // Indices not yet run
+    };
+
+    struct Task {
+        Batch* batch;
+        int begin, end;
+    };
+
+    struct Queue {
+        mutex lock;
+        deque<Task> tasks;
+    };
+
+    vector<unique_ptr<Queue>> queues; // One per worker, plus the caller's at the end
+    vector<thread> workers;
+    mutex parkLock;
+    condition_variable wake;
+    atomic<int> queued;               // Tasks sitting in any deque
+    int parked;
+    bool stopping;
+    atomic<long long> steals;
+
+    void push(int self, const Task& task) {
+        {
+            lock_guard<mutex> lock(queues[self]->lock);
+            queues[self]->tasks.push_back(task);
+        }
+        queued++;
+        // Checked under the park lock so a worker about to park cannot miss it
+        lock_guard<mutex> lock(parkLock);
+        if(parked > 0) wake.notify_one();
+    }
+
+    bool popOwn(int self, Task& task) {
+        Queue& q = *queues[self];
+        lock_guard<mutex> lock(q.lock);
+        if(q.tasks.empty()) return false;
+        task = q.tasks.back();
+        q.tasks.pop_back();
+        queued--;
+        return true;
+    }
+
+    bool steal(int self, Task& task) {
+        int count = (int)queues.size();
+        for(int i = 1; i < count; i++) {
+            Queue& q = *queues[(self + i) % count];
+            lock_guard<mutex> lock(q.lock);
+            if(q.tasks.empty()) continue;
+            task = q.tasks.front();
+            q.tasks.pop_front();
+            queued--;
+            steals++;
+            return true;
+        }
+        return false;
+    }
+
+    bool find(int self, Task& task) {
+        return popOwn(self, task) || steal(self, task);
+    }
+
+    void execute(int self, Task task) {
+        // Keep the first half, offer the rest
+        while(task.end - task.begin > task.batch->grain) {
+            int mid = task.begin + (task.end - task.begin) / 2;
+            push(self, Task{task.batch, mid, task.end});
+            task.end = mid;
+        }
+        (*task.batch->body)(task.begin, task.end);
+        task.batch->remaining -= task.end - task.begin;
+    }
+
+    void workerLoop(int self) {
+        for(;;) {
+            Task task;
+            if(find(self, task)) {
+                execute(self, task);
+                continue;
+            }
+            unique_lock<mutex> lock(parkLock);
+            parked++;
+            wake.wait(lock, [this] { return stopping || queued.load() > 0; });
+            parked--;
+            if(stopping) return;
+        }
+    }
+
+public:
+    // threads = total threads including the caller; 0 uses every core
+    explicit JobSystem(int threads = 0) : queued(0), parked(0), stopping(false), steals(0) {
+        if(threads <= 0) threads = (int)thread::hardware_concurrency();
+        if(threads <= 0) threads = 1;
+        for(int i = 0; i < threads; i++) {
+            queues.push_back(unique_ptr<Queue>(new Queue()));
+        }
+        for(int i = 0; i + 1 < threads; i++) {
+            workers.emplace_back(&JobSystem::workerLoop, this, i);
+        }
+    }
+
+    ~JobSystem() {
+        {
+            lock_guard<mutex> lock(parkLock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for(thread& worker : workers) worker.join();
+    }
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    // Calls body(begin, end) over [0, count) in pieces of at most `grain` indices
+    void parallelFor(int count, int grain, const function<void(int, int)>& body) {
+        if(count <= 0) return;
+        if(grain < 1) grain = 1;
+        if(workers.empty() || count <= grain) {
+            body(0, count);
+            return;
+        }
+
+        Batch batch;
+        batch.body = &body;
+        batch.grain = grain;
+        batch.remaining = count;
+        int self = (int)queues.size() - 1;
+        execute(self, Task{&batch, 0, count});
+        while(batch.remaining.load() > 0) {
+            Task task;
+            if(find(self, task)) {
+                execute(self, task);
+            } else {
+                this_thread::yield(); // The last pieces are running elsewhere
+            }
+        }
+    }
+
+    int getThreadCount() const { return (int)queues.size(); }
+    long long getStealCount() const { return steals.load(); }
+};
+
+#endif
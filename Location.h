@@ -4,6 +4,7 @@
 #include "String.h"
 #include "Item.h"
 #include "Monster.h"
+#include "StateHash.h"
 #include <vector>
 #include <iostream>
 using namespace std;
@@ -27,14 +28,29 @@ private:
     bool isAccessible;
     vector<Item*> items; // Aggregation - Location has Items
     vector<Monster*> monsters; // Aggregation - Location has Monsters
+    StateHash* stateHash; // World hash this cell is counted in, if any
+    
+    template<typename T>
+    void assign(T& field, const T& value, StateHash::Field which) {
+        StateHash::assign(stateHash, StateHash::cell(x, y), which, field, value);
+    }
+    
+    // Adds or removes the key for one item or monster lying here
+    void toggleHolds(StateHash::Field which, int entityId) {
+        if(stateHash) {
+            uint64_t subject = StateHash::cell(x, y);
+            stateHash->change(subject, StateHash::key(subject, which, StateHash::value(entityId)));
+        }
+    }
     
 public:
-    Location() : x(0), y(0), type(LocationType::EMPTY), isVisited(false), isAccessible(true) {
+    Location() : x(0), y(0), type(LocationType::EMPTY), isVisited(false), isAccessible(true), stateHash(nullptr) {
         description = "An empty space";
     }
     
     Location(int posX, int posY, LocationType locType, const String& desc = "A mysterious place")
-        : x(posX), y(posY), type(locType), description(desc), isVisited(false), isAccessible(true) {}
+        : x(posX), y(posY), type(locType), description(desc), isVisited(false), isAccessible(true),
+          stateHash(nullptr) {}
     
     ~Location() {
         // Note: We don't delete items and monsters here as they might be managed elsewhere
@@ -43,41 +59,45 @@ public:
     
     // Display location information
     void display() const {
-        cout << "=== Location (" << x << ", " << y << ") ===" << endl;
-        cout << description << endl;
+        gameOutput << "=== Location (" << x << ", " << y << ") ===\n";
+        gameOutput << description << "\n";
         
         if(!items.empty()) {
-            cout << "Items here:" << endl;
+            gameOutput << "Items here:\n";
             for(const Item* item : items) {
                 if(item->getActive()) {
-                    cout << "  - " << item->getName() << ": " << item->getDescription() << endl;
+                    gameOutput << "  - " << item->getName() << ": " << item->getDescription() << "\n";
                 }
             }
         }
         
         if(!monsters.empty()) {
-            cout << "Creatures here:" << endl;
+            gameOutput << "Creatures here:\n";
             for(const Monster* monster : monsters) {
                 if(monster->getActive() && !monster->getDefeated()) {
-                    cout << "  - " << monster->getName() << " (Hostile)" << endl;
+                    gameOutput << "  - " << monster->getName() << " (Hostile)\n";
                 }
             }
         }
         
-        cout << "Visited: " << (isVisited ? "Yes" : "No") << endl;
+        gameOutput << "Visited: " << (isVisited ? "Yes" : "No") << "\n";
     }
     
     // Item management
     void addItem(Item* item) {
         if(item) {
             items.push_back(item);
+            toggleHolds(StateHash::HOLDS_ITEM, item->getId());
             item->setPosition(x, y);
+            item->setPlaced(true);
         }
     }
     
     bool removeItem(int itemId) {
         for(auto it = items.begin(); it != items.end(); ++it) {
             if((*it)->getId() == itemId) {
+                (*it)->setPlaced(false);
+                toggleHolds(StateHash::HOLDS_ITEM, itemId);
                 items.erase(it);
                 return true;
             }
@@ -98,13 +118,34 @@ public:
     void addMonster(Monster* monster) {
         if(monster) {
             monsters.push_back(monster);
+            toggleHolds(StateHash::HOLDS_MONSTER, monster->getId());
             monster->setPosition(x, y);
+            monster->setPlaced(true);
         }
     }
     
+    // Hands a monster to another cell without taking it off the map, so its tracker hears a
+    // move (usually within one bucket) instead of a removal and a placement
+    bool passMonster(int monsterId, Location& to) {
+        for(auto it = monsters.begin(); it != monsters.end(); ++it) {
+            Monster* monster = *it;
+            if(monster->getId() == monsterId) {
+                toggleHolds(StateHash::HOLDS_MONSTER, monsterId);
+                monsters.erase(it);
+                to.monsters.push_back(monster);
+                to.toggleHolds(StateHash::HOLDS_MONSTER, monsterId);
+                monster->setPosition(to.x, to.y);
+                return true;
+            }
+        }
+        return false;
+    }
+    
     bool removeMonster(int monsterId) {
         for(auto it = monsters.begin(); it != monsters.end(); ++it) {
             if((*it)->getId() == monsterId) {
+                (*it)->setPlaced(false);
+                toggleHolds(StateHash::HOLDS_MONSTER, monsterId);
                 monsters.erase(it);
                 return true;
             }
@@ -124,8 +165,8 @@ public:
     // Location interaction
     void enter() {
         if(!isVisited) {
-            cout << "You enter a new area..." << endl;
-            isVisited = true;
+            gameOutput << "You enter a new area...\n";
+            assign(isVisited, true, StateHash::VISITED);
         }
         display();
     }
@@ -135,7 +176,7 @@ public:
     }
     
     void setAccessible(bool accessible) {
-        isAccessible = accessible;
+        assign(isAccessible, accessible, StateHash::ACCESSIBLE);
     }
     
     // Getters
@@ -148,9 +189,28 @@ public:
     const vector<Monster*>& getMonsters() const { return monsters; }
     
     // Setters
-    void setType(LocationType newType) { type = newType; }
-    void setDescription(const String& desc) { description = desc; }
-    void setVisited(bool visited) { isVisited = visited; }
+    void setType(LocationType newType) { assign(type, newType, StateHash::TYPE); }
+    void setDescription(const String& desc) { assign(description, desc, StateHash::DESCRIPTION); }
+    void setVisited(bool visited) { assign(isVisited, visited, StateHash::VISITED); }
+    
+    // This cell's share of the state hash: its fields and what lies in it
+    uint64_t hashContribution() const {
+        StateHash::Keys key(StateHash::cell(x, y));
+        uint64_t h = key(StateHash::TYPE, StateHash::value(type)) ^
+                     key(StateHash::DESCRIPTION, StateHash::value(description)) ^
+                     key(StateHash::VISITED, StateHash::value(isVisited)) ^
+                     key(StateHash::ACCESSIBLE, StateHash::value(isAccessible));
+        for(const Item* item : items) {
+            h ^= key(StateHash::HOLDS_ITEM, StateHash::value(item->getId()));
+        }
+        for(const Monster* monster : monsters) {
+            h ^= key(StateHash::HOLDS_MONSTER, StateHash::value(monster->getId()));
+        }
+        return h;
+    }
+    
+    // Reports later changes to `hash`; the caller has counted hashContribution() already
+    void setStateHash(StateHash* hash) { stateHash = hash; }
     
     // Check if location has specific items or monsters
     bool hasItems() const {
@@ -170,10 +230,19 @@ public:
     // Get character representation for map
     char getMapSymbol() const {
         if(!isVisited) return '?';
-        
+        return getVisibleSymbol();
+    }
+    
+    // What the player sees when the cell is in view, explored or not
+    char getVisibleSymbol() const {
         if(hasMonsters()) return 'M';
         if(hasItems()) return 'I';
-        
+        return getTerrainSymbol();
+    }
+    
+    // Remembered shape of a cell seen from afar; contents may have moved since
+    char getTerrainSymbol() const {
+        if(!isAccessible) return '#';
         switch(type) {
             case LocationType::ENTRANCE: return 'S';
             case LocationType::EXIT: return 'E';
@@ -185,66 +254,25 @@ public:
         }
     }
     
-    // Serialization
-    void serialize(ofstream& file) const {
-        file.write(reinterpret_cast<const char*>(&x), sizeof(x));
-        file.write(reinterpret_cast<const char*>(&y), sizeof(y));
-        file.write(reinterpret_cast<const char*>(&type), sizeof(type));
-        file.write(reinterpret_cast<const char*>(&isVisited), sizeof(isVisited));
-        file.write(reinterpret_cast<const char*>(&isAccessible), sizeof(isAccessible));
-        
-        int descLen = description.size();
-        file.write(reinterpret_cast<const char*>(&descLen), sizeof(descLen));
-        for(int i = 0; i < descLen; i++) {
-            file.write(&description[i], sizeof(char));
-        }
-        
-        int itemCount = items.size();
-        file.write(reinterpret_cast<const char*>(&itemCount), sizeof(itemCount));
-        for(const Item* item : items) {
-            item->serialize(file);
-        }
-        
-        int monsterCount = monsters.size();
-        file.write(reinterpret_cast<const char*>(&monsterCount), sizeof(monsterCount));
-        for(const Monster* monster : monsters) {
-            monster->serialize(file);
-        }
+    // Serialization - cell fields only; Dungeon writes the item and monster ids it holds
+    void serialize(SaveWriter& out) const {
+        out.writeI32(x);
+        out.writeI32(y);
+        out.writeEnum(type);
+        out.writeBool(isVisited);
+        out.writeBool(isAccessible);
+        out.writeString(description);
     }
     
-    void deserialize(ifstream& file) {
-        file.read(reinterpret_cast<char*>(&x), sizeof(x));
-        file.read(reinterpret_cast<char*>(&y), sizeof(y));
-        file.read(reinterpret_cast<char*>(&type), sizeof(type));
-        file.read(reinterpret_cast<char*>(&isVisited), sizeof(isVisited));
-        file.read(reinterpret_cast<char*>(&isAccessible), sizeof(isAccessible));
-        
-        int descLen;
-        file.read(reinterpret_cast<char*>(&descLen), sizeof(descLen));
-        description.clear();
-        for(int i = 0; i < descLen; i++) {
-            char ch;
-            file.read(&ch, sizeof(char));
-            description.push_back(ch);
-        }
-        
-        int itemCount;
-        file.read(reinterpret_cast<char*>(&itemCount), sizeof(itemCount));
+    void deserialize(SaveReader& in) {
+        x = in.readI32();
+        y = in.readI32();
+        type = in.readEnum(LocationType::EXIT);
+        isVisited = in.readBool();
+        isAccessible = in.readBool();
+        description = in.readString();
         items.clear();
-        for(int i = 0; i < itemCount; i++) {
-            Item* item = new Item();
-            item->deserialize(file);
-            items.push_back(item);
-        }
-        
-        int monsterCount;
-        file.read(reinterpret_cast<char*>(&monsterCount), sizeof(monsterCount));
         monsters.clear();
-        for(int i = 0; i < monsterCount; i++) {
-            Monster* monster = new Monster();
-            monster->deserialize(file);
-            monsters.push_back(monster);
-        }
     }
 };
 
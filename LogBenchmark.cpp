@@ -0,0 +1,149 @@
+// Cost of a log call on each backend: several threads log game-like lines as fast as they
+// can, with latency tracking on, and the time per call is reported at p50/p99 along with
+// total throughput. The same combat hits then go through the binary event log, and a
+// coarse clock read is timed against steady_clock::now(). Console echo is off; output goes
+// to LogBenchmark.log and LogBenchmark.bin, removed afterwards.
+// Usage: LogBenchmark [threads] [lines per thread] [ring capacity]
+#include "Character.h"
+#include "Logger.h"
+#include "EventLog.h"
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+using namespace std;
+
+thread_local GameOutput gameOutput;
+Logger<String>* gameLogger = nullptr;
+
+enum Backend
+{
+    SYNC,
+    ASYNC,
+    THREAD_BUFFERS
+};
+
+static const char* backendName(Backend backend)
+{
+    switch(backend)
+    {
+        case ASYNC: return "async ring";
+        case THREAD_BUFFERS: return "thread buffers";
+        default: return "sync";
+    }
+}
+
+static void run(Backend backend, int threads, int lines, size_t capacity)
+{
+    remove("LogBenchmark.log");
+    Logger<String> logger("LogBenchmark.log", LogLevel::INFO);
+    logger.setConsoleEcho(false);
+    if(backend == ASYNC) logger.enableAsync(capacity, OverflowPolicy::BLOCK);
+    if(backend == THREAD_BUFFERS) logger.enableThreadBuffers(capacity);
+    logger.setLatencyTracking(true);
+
+    auto start = chrono::steady_clock::now();
+    vector<thread> workers;
+    for(int t = 0; t < threads; t++)
+    {
+        workers.emplace_back([&logger, lines, t]()
+        {
+            LogSession::set(t + 1);
+            for(int i = 0; i < lines; i++)
+            {
+                logger.logCombat("Hero", "Goblin", i % 17);
+            }
+        });
+    }
+    for(thread& worker : workers) worker.join();
+    double pushSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    String latency = logger.latencyReport();
+    logger.setLatencyTracking(false);
+    logger.flush();
+    double totalSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    long long total = (long long)threads * lines;
+    printf("%-15s %s\n", backendName(backend), latency.c_str());
+    printf("%15s %.2f M lines/s logged, %.2f M lines/s written\n", "", total / pushSeconds / 1e6,
+           total / totalSeconds / 1e6);
+}
+
+// The event log has no latency tracking, so this is the average call: wall time per thread over its calls
+static void runEvents(int threads, int lines)
+{
+    remove("LogBenchmark.bin");
+    EventLog events("LogBenchmark.bin");
+
+    auto start = chrono::steady_clock::now();
+    vector<thread> workers;
+    for(int t = 0; t < threads; t++)
+    {
+        workers.emplace_back([&events, lines, t]()
+        {
+            for(int i = 0; i < lines; i++)
+            {
+                events.record(GameEventId::COMBAT_HIT, t + 1, 2, i % 17, 100 - i % 100);
+            }
+        });
+    }
+    for(thread& worker : workers) worker.join();
+    events.flush();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    long long total = (long long)threads * lines;
+    printf("%-15s avg=%.0fns (%lld calls)\n", "binary events", seconds * 1e9 * threads / total, total);
+    printf("%15s %.2f M events/s written\n", "", total / seconds / 1e6);
+}
+
+static void runClocks(int reads)
+{
+    uint64_t sum = 0;
+    auto start = chrono::steady_clock::now();
+    for(int i = 0; i < reads; i++)
+    {
+        sum += (uint64_t)chrono::steady_clock::now().time_since_epoch().count();
+    }
+    double steadySeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    CoarseClock::tick();
+    start = chrono::steady_clock::now();
+    for(int i = 0; i < reads; i++)
+    {
+        sum += CoarseClock::nowNs();
+    }
+    double coarseSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    volatile uint64_t sink = sum;
+    (void)sink;
+    printf("%-15s steady_clock::now() %.1f ns, CoarseClock::nowNs() %.1f ns (%.0fx)\n", "clock read",
+           steadySeconds * 1e9 / reads, coarseSeconds * 1e9 / reads,
+           coarseSeconds > 0 ? steadySeconds / coarseSeconds : 0.0);
+}
+
+int main(int argc, char* argv[])
+{
+    int threads = argc > 1 ? atoi(argv[1]) : 4;
+    int lines = argc > 2 ? atoi(argv[2]) : 50000;
+    int capacity = argc > 3 ? atoi(argv[3]) : 8192;
+    if(threads < 1 || lines < 1 || capacity < 2)
+    {
+        cerr << "Usage: " << argv[0] << " [threads >= 1] [lines per thread >= 1] [ring capacity >= 2]" << endl;
+        return 1;
+    }
+
+    NullSink discard;
+    gameOutput.setSink(&discard);
+    printf("%d threads x %d lines, ring capacity %d, %u hardware threads\n", threads, lines, capacity,
+           thread::hardware_concurrency());
+    run(SYNC, threads, lines, capacity);
+    run(ASYNC, threads, lines, capacity);
+    run(THREAD_BUFFERS, threads, lines, capacity);
+    runEvents(threads, lines);
+    runClocks(10000000);
+    remove("LogBenchmark.log");
+    remove("LogBenchmark.bin");
+    gameOutput.setSink(nullptr);
+    return 0;
+}
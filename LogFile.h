@@ -0,0 +1,248 @@
+#ifndef LOG_FILE_H
+#define LOG_FILE_H
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+using namespace std;
+
+// Monotonic clock that is read from a cached value and refreshed once per tick
+// (per command on the game thread, per wake-up on the log writer) instead of per line
+class CoarseClock {
+private:
+    static chrono::steady_clock::time_point origin() {
+        static const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        return start;
+    }
+
+    static atomic<uint64_t>& cached() {
+        static atomic<uint64_t> nanos(0);
+        return nanos;
+    }
+
+public:
+    // Refreshes the cached time; never moves it backwards when several threads tick
+    static uint64_t tick() {
+        uint64_t now = (uint64_t)chrono::duration_cast<chrono::nanoseconds>(
+            chrono::steady_clock::now() - origin()).count();
+        uint64_t seen = cached().load(memory_order_relaxed);
+        while(seen < now && !cached().compare_exchange_weak(seen, now, memory_order_relaxed)) {
+        }
+        return now > seen ? now : seen;
+    }
+
+    // Nanoseconds since the first use of the clock, as of the last tick
+    static uint64_t nowNs() {
+        return cached().load(memory_order_relaxed);
+    }
+};
+
+// Log file with size- and age-based rotation.
+//   game.log -> game.log.1 -> ... -> game.log.<keepFiles>; standby: game.log.next
+// Rotation never blocks the thread that writes: a rotator thread opens the next file
+// (game.log.next) ahead of time, write() only swaps it in for the full one, and the
+// rotator then closes the old file and renames the chain in the background. If the next
+// file is not ready yet, write() keeps appending to the current one and tries again on
+// the next write. write(), flush() and setRotation() may be called from any thread.
+class LogFile {
+private:
+    string path;
+    mutable mutex writeMutex;     // Guards the active file and the settings below
+    unique_ptr<ofstream> active;
+    uint64_t activeBytes;
+    uint64_t openedAtNs;
+
+    uint64_t maxBytes;     // 0 = no size limit
+    uint64_t maxAgeNs;     // 0 = no age limit
+    int keepFiles;
+    bool rotationEnabled;
+
+    // Handed between write() and the rotator; held only to move pointers, never for I/O
+    mutex handoffMutex;
+    condition_variable handoffWake;
+    unique_ptr<ofstream> standby;   // The next file, opened ahead by the rotator
+    unique_ptr<ofstream> retired;   // The file write() swapped out, still to be renamed
+    int retiredKeep;
+    bool wantStandby;
+    bool stopping;
+    thread rotator;
+
+    string rotatedName(int index) const {
+        return path + "." + to_string(index);
+    }
+
+    string standbyName() const {
+        return path + ".next";
+    }
+
+    bool tooOld() const {
+        return rotationEnabled && maxAgeNs > 0 && activeBytes > 0 &&
+               CoarseClock::nowNs() - openedAtNs >= maxAgeNs;
+    }
+
+    // Length of the longest prefix of whole lines that fits in limit bytes (0 if none)
+    static size_t wholeLinesWithin(const char* data, size_t limit) {
+        for(size_t i = limit; i > 0; i--) {
+            if(data[i - 1] == '\n') return i;
+        }
+        return 0;
+    }
+
+    // Swaps the standby in; false (and nothing changes) if it is not ready. Called with writeMutex held.
+    bool rotate() {
+        unique_lock<mutex> lock(handoffMutex, try_to_lock);
+        if(!lock.owns_lock() || !standby || retired) return false;
+        retired = move(active);
+        active = move(standby);
+        retiredKeep = keepFiles;
+        lock.unlock();
+        handoffWake.notify_one();
+        activeBytes = 0;
+        openedAtNs = CoarseClock::nowNs();
+        return true;
+    }
+
+    // Renames after a swap, then opens the next standby; a failed open is retried every second
+    void runRotator() {
+        unique_lock<mutex> lock(handoffMutex);
+        for(;;) {
+            if(retired) {
+                unique_ptr<ofstream> old = move(retired);
+                int keep = retiredKeep;
+                lock.unlock();
+                old->close();
+                remove(rotatedName(keep).c_str());
+                for(int i = keep - 1; i >= 1; i--) {
+                    rename(rotatedName(i).c_str(), rotatedName(i + 1).c_str());
+                }
+                rename(path.c_str(), rotatedName(1).c_str());
+                // The new active file is game.log.next until here; its stream follows the rename
+                rename(standbyName().c_str(), path.c_str());
+                lock.lock();
+                continue;
+            }
+            if(stopping) break;
+            if(wantStandby && !standby) {
+                lock.unlock();
+                unique_ptr<ofstream> next(new ofstream(standbyName().c_str(), ios::out | ios::trunc));
+                lock.lock();
+                if(next->is_open()) {
+                    standby = move(next);
+                } else {
+                    handoffWake.wait_for(lock, chrono::seconds(1));
+                }
+                continue;
+            }
+            handoffWake.wait(lock);
+        }
+    }
+
+    // Asks the rotator for a standby file if rotation is on, starting it on first use
+    void requestStandby() {
+        {
+            lock_guard<mutex> lock(handoffMutex);
+            wantStandby = rotationEnabled && active;
+        }
+        if(wantStandby && !rotator.joinable()) rotator = thread(&LogFile::runRotator, this);
+        handoffWake.notify_one();
+    }
+
+public:
+    LogFile() : activeBytes(0), openedAtNs(0), maxBytes(0), maxAgeNs(0), keepFiles(5), rotationEnabled(false),
+                retiredKeep(0), wantStandby(false), stopping(false) {}
+
+    ~LogFile() {
+        close();
+    }
+
+    LogFile(const LogFile&) = delete;
+    LogFile& operator=(const LogFile&) = delete;
+
+    bool open(const string& fileName) {
+        lock_guard<mutex> lock(writeMutex);
+        path = fileName;
+        active.reset(new ofstream(path.c_str(), ios::app));
+        if(!active->is_open()) {
+            active.reset();
+            return false;
+        }
+        active->seekp(0, ios::end);
+        activeBytes = (uint64_t)active->tellp();
+        openedAtNs = CoarseClock::tick();
+        requestStandby();
+        return true;
+    }
+
+    // Finishes any rotation in progress, then closes; nothing may write meanwhile
+    void close() {
+        if(rotator.joinable()) {
+            {
+                lock_guard<mutex> lock(handoffMutex);
+                stopping = true;
+            }
+            handoffWake.notify_one();
+            rotator.join();
+            stopping = false;
+        }
+        lock_guard<mutex> lock(writeMutex);
+        active.reset();
+        if(standby) {
+            standby.reset();
+            remove(standbyName().c_str());
+        }
+    }
+
+    // maxFileBytes / maxAgeSeconds of 0 disable that trigger
+    void setRotation(uint64_t maxFileBytes, int maxAgeSeconds, int keep = 5) {
+        lock_guard<mutex> lock(writeMutex);
+        maxBytes = maxFileBytes;
+        maxAgeNs = (uint64_t)(maxAgeSeconds > 0 ? maxAgeSeconds : 0) * 1000000000ull;
+        keepFiles = keep > 0 ? keep : 1;
+        rotationEnabled = maxBytes > 0 || maxAgeNs > 0;
+        requestStandby();
+    }
+
+    // Writes a block of whole lines, splitting it at line boundaries when it crosses the size limit
+    void write(const char* data, size_t len) {
+        lock_guard<mutex> lock(writeMutex);
+        if(!active) return;
+        if(tooOld()) rotate();
+        while(rotationEnabled && maxBytes > 0 && activeBytes + len > maxBytes) {
+            size_t room = maxBytes > activeBytes ? (size_t)(maxBytes - activeBytes) : 0;
+            size_t cut = wholeLinesWithin(data, room < len ? room : len);
+            if(cut == 0 && activeBytes == 0) break; // A single line longer than the limit
+            active->write(data, cut);
+            activeBytes += cut;
+            data += cut;
+            len -= cut;
+            if(!rotate()) break; // Next file not ready; keep appending
+        }
+        active->write(data, len);
+        activeBytes += len;
+    }
+
+    void flush() {
+        lock_guard<mutex> lock(writeMutex);
+        if(active) active->flush();
+    }
+
+    bool is_open() const {
+        lock_guard<mutex> lock(writeMutex);
+        return active != nullptr;
+    }
+
+    uint64_t getActiveBytes() const {
+        lock_guard<mutex> lock(writeMutex);
+        return activeBytes;
+    }
+};
+
+#endif
@@ -2,30 +2,103 @@
 #define LOGGER_H
 
 #include "String.h"
+#include "AsyncLog.h"
+#include "ThreadLog.h"
 #include <fstream>
 #include <iostream>
+#include <sstream>
+#include <chrono>
+#include <cstdio>
 using namespace std;
 
+// Ordered by severity, so "level >= threshold" means "should be logged"
 enum class LogLevel {
+    DEBUG,
     INFO,
     WARNING,
-    ERROR,
-    DEBUG
+    ERROR
 };
 
+// Compile-time floor: LOG_* macros below it expand to nothing, arguments included.
+// Build with e.g. -DLOG_MIN_LEVEL=LOG_LEVEL_WARNING to strip DEBUG and INFO calls.
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARNING 2
+#define LOG_LEVEL_ERROR 3
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL LOG_LEVEL_DEBUG
+#endif
+
 template<typename T>
 class Logger {
 private:
     String logFileName;
     LogLevel currentLevel;
-    ofstream logFile;
+    LogFile logFile;
+    size_t asyncCapacity;
+    OverflowPolicy asyncPolicy;
+    // Backends are published atomically: log() may run on any thread while they are switched
+    atomic<AsyncLogWriter*> asyncWriter;       // Null while logging synchronously
+    atomic<ThreadLogCollector*> collector;     // Per-thread buffers, for several sessions in one process
+    mutex configMutex;                         // Serializes enabling, disabling and flushing backends
+    // log() calls in progress, counted under the generation they started in, so retiring a
+    // backend waits only for calls that could have seen it and new calls cannot hold it up
+    atomic<unsigned> generation;
+    atomic<int> callers[2];
+    bool trackLatency;
+    atomic<bool> consoleEcho;
+    mutex syncMutex;                           // Synchronous writes, one line at a time
+    LatencyHistogram latency;
+    
+    // Counts a log() call for as long as it may use a backend
+    class Caller {
+    private:
+        atomic<int>& count;
+        
+        static atomic<int>& enter(Logger& logger) {
+            for(;;) {
+                unsigned g = logger.generation.load();
+                logger.callers[g & 1].fetch_add(1);
+                // Recheck, so a count never lands under a generation a retire has finished with
+                if(logger.generation.load() == g) return logger.callers[g & 1];
+                logger.callers[g & 1].fetch_sub(1);
+            }
+        }
+        
+    public:
+        explicit Caller(Logger& logger) : count(enter(logger)) {}
+        ~Caller() { count.fetch_sub(1); }
+    };
     
+    // Unpublishes a backend, waits out the calls that may still be using it, then deletes it
+    // (which writes everything it holds). Called with configMutex held.
+    template<typename Backend>
+    void retire(atomic<Backend*>& slot) {
+        Backend* old = slot.exchange(nullptr);
+        if(!old) return;
+        unsigned g = generation.fetch_add(1);
+        while(callers[g & 1].load() != 0) {
+            this_thread::yield();
+        }
+        delete old;
+    }
+    
+    // Seconds since start from the coarse clock, e.g. "[12.345678] "; no clock call per line
     String getCurrentTime() const {
-        // Simple timestamp - in real implementation you'd use proper time functions
-        static int timeCounter = 0;
-        String time;
-        time.itos(++timeCounter);
-        return String("[") + time + String("] ");
+        uint64_t nanos = CoarseClock::nowNs();
+        char stamp[32];
+        snprintf(stamp, sizeof(stamp), "[%llu.%06llu] ", (unsigned long long)(nanos / 1000000000ull),
+                 (unsigned long long)(nanos % 1000000000ull / 1000));
+        return String(stamp);
+    }
+    
+    // "[S3] " for records logged from a game session's thread, empty otherwise
+    String sessionTag() const {
+        unsigned session = LogSession::get();
+        if(session == 0) return String();
+        char tag[16];
+        snprintf(tag, sizeof(tag), "[S%u] ", session);
+        return String(tag);
     }
     
     String levelToString(LogLevel level) const {
@@ -40,37 +113,157 @@ private:
     
 public:
     Logger(const String& fileName = "game.log", LogLevel level = LogLevel::INFO) 
-        : logFileName(fileName), currentLevel(level) {
-        logFile.open(fileName.c_str(), ios::app);
-        if(!logFile.is_open()) {
+        : logFileName(fileName), currentLevel(level), asyncCapacity(8192), asyncPolicy(OverflowPolicy::BLOCK),
+          asyncWriter(nullptr), collector(nullptr), generation(0), trackLatency(false), consoleEcho(true) {
+        callers[0].store(0);
+        callers[1].store(0);
+        CoarseClock::tick();
+        if(!logFile.open(fileName.c_str())) {
             cerr << "Warning: Could not open log file " << fileName << endl;
         }
         log(LogLevel::INFO, "Logger initialized");
     }
     
     ~Logger() {
-        log(LogLevel::INFO, "Logger shutting down");
-        if(logFile.is_open()) {
-            logFile.close();
+        if(trackLatency) {
+            log(LogLevel::INFO, String("Log call latency: ") + latencyReport());
         }
+        log(LogLevel::INFO, "Logger shutting down");
+        disableAsync();
+        disableThreadBuffers();
+        logFile.close();
+    }
+    
+    // Cheap check the LOG_* macros make before building a message
+    bool isEnabled(LogLevel level) const {
+        return level >= currentLevel;
     }
     
     void log(LogLevel level, const String& message) {
-        if(level < currentLevel) return;
+        if(!isEnabled(level)) return;
         
-        String logEntry = getCurrentTime() + levelToString(level) + ": " + message;
+        chrono::steady_clock::time_point start;
+        if(trackLatency) start = chrono::steady_clock::now();
         
-        // Write to console
-        cout << logEntry << endl;
+        String logEntry = getCurrentTime() + sessionTag() + levelToString(level) + ": " + message;
+        
+        Caller caller(*this);
+        if(ThreadLogCollector* threads = collector.load()) {
+            threads->push(logEntry.c_str(), logEntry.size());
+        } else if(AsyncLogWriter* writer = asyncWriter.load()) {
+            // The writer thread echoes to the console and file in batches
+            writer->push(logEntry.c_str(), logEntry.size());
+        } else {
+            lock_guard<mutex> lock(syncMutex);
+            // Write to console
+            if(consoleEcho) {
+                lock_guard<mutex> console(consoleMutex());
+                cout << logEntry << endl;
+            }
+            
+            // Write to file
+            if(logFile.is_open()) {
+                String line = logEntry + "\n";
+                logFile.write(line.c_str(), line.size());
+                logFile.flush();
+            }
+        }
         
-        // Write to file
-        if(logFile.is_open()) {
-            logFile << logEntry << endl;
-            logFile.flush();
+        if(trackLatency) {
+            latency.record(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count());
+        }
+    }
+    
+    // Moves console and file output onto a background thread fed by a lock-free ring.
+    // Ignored while per-thread buffers are on; they already write off-thread.
+    void enableAsync(size_t capacity = 8192, OverflowPolicy policy = OverflowPolicy::BLOCK) {
+        lock_guard<mutex> lock(configMutex);
+        if(asyncWriter.load() || collector.load()) return;
+        asyncCapacity = capacity;
+        asyncPolicy = policy;
+        asyncWriter.store(new AsyncLogWriter(logFile, capacity, policy, consoleEcho));
+    }
+    
+    // Drains every queued record and returns to synchronous writes
+    void disableAsync() {
+        lock_guard<mutex> lock(configMutex);
+        retire(asyncWriter);
+    }
+    
+    // Rotates game.log to game.log.1.. once it passes maxBytes or maxAgeSeconds (0 = off).
+    // Safe while other threads log: the file takes the new settings on its next write.
+    void setRotation(unsigned long long maxBytes, int maxAgeSeconds, int keepFiles = 5) {
+        logFile.setRotation(maxBytes, maxAgeSeconds, keepFiles);
+    }
+    
+    // Whether log lines are also printed on the console (the file always gets them)
+    void setConsoleEcho(bool echo) {
+        lock_guard<mutex> lock(configMutex);
+        consoleEcho = echo;
+        if(AsyncLogWriter* writer = asyncWriter.load()) writer->setConsoleEcho(echo);
+        if(ThreadLogCollector* threads = collector.load()) threads->setConsoleEcho(echo);
+    }
+    
+    // Waits until every record logged before the call has been written. The backend keeps
+    // running, so other threads can go on logging meanwhile.
+    void flush() {
+        lock_guard<mutex> lock(configMutex); // Keeps the backend from being retired meanwhile
+        if(ThreadLogCollector* threads = collector.load()) {
+            threads->flush();
+        } else if(AsyncLogWriter* writer = asyncWriter.load()) {
+            writer->flush();
         }
+        logFile.flush();
+    }
+    
+    bool getConsoleEcho() const {
+        return consoleEcho;
+    }
+    
+    bool isAsync() const {
+        return asyncWriter.load() != nullptr || collector.load() != nullptr;
+    }
+    
+    // Each logging thread writes into its own buffer; a collector thread merges them in order.
+    // Use this when several GameEngine sessions share the logger from different threads.
+    // It takes over from the shared async ring rather than stacking on it: whatever the ring
+    // still holds is written first, and its overflow policy (BLOCK unless enableAsync said
+    // otherwise) now applies to each thread's buffer.
+    void enableThreadBuffers(size_t perThreadCapacity = 1024) {
+        lock_guard<mutex> lock(configMutex);
+        if(collector.load()) return;
+        retire(asyncWriter);
+        collector.store(new ThreadLogCollector(logFile, perThreadCapacity, asyncPolicy, consoleEcho));
+    }
+    
+    void disableThreadBuffers() {
+        lock_guard<mutex> lock(configMutex);
+        retire(collector);
+    }
+    
+    // Records the overflow policy discarded so far, on whichever backend is on
+    unsigned long long getDroppedCount() {
+        Caller caller(*this);
+        if(ThreadLogCollector* threads = collector.load()) return threads->getDroppedCount();
+        if(AsyncLogWriter* writer = asyncWriter.load()) return writer->getDroppedCount();
+        return 0;
+    }
+    
+    // Per-call latency of log() for accepted records, reported at p50/p99
+    void setLatencyTracking(bool enabled) {
+        trackLatency = enabled;
+        if(enabled) latency.reset();
+    }
+    
+    String latencyReport() const {
+        ostringstream report;
+        report << "p50=" << latency.percentile(0.50) << "ns p99=" << latency.percentile(0.99)
+               << "ns (" << latency.total() << " calls)";
+        return String(report.str().c_str());
     }
     
     void log(LogLevel level, const String& message, const T& data) {
+        if(!isEnabled(level)) return;
         String fullMessage = message + " - Data: ";
         // This is a simplified approach - in real implementation you'd use proper formatting
         log(level, fullMessage);
@@ -98,13 +291,14 @@ public:
     }
     
     void logPlayerAction(const String& action, const Character* player) {
-        if(player) {
+        if(player && isEnabled(LogLevel::INFO)) {
             String message = "Player '" + player->getName() + "' performed action: " + action;
             log(LogLevel::INFO, message);
         }
     }
     
     void logCombat(const String& attacker, const String& defender, int damage) {
+        if(!isEnabled(LogLevel::INFO)) return;
         String message = attacker + " attacks " + defender + " for ";
         String dmgStr;
         dmgStr.itos(damage);
@@ -113,11 +307,13 @@ public:
     }
     
     void logItemUsage(const String& playerName, const String& itemName) {
+        if(!isEnabled(LogLevel::INFO)) return;
         String message = playerName + " used item: " + itemName;
         log(LogLevel::INFO, message);
     }
     
     void logGameEvent(const String& event) {
+        if(!isEnabled(LogLevel::INFO)) return;
         log(LogLevel::INFO, "GAME EVENT: " + event);
     }
 };
@@ -125,10 +321,34 @@ public:
 // Global logger instance
 extern Logger<String>* gameLogger;
 
-// Helper macros for easier logging
-#define LOG_INFO(msg) if(gameLogger) gameLogger->info(msg)
-#define LOG_WARNING(msg) if(gameLogger) gameLogger->warning(msg)
-#define LOG_ERROR(msg) if(gameLogger) gameLogger->error(msg)
-#define LOG_DEBUG(msg) if(gameLogger) gameLogger->debug(msg)
+// Helper macros for easier logging. The message expression is only evaluated
+// once the runtime level check passes, so callers can build it inline.
+#define LOG_AT(level, msg) \
+    do { \
+        if(gameLogger && gameLogger->isEnabled(level)) gameLogger->log(level, msg); \
+    } while(0)
+// sizeof keeps the message type-checked (and its variables "used") without evaluating it
+#define LOG_DISABLED(msg) do { (void)sizeof(msg); } while(0)
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(msg) LOG_AT(LogLevel::DEBUG, msg)
+#else
+#define LOG_DEBUG(msg) LOG_DISABLED(msg)
+#endif
+#if LOG_MIN_LEVEL <= LOG_LEVEL_INFO
+#define LOG_INFO(msg) LOG_AT(LogLevel::INFO, msg)
+#else
+#define LOG_INFO(msg) LOG_DISABLED(msg)
+#endif
+#if LOG_MIN_LEVEL <= LOG_LEVEL_WARNING
+#define LOG_WARNING(msg) LOG_AT(LogLevel::WARNING, msg)
+#else
+#define LOG_WARNING(msg) LOG_DISABLED(msg)
+#endif
+#if LOG_MIN_LEVEL <= LOG_LEVEL_ERROR
+#define LOG_ERROR(msg) LOG_AT(LogLevel::ERROR, msg)
+#else
+#define LOG_ERROR(msg) LOG_DISABLED(msg)
+#endif
 
 #endif
\ No newline at end of file
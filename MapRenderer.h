@@ -0,0 +1,244 @@
+#ifndef MAP_RENDERER_H
+#define MAP_RENDERER_H
+
+#include "Dungeon.h"
+#include <ostream>
+#include <vector>
+#include <algorithm>
+using namespace std;
+
+// Draws the dungeon map, optionally limited to a window around the player.
+//
+// Text mode prints the window once, like Dungeon::displayMap. Live mode pins the map to
+// the top of an ANSI terminal (game text scrolls underneath it) and keeps the last frame,
+// so after each command only cells the dungeon marked dirty are re-read and only the ones
+// that actually changed are sent, as cursor moves plus the new symbols.
+class MapRenderer {
+private:
+    static const int HEADER_ROWS = 2; // Title, column numbers
+    static const int LABEL_COLS = 2;  // Row number and a space
+
+    struct View {
+        int x, y, width, height;
+
+        bool operator==(const View& other) const {
+            return x == other.x && y == other.y && width == other.width && height == other.height;
+        }
+    };
+
+    int radius;          // Window reaches this far from the player; 0 = whole map
+    bool live;
+    bool pinned;         // Screen is cleared and the scroll region set for the current size
+    bool frameValid;     // front matches what is on screen
+    View view;           // Window of the pinned frame
+    vector<char> front;  // Symbols on screen, view.width * view.height
+    vector<int> changed; // Scratch list of frame indices to send
+
+    static char symbolAt(const Dungeon& dungeon, int x, int y) {
+        const Character* player = dungeon.getPlayer();
+        if(player && player->getX() == x && player->getY() == y) return 'P';
+        return dungeon.getMapSymbol(x, y);
+    }
+
+    static int clampOrigin(int wanted, int size, int total) {
+        if(wanted + size > total) wanted = total - size;
+        return wanted < 0 ? 0 : wanted;
+    }
+
+    // Window centred on the player
+    View centredView(const Dungeon& dungeon) const {
+        View v;
+        v.width = dungeon.getWidth();
+        v.height = dungeon.getHeight();
+        v.x = 0;
+        v.y = 0;
+        const Character* player = dungeon.getPlayer();
+        if(radius > 0 && player) {
+            v.width = min(v.width, 2 * radius + 1);
+            v.height = min(v.height, 2 * radius + 1);
+            v.x = clampOrigin(player->getX() - radius, v.width, dungeon.getWidth());
+            v.y = clampOrigin(player->getY() - radius, v.height, dungeon.getHeight());
+        }
+        return v;
+    }
+
+    // Keeps the pinned window still until the player walks into its outer margin,
+    // so moving around does not redraw the whole window every step
+    View liveView(const Dungeon& dungeon) const {
+        View centred = centredView(dungeon);
+        const Character* player = dungeon.getPlayer();
+        if(!frameValid || !player || centred.width != view.width || centred.height != view.height) {
+            return centred;
+        }
+        int marginX = view.width / 4;
+        int marginY = view.height / 4;
+        int px = player->getX() - view.x;
+        int py = player->getY() - view.y;
+        bool nearEdgeX = (px < marginX && view.x > 0) ||
+                         (px >= view.width - marginX && view.x + view.width < dungeon.getWidth());
+        bool nearEdgeY = (py < marginY && view.y > 0) ||
+                         (py >= view.height - marginY && view.y + view.height < dungeon.getHeight());
+        return (nearEdgeX || nearEdgeY) ? centred : view;
+    }
+
+    static void moveCursor(ostream& out, int row, int column) {
+        out << "\x1b[" << row << ';' << column << 'H';
+    }
+
+    void writeHeader(const Dungeon& dungeon, const View& v, ostream& out) const {
+        out << "=== " << dungeon.getName() << " Map";
+        if(v.width != dungeon.getWidth() || v.height != dungeon.getHeight()) {
+            out << " (" << v.x << "-" << v.x + v.width - 1 << ", " << v.y << "-" << v.y + v.height - 1 << ")";
+        }
+        out << " ===";
+    }
+
+    void writeColumnNumbers(const View& v, ostream& out) const {
+        out << "  ";
+        for(int j = 0; j < v.width; j++) {
+            out << (v.x + j) % 10;
+        }
+    }
+
+    // Redraws the whole pinned area. A new layout clears the screen and sets the scroll region
+    void drawPinned(Dungeon& dungeon, const View& v, ostream& out) {
+        bool newLayout = !pinned || v.width != view.width || v.height != view.height;
+        view = v;
+        front.resize(view.width * view.height);
+
+        if(newLayout) {
+            out << "\x1b[r\x1b[2J";
+        } else {
+            out << "\x1b" "7";
+        }
+        moveCursor(out, 1, 1);
+        writeHeader(dungeon, view, out);
+        out << "\x1b[K\r\n";
+        writeColumnNumbers(view, out);
+        out << "\x1b[K";
+        for(int i = 0; i < view.height; i++) {
+            out << "\r\n" << (view.y + i) % 10 << ' ';
+            char* row = &front[i * view.width];
+            for(int j = 0; j < view.width; j++) {
+                row[j] = symbolAt(dungeon, view.x + j, view.y + i);
+            }
+            out.write(row, view.width);
+            out << "\x1b[K";
+        }
+
+        if(newLayout) {
+            // Text scrolls below the map and a blank separator line
+            out << "\x1b[" << HEADER_ROWS + view.height + 2 << 'r';
+            moveCursor(out, 999, 1);
+        } else {
+            out << "\x1b" "8";
+        }
+        pinned = true;
+        frameValid = true;
+        dungeon.clearDirty();
+    }
+
+public:
+    MapRenderer() : radius(0), live(false), pinned(false), frameValid(false) {
+        view.x = view.y = view.width = view.height = 0;
+    }
+
+    // 0 shows the whole map
+    void setViewRadius(int cells) {
+        radius = cells > 0 ? cells : 0;
+        frameValid = false;
+    }
+
+    int getViewRadius() const { return radius; }
+    bool isLive() const { return live; }
+
+    // Forget the frame on screen (new game, loaded game, cleared terminal)
+    void invalidate() {
+        frameValid = false;
+    }
+
+    // Prints the window around the player as plain text
+    void renderText(const Dungeon& dungeon, ostream& out) const {
+        View v = centredView(dungeon);
+        out << "\n";
+        writeHeader(dungeon, v, out);
+        out << "\n";
+        out << "Legend: S=Start, E=Exit, R=Room, T=Treasure, L=Lair, M=Monster, I=Item, .=Corridor, #=Wall, ?=Unexplored, P=You\n";
+        if(const Character* player = dungeon.getPlayer()) {
+            out << "Player position: (" << player->getX() << ", " << player->getY() << ")\n";
+        }
+        out << "\n";
+        writeColumnNumbers(v, out);
+        out << "\n";
+        string row(v.width, ' ');
+        for(int i = 0; i < v.height; i++) {
+            for(int j = 0; j < v.width; j++) {
+                row[j] = symbolAt(dungeon, v.x + j, v.y + i);
+            }
+            out << (v.y + i) % 10 << ' ' << row << "\n";
+        }
+        out << "\n";
+    }
+
+    void startLive(Dungeon& dungeon, ostream& out) {
+        live = true;
+        pinned = false;
+        frameValid = false;
+        drawPinned(dungeon, centredView(dungeon), out);
+    }
+
+    // Releases the top of the screen back to normal scrolling
+    void stopLive(ostream& out) {
+        if(!live) return;
+        live = false;
+        pinned = false;
+        frameValid = false;
+        out << "\x1b[r";
+        moveCursor(out, 999, 1);
+        out << "\n";
+    }
+
+    // Sends what changed since the last frame; nothing at all when nothing did
+    void update(Dungeon& dungeon, ostream& out) {
+        if(!live) return;
+        View v = liveView(dungeon);
+        if(!frameValid || !(v == view)) {
+            drawPinned(dungeon, v, out);
+            return;
+        }
+
+        changed.clear();
+        int mapWidth = dungeon.getWidth();
+        for(int cell : dungeon.getDirtyCells()) {
+            int x = cell % mapWidth - view.x;
+            int y = cell / mapWidth - view.y;
+            if(x < 0 || y < 0 || x >= view.width || y >= view.height) continue;
+            int index = y * view.width + x;
+            char symbol = symbolAt(dungeon, view.x + x, view.y + y);
+            if(front[index] != symbol) {
+                front[index] = symbol;
+                changed.push_back(index);
+            }
+        }
+        dungeon.clearDirty();
+        if(changed.empty()) return;
+
+        // One cursor move per run of adjacent changed cells in a row
+        sort(changed.begin(), changed.end());
+        out << "\x1b" "7";
+        for(size_t i = 0; i < changed.size();) {
+            int start = changed[i];
+            size_t end = i + 1;
+            while(end < changed.size() && changed[end] == changed[end - 1] + 1 &&
+                  changed[end] % view.width != 0) {
+                end++;
+            }
+            moveCursor(out, HEADER_ROWS + 1 + start / view.width, LABEL_COLS + 1 + start % view.width);
+            out.write(&front[start], (streamsize)(end - i));
+            i = end;
+        }
+        out << "\x1b" "8";
+    }
+};
+
+#endif
@@ -2,6 +2,7 @@
 #define MONSTER_H
 
 #include "Entity.h"
+#include "CombatRules.h"
 #include "String.h"
 #include <vector>
 
@@ -39,31 +40,30 @@ public:
     
     // Override virtual functions
     virtual void display() const override {
-        cout << "Monster: " << name << " (HP: " << health << "/" << maxHealth 
-             << ", ATK: " << attack << ", DEF: " << defense << ")" << endl;
+        gameOutput << "Monster: " << name << " (HP: " << health << "/" << maxHealth 
+                   << ", ATK: " << attack << ", DEF: " << defense << ")\n";
         if (weakness != "None") {
-            cout << "Weakness: " << weakness << endl;
+            gameOutput << "Weakness: " << weakness << "\n";
         }
     }
     
     virtual bool interact() override {
         if (isDefeated) {
-            cout << name << " has already been defeated." << endl;
+            gameOutput << name << " has already been defeated.\n";
             return false;
         }
-        cout << "You encounter " << name << "! Prepare for battle!" << endl;
+        gameOutput << "You encounter " << name << "! Prepare for battle!\n";
         return true;
     }
     
     // Combat methods
     void takeDamage(int damage) {
-        int actualDamage = damage - defense;
-        if (actualDamage < 0) actualDamage = 0;
-        health -= actualDamage;
+        int actualDamage = CombatRules::absorb(damage, defense);
+        assign(health, health - actualDamage, StateHash::HEALTH);
         if (health <= 0) {
-            health = 0;
-            isDefeated = true;
-            cout << name << " has been defeated!" << endl;
+            assign(health, 0, StateHash::HEALTH);
+            assign(isDefeated, true, StateHash::DEFEATED);
+            gameOutput << name << " has been defeated!\n";
         }
     }
     
@@ -86,64 +86,65 @@ public:
     const vector<int>& getRequiredItems() const { return requiredItems; }
     
     // Setters
-    void setHealth(int hp) { health = hp; }
-    void setDefeated(bool defeated) { isDefeated = defeated; }
-    void addRequiredItem(int itemId) { requiredItems.push_back(itemId); }
+    void setHealth(int hp) { assign(health, hp, StateHash::HEALTH); }
+    void setDefeated(bool defeated) { assign(isDefeated, defeated, StateHash::DEFEATED); }
+    void addRequiredItem(int itemId) {
+        requiredItems.push_back(itemId);
+        if(stateHash) stateHash->change(hashSubject, StateHash::key(hashSubject, StateHash::REQUIRES, StateHash::value(itemId)));
+    }
     
     // Heal monster
     void heal(int amount) {
-        health += amount;
-        if (health > maxHealth) health = maxHealth;
+        assign(health, health + amount < maxHealth ? health + amount : maxHealth, StateHash::HEALTH);
     }
     
-    // Serialization
-    virtual void serialize(ofstream& file) const override {
-        Entity::serialize(file);
-        file.write(reinterpret_cast<const char*>(&type), sizeof(type));
-        file.write(reinterpret_cast<const char*>(&health), sizeof(health));
-        file.write(reinterpret_cast<const char*>(&maxHealth), sizeof(maxHealth));
-        file.write(reinterpret_cast<const char*>(&attack), sizeof(attack));
-        file.write(reinterpret_cast<const char*>(&defense), sizeof(defense));
-        file.write(reinterpret_cast<const char*>(&isDefeated), sizeof(isDefeated));
-        
-        int weaknessLen = weakness.size();
-        file.write(reinterpret_cast<const char*>(&weaknessLen), sizeof(weaknessLen));
-        for(int i = 0; i < weaknessLen; i++) {
-            file.write(&weakness[i], sizeof(char));
-        }
-        
-        int reqItemsSize = requiredItems.size();
-        file.write(reinterpret_cast<const char*>(&reqItemsSize), sizeof(reqItemsSize));
+    virtual uint64_t hashContribution(uint64_t subject) const override {
+        StateHash::Keys key(subject);
+        uint64_t h = Entity::hashContribution(subject) ^
+                     key(StateHash::TYPE, StateHash::value(type)) ^
+                     key(StateHash::HEALTH, StateHash::value(health)) ^
+                     key(StateHash::MAX_HEALTH, StateHash::value(maxHealth)) ^
+                     key(StateHash::ATTACK, StateHash::value(attack)) ^
+                     key(StateHash::DEFENSE, StateHash::value(defense)) ^
+                     key(StateHash::WEAKNESS, StateHash::value(weakness)) ^
+                     key(StateHash::DEFEATED, StateHash::value(isDefeated));
         for(int item : requiredItems) {
-            file.write(reinterpret_cast<const char*>(&item), sizeof(item));
+            h ^= key(StateHash::REQUIRES, StateHash::value(item));
         }
+        return h;
     }
     
-    virtual void deserialize(ifstream& file) override {
-        Entity::deserialize(file);
-        file.read(reinterpret_cast<char*>(&type), sizeof(type));
-        file.read(reinterpret_cast<char*>(&health), sizeof(health));
-        file.read(reinterpret_cast<char*>(&maxHealth), sizeof(maxHealth));
-        file.read(reinterpret_cast<char*>(&attack), sizeof(attack));
-        file.read(reinterpret_cast<char*>(&defense), sizeof(defense));
-        file.read(reinterpret_cast<char*>(&isDefeated), sizeof(isDefeated));
+    // Serialization
+    virtual void serialize(SaveWriter& out) const override {
+        Entity::serialize(out);
+        out.writeEnum(type);
+        out.writeI32(health);
+        out.writeI32(maxHealth);
+        out.writeI32(attack);
+        out.writeI32(defense);
+        out.writeBool(isDefeated);
+        out.writeString(weakness);
         
-        int weaknessLen;
-        file.read(reinterpret_cast<char*>(&weaknessLen), sizeof(weaknessLen));
-        weakness.clear();
-        for(int i = 0; i < weaknessLen; i++) {
-            char ch;
-            file.read(&ch, sizeof(char));
-            weakness.push_back(ch);
+        out.writeU32((uint32_t)requiredItems.size());
+        for(int item : requiredItems) {
+            out.writeI32(item);
         }
+    }
+    
+    virtual void deserialize(SaveReader& in) override {
+        Entity::deserialize(in);
+        type = in.readEnum(MonsterType::TROLL);
+        health = in.readI32();
+        maxHealth = in.readI32();
+        attack = in.readI32();
+        defense = in.readI32();
+        isDefeated = in.readBool();
+        weakness = in.readString();
         
-        int reqItemsSize;
-        file.read(reinterpret_cast<char*>(&reqItemsSize), sizeof(reqItemsSize));
+        int reqItemsSize = in.readCount(4);
         requiredItems.clear();
         for(int i = 0; i < reqItemsSize; i++) {
-            int item;
-            file.read(reinterpret_cast<char*>(&item), sizeof(item));
-            requiredItems.push_back(item);
+            requiredItems.push_back(in.readI32());
         }
     }
 };
@@ -0,0 +1,118 @@
+#ifndef OUTPUT_SINK_H
+#define OUTPUT_SINK_H
+
+#include <iostream>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <mutex>
+using namespace std;
+
+// Held around every console write, by game output and by log threads echoing to the
+// console alike, so a log batch never lands in the middle of a response
+inline mutex& consoleMutex() {
+    static mutex m;
+    return m;
+}
+
+// Where a finished response goes
+class OutputSink {
+public:
+    virtual ~OutputSink() {}
+
+    virtual void write(const char* data, size_t length) = 0;
+};
+
+// Writes each response to a stream and flushes it once
+class StreamSink : public OutputSink {
+private:
+    ostream& out;
+
+public:
+    StreamSink(ostream& stream) : out(stream) {}
+
+    virtual void write(const char* data, size_t length) override {
+        lock_guard<mutex> lock(consoleMutex());
+        out.write(data, length);
+        out.flush();
+    }
+};
+
+// Discards everything (headless runs)
+class NullSink : public OutputSink {
+public:
+    virtual void write(const char*, size_t) override {}
+};
+
+// Stream buffer that only appends to a string; never flushes anywhere
+class ResponseBuffer : public streambuf {
+private:
+    string text;
+
+protected:
+    virtual int_type overflow(int_type ch) override {
+        if(!traits_type::eq_int_type(ch, traits_type::eof())) {
+            text.push_back(traits_type::to_char_type(ch));
+        }
+        return traits_type::not_eof(ch);
+    }
+
+    virtual streamsize xsputn(const char* data, streamsize count) override {
+        text.append(data, (size_t)count);
+        return count;
+    }
+
+public:
+    ResponseBuffer() {
+        text.reserve(4096);
+    }
+
+    const string& str() const { return text; }
+    void clear() { text.clear(); }
+};
+
+// Game output stream. Gameplay code writes here with "\n" instead of endl; the engine
+// calls commit() once per command (and before reading input), which hands the whole
+// response to the sink in a single write and flush.
+class GameOutput : public ostream {
+private:
+    ResponseBuffer buffer;
+    OutputSink* sink;
+
+    static OutputSink& console() {
+        static StreamSink sink(cout);
+        return sink;
+    }
+
+public:
+    GameOutput() : ostream(nullptr), sink(&console()) {
+        rdbuf(&buffer);
+    }
+
+    GameOutput(const GameOutput&) = delete;
+    GameOutput& operator=(const GameOutput&) = delete;
+
+    // Null restores the console; returns the previous sink
+    OutputSink* setSink(OutputSink* newSink) {
+        OutputSink* previous = sink;
+        sink = newSink ? newSink : &console();
+        return previous;
+    }
+
+    void commit() {
+        const string& text = buffer.str();
+        if(!text.empty()) {
+            sink->write(text.data(), text.size());
+            buffer.clear();
+        }
+    }
+
+    size_t pending() const {
+        return buffer.str().size();
+    }
+};
+
+// One per thread, so game sessions on different threads keep their responses apart
+extern thread_local GameOutput gameOutput;
+
+#endif
@@ -0,0 +1,130 @@
+// Pathfinding throughput on generated maps: A* against jump point search, and the
+// cost of chasing with a flow field (one rebuild per player move, one read per monster)
+// Usage: PathBenchmark [size] [queries] [seed]
+#include "Pathfinder.h"
+#include "FlowField.h"
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+using namespace std;
+
+thread_local GameOutput gameOutput;
+
+int main(int argc, char* argv[])
+{
+    int size = argc > 1 ? atoi(argv[1]) : 1000;
+    int queries = argc > 2 ? atoi(argv[2]) : 200;
+    uint64_t seed = argc > 3 ? strtoull(argv[3], nullptr, 10) : 1;
+    if(size < 4 || queries < 1)
+    {
+        cerr << "Usage: " << argv[0] << " [size >= 4] [queries >= 1] [seed]" << endl;
+        return 1;
+    }
+
+    auto built = chrono::steady_clock::now();
+    Dungeon dungeon(size, size, "Benchmark", seed);
+    double buildSeconds = chrono::duration<double>(chrono::steady_clock::now() - built).count();
+
+    vector<GridPoint> floor;
+    for(int y = 0; y < size; y++)
+    {
+        for(int x = 0; x < size; x++)
+        {
+            if(dungeon.isAccessible(x, y))
+            {
+                floor.push_back(GridPoint{x, y});
+            }
+        }
+    }
+    printf("%dx%d map, %zu walkable cells, built in %.2f s\n", size, size, floor.size(), buildSeconds);
+
+    // The same random endpoint pairs for both methods
+    Random rng(seed);
+    vector<GridPoint> starts, goals;
+    for(int i = 0; i < queries; i++)
+    {
+        starts.push_back(floor[rng.range(0, (int)floor.size() - 1)]);
+        goals.push_back(floor[rng.range(0, (int)floor.size() - 1)]);
+    }
+
+    Pathfinder pathfinder;
+    pathfinder.sync(dungeon);
+    vector<GridPoint> path;
+    const char* names[] = {"A*", "JPS"};
+    for(int method = Pathfinder::ASTAR; method <= Pathfinder::JUMP_POINT; method++)
+    {
+        long long expanded = 0;
+        long long steps = 0;
+        int found = 0;
+        auto start = chrono::steady_clock::now();
+        for(int i = 0; i < queries; i++)
+        {
+            if(pathfinder.findPath(dungeon, starts[i].x, starts[i].y, goals[i].x, goals[i].y, path,
+                                   (Pathfinder::Method)method))
+            {
+                found++;
+                steps += path.size();
+            }
+            expanded += pathfinder.getExpandedCount();
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        printf("%-4s %10.1f queries/s  %8.1f us/query  %9lld expanded/query  %lld total steps (%d found)\n",
+               names[method], queries / seconds, seconds * 1e6 / queries, expanded / queries, steps, found);
+    }
+
+    // Flow field: the player walks a random path; each move rebuilds the field once and
+    // then every monster in range looks up its next step
+    const int MONSTERS = 5000;
+    for(int radius : {24, 64})
+    {
+        FlowField field(radius);
+        GridPoint player = floor[rng.range(0, (int)floor.size() - 1)];
+        vector<GridPoint> monsters(MONSTERS);
+        for(GridPoint& m : monsters)
+        {
+            m.x = player.x + rng.range(-radius, radius);
+            m.y = player.y + rng.range(-radius, radius);
+        }
+
+        const int MOVES = 2000;
+        double rebuildSeconds = 0;
+        double stepSeconds = 0;
+        long long steps = 0;
+        long long reachedCells = 0;
+        for(int move = 0; move < MOVES; move++)
+        {
+            static const int dx[4] = {0, 0, 1, -1};
+            static const int dy[4] = {-1, 1, 0, 0};
+            int d = rng.range(0, 3);
+            if(dungeon.isAccessible(player.x + dx[d], player.y + dy[d]))
+            {
+                player.x += dx[d];
+                player.y += dy[d];
+            }
+
+            auto rebuildStart = chrono::steady_clock::now();
+            field.update(dungeon, player.x, player.y);
+            auto stepStart = chrono::steady_clock::now();
+            for(GridPoint& m : monsters)
+            {
+                int nx, ny;
+                if(field.nextStep(m.x, m.y, nx, ny))
+                {
+                    m.x = nx;
+                    m.y = ny;
+                    steps++;
+                }
+            }
+            auto stepEnd = chrono::steady_clock::now();
+            rebuildSeconds += chrono::duration<double>(stepStart - rebuildStart).count();
+            stepSeconds += chrono::duration<double>(stepEnd - stepStart).count();
+            reachedCells += field.getReachedCells().size();
+        }
+        printf("flow radius %2d: %7.1f us/rebuild (%lld cells), %d monsters %6.1f us/tick (%.1f ns each), %lld steps\n",
+               radius, rebuildSeconds * 1e6 / MOVES, reachedCells / MOVES, MONSTERS,
+               stepSeconds * 1e6 / MOVES, stepSeconds * 1e9 / MOVES / MONSTERS, steps);
+    }
+    return 0;
+}
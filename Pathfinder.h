@@ -0,0 +1,263 @@
+#ifndef PATHFINDER_H
+#define PATHFINDER_H
+
+#include "Dungeon.h"
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <cstdlib>
+using namespace std;
+
+struct GridPoint {
+    int x, y;
+};
+
+// Shortest 4-connected paths over a dungeon (every step costs 1, blocked cells are
+// those Location::canAccess rejects).
+//
+// A* uses a binary heap and Manhattan distance. Jump point search gives the same path
+// lengths but only pushes cells where the route can bend: with vertical-first canonical
+// paths, a vertical scan tries a horizontal scan at every step, and a horizontal scan
+// stops where an obstacle behind it opens a vertical turn.
+//
+// All per-cell state lives in scratch arrays that are reused between queries; a
+// generation stamp stands in for clearing them, so a query allocates nothing once the
+// buffers have grown to the map size.
+class Pathfinder {
+public:
+    enum Method {
+        ASTAR,
+        JUMP_POINT
+    };
+
+private:
+    struct OpenEntry {
+        uint32_t f;
+        uint32_t g;
+        int cell;
+    };
+
+    int width, height;
+    uint64_t layoutVersion; // Version of the dungeon the walkable map was copied from
+    vector<uint8_t> walkable;
+    vector<uint32_t> cost;     // Best known g, valid where seen == generation
+    vector<int> parent;
+    vector<uint32_t> seen;
+    vector<uint32_t> closed;
+    uint32_t generation;
+    vector<OpenEntry> open;    // Binary min-heap on f, then larger g first
+    int goalX, goalY;
+    long long expanded;
+
+    bool isOpen(int x, int y) const {
+        return x >= 0 && y >= 0 && x < width && y < height && walkable[(size_t)y * width + x];
+    }
+
+    uint32_t heuristic(int cell) const {
+        return (uint32_t)(abs(cell % width - goalX) + abs(cell / width - goalY));
+    }
+
+    static bool before(const OpenEntry& a, const OpenEntry& b) {
+        return a.f < b.f || (a.f == b.f && a.g > b.g);
+    }
+
+    void pushOpen(OpenEntry entry) {
+        open.push_back(entry);
+        size_t i = open.size() - 1;
+        while(i > 0) {
+            size_t up = (i - 1) / 2;
+            if(!before(open[i], open[up])) break;
+            swap(open[i], open[up]);
+            i = up;
+        }
+    }
+
+    OpenEntry popOpen() {
+        OpenEntry top = open[0];
+        open[0] = open.back();
+        open.pop_back();
+        size_t i = 0;
+        for(;;) {
+            size_t left = 2 * i + 1;
+            if(left >= open.size()) break;
+            size_t best = left;
+            if(left + 1 < open.size() && before(open[left + 1], open[left])) best = left + 1;
+            if(!before(open[best], open[i])) break;
+            swap(open[i], open[best]);
+            i = best;
+        }
+        return top;
+    }
+
+    // Records a better route to cell and queues it
+    void relax(int from, int cell, uint32_t g) {
+        if(closed[cell] == generation) return;
+        if(seen[cell] == generation && cost[cell] <= g) return;
+        seen[cell] = generation;
+        cost[cell] = g;
+        parent[cell] = from;
+        pushOpen(OpenEntry{g + heuristic(cell), g, cell});
+    }
+
+    // Jump point or goal reached by scanning horizontally, or -1
+    int jumpHorizontal(int x, int y, int dx) const {
+        for(;;) {
+            x += dx;
+            if(!isOpen(x, y)) return -1;
+            if(x == goalX && y == goalY) return y * width + x;
+            if((isOpen(x, y + 1) && !isOpen(x - dx, y + 1)) ||
+               (isOpen(x, y - 1) && !isOpen(x - dx, y - 1))) {
+                return y * width + x;
+            }
+        }
+    }
+
+    int jumpVertical(int x, int y, int dy) const {
+        for(;;) {
+            y += dy;
+            if(!isOpen(x, y)) return -1;
+            if(x == goalX && y == goalY) return y * width + x;
+            if(jumpHorizontal(x, y, 1) >= 0 || jumpHorizontal(x, y, -1) >= 0) return y * width + x;
+        }
+    }
+
+    void expandAStar(int cell, uint32_t g) {
+        int x = cell % width;
+        int y = cell / width;
+        static const int dirs[4][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+        for(const auto& d : dirs) {
+            if(isOpen(x + d[0], y + d[1])) relax(cell, (y + d[1]) * width + x + d[0], g + 1);
+        }
+    }
+
+    void jumpTo(int cell, int target, uint32_t g) {
+        if(target < 0) return;
+        uint32_t distance = (uint32_t)(abs(target % width - cell % width) + abs(target / width - cell / width));
+        relax(cell, target, g + distance);
+    }
+
+    // Only the directions a canonical path can take from here
+    void expandJumpPoint(int cell, uint32_t g, int start) {
+        int x = cell % width;
+        int y = cell / width;
+        if(cell == start) {
+            jumpTo(cell, jumpHorizontal(x, y, 1), g);
+            jumpTo(cell, jumpHorizontal(x, y, -1), g);
+            jumpTo(cell, jumpVertical(x, y, 1), g);
+            jumpTo(cell, jumpVertical(x, y, -1), g);
+            return;
+        }
+        int from = parent[cell];
+        int px = from % width;
+        int py = from / width;
+        if(px == x) {
+            // Arrived vertically: keep going, or turn either way
+            int dy = y > py ? 1 : -1;
+            jumpTo(cell, jumpVertical(x, y, dy), g);
+            jumpTo(cell, jumpHorizontal(x, y, 1), g);
+            jumpTo(cell, jumpHorizontal(x, y, -1), g);
+        } else {
+            // Arrived horizontally: keep going, or turn where an obstacle forces it
+            int dx = x > px ? 1 : -1;
+            jumpTo(cell, jumpHorizontal(x, y, dx), g);
+            if(isOpen(x, y + 1) && !isOpen(x - dx, y + 1)) jumpTo(cell, jumpVertical(x, y, 1), g);
+            if(isOpen(x, y - 1) && !isOpen(x - dx, y - 1)) jumpTo(cell, jumpVertical(x, y, -1), g);
+        }
+    }
+
+    // Walks parent links back to the start, filling in the straight runs between jump points
+    void buildPath(int start, int goal, vector<GridPoint>& path) const {
+        path.clear();
+        for(int cell = goal; cell != start; cell = parent[cell]) {
+            int x = cell % width, y = cell / width;
+            int from = parent[cell];
+            int fx = from % width, fy = from / width;
+            while(x != fx || y != fy) {
+                path.push_back(GridPoint{x, y});
+                if(x != fx) x += x < fx ? 1 : -1;
+                else y += y < fy ? 1 : -1;
+            }
+        }
+        for(size_t i = 0, j = path.size(); i + 1 < j; i++, j--) {
+            swap(path[i], path[j - 1]);
+        }
+    }
+
+public:
+    Pathfinder() : width(0), height(0), layoutVersion(0), generation(0), goalX(0), goalY(0), expanded(0) {}
+
+    // Copies which cells are walkable; cheap no-op while the dungeon's layout is unchanged
+    void sync(const Dungeon& dungeon) {
+        if(dungeon.getLayoutVersion() == layoutVersion && dungeon.getWidth() == width &&
+           dungeon.getHeight() == height) {
+            return;
+        }
+        width = dungeon.getWidth();
+        height = dungeon.getHeight();
+        size_t cells = (size_t)width * height;
+        walkable.resize(cells);
+        for(int y = 0; y < height; y++) {
+            for(int x = 0; x < width; x++) {
+                walkable[(size_t)y * width + x] = dungeon.isAccessible(x, y) ? 1 : 0;
+            }
+        }
+        if(cost.size() != cells) {
+            cost.assign(cells, 0);
+            parent.assign(cells, -1);
+            seen.assign(cells, 0);
+            closed.assign(cells, 0);
+            generation = 0;
+        }
+        layoutVersion = dungeon.getLayoutVersion();
+    }
+
+    // Fills path with the cells after the start up to and including the goal.
+    // Returns false (and an empty path) when the goal cannot be reached.
+    bool findPath(const Dungeon& dungeon, int startX, int startY, int targetX, int targetY,
+                  vector<GridPoint>& path, Method method = JUMP_POINT) {
+        sync(dungeon);
+        path.clear();
+        expanded = 0;
+        if(!isOpen(startX, startY) || !isOpen(targetX, targetY)) return false;
+        if(startX == targetX && startY == targetY) return true;
+
+        if(++generation == 0) {
+            // Stamps wrapped around; old marks could look current
+            fill(seen.begin(), seen.end(), 0);
+            fill(closed.begin(), closed.end(), 0);
+            generation = 1;
+        }
+        goalX = targetX;
+        goalY = targetY;
+        int start = startY * width + startX;
+        int goal = targetY * width + targetX;
+
+        open.clear();
+        seen[start] = generation;
+        cost[start] = 0;
+        parent[start] = start;
+        pushOpen(OpenEntry{heuristic(start), 0, start});
+
+        while(!open.empty()) {
+            OpenEntry top = popOpen();
+            if(closed[top.cell] == generation || top.g != cost[top.cell]) continue; // Stale entry
+            if(top.cell == goal) {
+                buildPath(start, goal, path);
+                return true;
+            }
+            closed[top.cell] = generation;
+            expanded++;
+            if(method == JUMP_POINT) {
+                expandJumpPoint(top.cell, top.g, start);
+            } else {
+                expandAStar(top.cell, top.g);
+            }
+        }
+        return false;
+    }
+
+    // Cells taken off the open list by the last query
+    long long getExpandedCount() const { return expanded; }
+};
+
+#endif
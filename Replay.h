@@ -0,0 +1,308 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "SaveFormat.h"
+#include "Headless.h"
+#include "GameExceptions.h"
+#include "String.h"
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+using namespace std;
+
+// What a session needs besides its starting world to play out the same way again
+struct SessionSettings {
+    uint64_t seed;        // The dungeon's generator seed, which saves leave out but the world simulation draws from
+    bool living;
+    bool chase;
+    CombatPolicy policy;
+    int undoLimit;        // Commands kept for undo
+};
+
+// File layout (little-endian):
+//   header:  "DCRP" | version u16 | seed u64 | flags u8 (1 = living, 2 = chase)
+//            | combat mode u8 | flee percent u8 | resolve at once u8 | undo limit u32
+//            | start state hash u64 | snapshot length u32 | snapshot (a save file, compressed)
+//   records: kind u8, then
+//     COMMAND  length varint | the command's bytes
+//     ANSWER   u8, 1 = kept fighting (a "Continue fighting?" prompt)
+//     LOADED   found u8, then if found: length u32 | the save file's bytes (what a load read)
+//     END      commands u32 | final state hash u64
+// Everything up to a missing END is still replayable; a recording cut short just cannot
+// be verified.
+class ReplayFormat {
+public:
+    static const uint16_t VERSION = 1;
+
+    enum RecordKind : uint8_t {
+        COMMAND = 1,
+        ANSWER = 2,
+        END = 3,
+        LOADED = 4
+    };
+
+    static const char* magic() { return "DCRP"; }
+
+    static void putVarint(vector<uint8_t>& out, uint32_t v) {
+        while(v >= 0x80) {
+            out.push_back((uint8_t)(v | 0x80));
+            v >>= 7;
+        }
+        out.push_back((uint8_t)v);
+    }
+};
+
+// Appends a session to a file as it is played. The header goes out once start() has the
+// starting state; records are buffered and written in blocks; finish() writes END.
+class SessionRecorder {
+private:
+    static const size_t FLUSH_BYTES = 4096;
+
+    ofstream file;
+    vector<uint8_t> pending;
+    uint32_t commands;
+    bool started;
+    bool finished;
+
+    void flush() {
+        if(pending.empty()) return;
+        file.write(reinterpret_cast<const char*>(pending.data()), pending.size());
+        file.flush();
+        pending.clear();
+    }
+
+public:
+    // Throws FileOperationException if the file cannot be created
+    explicit SessionRecorder(const String& fileName)
+        : commands(0), started(false), finished(false) {
+        file.open(fileName.c_str(), ios::binary | ios::trunc);
+        if(!file.is_open()) {
+            throw FileOperationException("record", fileName);
+        }
+    }
+
+    // Writes the header; called once, before the first record
+    void start(const SessionSettings& settings, uint64_t startHash, const vector<uint8_t>& snapshot) {
+        started = true;
+        SaveWriter header;
+        for(int i = 0; i < 4; i++) header.writeU8((uint8_t)ReplayFormat::magic()[i]);
+        header.writeU16(ReplayFormat::VERSION);
+        header.writeU64(settings.seed);
+        header.writeU8((uint8_t)((settings.living ? 1 : 0) | (settings.chase ? 2 : 0)));
+        header.writeU8((uint8_t)settings.policy.mode);
+        header.writeU8((uint8_t)settings.policy.fleeHealthPercent);
+        header.writeBool(settings.policy.resolveAtOnce);
+        header.writeU32((uint32_t)settings.undoLimit);
+        header.writeU64(startHash);
+        header.writeU32((uint32_t)snapshot.size());
+        file.write(reinterpret_cast<const char*>(header.data().data()), header.size());
+        file.write(reinterpret_cast<const char*>(snapshot.data()), snapshot.size());
+    }
+
+    ~SessionRecorder() {
+        flush();
+    }
+
+    void command(const char* text, int length) {
+        pending.push_back(ReplayFormat::COMMAND);
+        ReplayFormat::putVarint(pending, (uint32_t)length);
+        pending.insert(pending.end(), text, text + length);
+        commands++;
+        if(pending.size() >= FLUSH_BYTES) flush();
+    }
+
+    void answer(bool keepFighting) {
+        pending.push_back(ReplayFormat::ANSWER);
+        pending.push_back(keepFighting ? 1 : 0);
+    }
+
+    // The file a load command read, or nullptr if there was none, so a replay never
+    // depends on what the save file holds by then
+    void loaded(const string* fileBytes) {
+        pending.push_back(ReplayFormat::LOADED);
+        pending.push_back(fileBytes ? 1 : 0);
+        if(fileBytes) {
+            uint32_t length = (uint32_t)fileBytes->size();
+            for(int i = 0; i < 4; i++) pending.push_back((uint8_t)(length >> (8 * i)));
+            pending.insert(pending.end(), fileBytes->begin(), fileBytes->end());
+        }
+        if(pending.size() >= FLUSH_BYTES) flush();
+    }
+
+    void finish(uint64_t finalHash) {
+        if(finished) return;
+        finished = true;
+        pending.push_back(ReplayFormat::END);
+        for(int i = 0; i < 4; i++) pending.push_back((uint8_t)(commands >> (8 * i)));
+        for(int i = 0; i < 8; i++) pending.push_back((uint8_t)(finalHash >> (8 * i)));
+        flush();
+    }
+
+    bool isStarted() const { return started; }
+    uint32_t getCommandCount() const { return commands; }
+};
+
+// A recording read back into memory: command texts packed into one buffer, the
+// prompt answers in the order they were given, and the files loads read
+class SessionLog {
+public:
+    struct Command {
+        uint32_t offset, length;
+    };
+
+    struct LoadedFile {
+        bool found;
+        uint32_t offset, length; // Into loadedBytes
+    };
+
+    SessionSettings settings;
+    uint64_t startHash;
+    vector<uint8_t> snapshot;
+    vector<char> text;
+    vector<Command> commands;
+    vector<uint8_t> answers;
+    vector<char> loadedBytes;
+    vector<LoadedFile> loads;
+    bool complete;        // END was read
+    uint64_t finalHash;
+
+    // Throws FileOperationException or SaveLoadException
+    static SessionLog read(const String& fileName) {
+        ifstream file(fileName.c_str(), ios::binary);
+        if(!file.is_open()) {
+            throw FileOperationException("replay", fileName);
+        }
+        vector<uint8_t> bytes((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+        if(bytes.size() < 4 || memcmp(bytes.data(), ReplayFormat::magic(), 4) != 0) {
+            throw SaveLoadException("not a session recording");
+        }
+
+        // The fixed part goes through the bounds-checked save reader
+        vector<uint8_t> rest(bytes.begin() + 4, bytes.end());
+        SaveReader in(rest, 1);
+        SessionLog log;
+        uint16_t version = in.readU16();
+        if(version == 0 || version > ReplayFormat::VERSION) {
+            throw SaveLoadException("unsupported recording version");
+        }
+        log.settings.seed = in.readU64();
+        uint8_t flags = in.readU8();
+        log.settings.living = (flags & 1) != 0;
+        log.settings.chase = (flags & 2) != 0;
+        log.settings.policy.mode = in.readEnum(CombatPolicy::FLEE_BELOW);
+        log.settings.policy.fleeHealthPercent = in.readU8();
+        log.settings.policy.resolveAtOnce = in.readBool();
+        uint32_t undoLimit = in.readU32();
+        if(undoLimit > 0x7FFFFFFFu) {
+            throw SaveLoadException("undo limit out of range");
+        }
+        log.settings.undoLimit = (int)undoLimit;
+        log.startHash = in.readU64();
+        int snapshotSize = in.readCount(1);
+        log.snapshot.resize(snapshotSize);
+        for(int i = 0; i < snapshotSize; i++) log.snapshot[i] = in.readU8();
+
+        log.complete = false;
+        log.finalHash = 0;
+        const uint8_t* p = rest.data() + (rest.size() - in.remaining());
+        const uint8_t* end = rest.data() + rest.size();
+        while(p < end && !log.complete) {
+            uint8_t kind = *p++;
+            if(kind == ReplayFormat::COMMAND) {
+                uint32_t length = 0;
+                int shift = 0;
+                while(p < end && shift < 32) {
+                    uint8_t b = *p++;
+                    length |= (uint32_t)(b & 0x7F) << shift;
+                    shift += 7;
+                    if(!(b & 0x80)) break;
+                }
+                if((size_t)(end - p) < length) break; // Cut off mid-record
+                log.commands.push_back(Command{(uint32_t)log.text.size(), length});
+                log.text.insert(log.text.end(), p, p + length);
+                p += length;
+            } else if(kind == ReplayFormat::ANSWER && p < end) {
+                log.answers.push_back(*p++);
+            } else if(kind == ReplayFormat::LOADED && p < end) {
+                LoadedFile loaded = LoadedFile{*p++ != 0, (uint32_t)log.loadedBytes.size(), 0};
+                if(loaded.found) {
+                    if(end - p < 4) break;
+                    for(int i = 0; i < 4; i++) loaded.length |= (uint32_t)p[i] << (8 * i);
+                    p += 4;
+                    if((size_t)(end - p) < loaded.length) break; // Cut off mid-record
+                    log.loadedBytes.insert(log.loadedBytes.end(), p, p + loaded.length);
+                    p += loaded.length;
+                }
+                log.loads.push_back(loaded);
+            } else if(kind == ReplayFormat::END && end - p >= 12) {
+                uint32_t count = 0;
+                for(int i = 0; i < 4; i++) count |= (uint32_t)p[i] << (8 * i);
+                for(int i = 0; i < 8; i++) log.finalHash |= (uint64_t)p[4 + i] << (8 * i);
+                if(count != log.commands.size()) {
+                    throw SaveLoadException("recording command count does not match");
+                }
+                log.complete = true;
+            } else if(kind != ReplayFormat::ANSWER && kind != ReplayFormat::END && kind != ReplayFormat::LOADED) {
+                throw SaveLoadException("unknown record in recording");
+            } else {
+                break;
+            }
+        }
+        return log;
+    }
+
+    const char* commandText(size_t i) const { return text.data() + commands[i].offset; }
+    int commandLength(size_t i) const { return (int)commands[i].length; }
+};
+
+// What a replay measured
+struct ReplayReport {
+    vector<double> commandSeconds; // Parallel to SessionLog::commands; shorter if the game ended early
+    double seconds;
+    bool verified;     // A final hash was compared
+    bool matched;
+    uint64_t expectedHash;
+    uint64_t actualHash;
+};
+
+// Per-command timing summary plus the slowest commands with their text
+inline void printReplayReport(ostream& out, const ReplayReport& report, const SessionLog& log, int slowest = 5) {
+    size_t count = report.commandSeconds.size();
+    out << count << " of " << log.commands.size() << " commands replayed in " << report.seconds << " s";
+    if(report.seconds > 0) out << " (" << (long long)(count / report.seconds) << " commands/s)";
+    out << "\n";
+    if(count > 0) {
+        vector<double> sorted(report.commandSeconds);
+        sort(sorted.begin(), sorted.end());
+        double total = 0;
+        for(double s : sorted) total += s;
+        out << "Per command (us): mean " << total / count * 1e6
+            << ", p50 " << sorted[count / 2] * 1e6
+            << ", p90 " << sorted[count * 9 / 10] * 1e6
+            << ", p99 " << sorted[count * 99 / 100] * 1e6
+            << ", max " << sorted[count - 1] * 1e6 << "\n";
+
+        vector<size_t> order(count);
+        for(size_t i = 0; i < count; i++) order[i] = i;
+        size_t shown = min(count, (size_t)slowest);
+        partial_sort(order.begin(), order.begin() + shown, order.end(), [&report](size_t a, size_t b) {
+            return report.commandSeconds[a] > report.commandSeconds[b];
+        });
+        out << "Slowest:\n";
+        for(size_t i = 0; i < shown; i++) {
+            size_t c = order[i];
+            out << "  #" << c + 1 << "  " << report.commandSeconds[c] * 1e6 << " us  ";
+            out.write(log.commandText(c), log.commandLength(c));
+            out << "\n";
+        }
+    }
+    if(report.verified) {
+        out << "Final state " << (report.matched ? "matches" : "DIFFERS from") << " the recording (hash "
+            << hex << report.actualHash << ", recorded " << report.expectedHash << dec << ")\n";
+    }
+}
+
+#endif
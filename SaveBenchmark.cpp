@@ -0,0 +1,180 @@
+// Save and load throughput on a generated map, compressed against uncompressed, in memory.
+// A save is serializing into the section format, plus the block compressor for a compressed
+// one; a load is parsing the sections and deserializing a fresh hero and dungeon, plus
+// inflating first for a compressed one. Each is timed over several rounds and reported as
+// MB/s of raw state at the median round, with the stages on their own, the compression ratio
+// and CRC32C speed. Every round checks the inflated bytes against the original and that both
+// loads give back a world with the original's state hash.
+// Usage: SaveBenchmark [size] [rounds] [seed]
+#include "Dungeon.h"
+#include "Character.h"
+#include "SaveFormat.h"
+#include "SaveCompression.h"
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+using namespace std;
+
+thread_local GameOutput gameOutput;
+
+static double median(vector<double> seconds)
+{
+    sort(seconds.begin(), seconds.end());
+    return seconds[seconds.size() / 2];
+}
+
+static double megabytesPerSecond(size_t bytes, double seconds)
+{
+    return seconds > 0 ? bytes / (1024.0 * 1024.0) / seconds : 0.0;
+}
+
+static string serializeGame(const Character& hero, const Dungeon& dungeon)
+{
+    vector<SaveSchema::Section> sections(2);
+    SaveWriter heroOut;
+    hero.serialize(heroOut);
+    sections[0].id = SaveSchema::SECTION_PLAYER;
+    sections[0].payload = heroOut.release();
+    SaveWriter worldOut;
+    dungeon.serialize(worldOut);
+    sections[1].id = SaveSchema::SECTION_DUNGEON;
+    sections[1].payload = worldOut.release();
+    ostringstream out;
+    SaveSchema::write(out, sections);
+    return out.str();
+}
+
+static void deserializeGame(istream& in, Character& hero, Dungeon& dungeon)
+{
+    uint16_t version;
+    vector<SaveSchema::Section> sections = SaveSchema::read(in, version);
+    SaveReader heroIn(SaveSchema::require(sections, SaveSchema::SECTION_PLAYER).payload, version);
+    hero.deserialize(heroIn);
+    SaveReader worldIn(SaveSchema::require(sections, SaveSchema::SECTION_DUNGEON).payload, version);
+    dungeon.deserialize(worldIn);
+}
+
+// Whether a loaded world hashes the same as the one that was saved
+static bool sameState(Character& hero, Dungeon& dungeon, uint64_t expected)
+{
+    dungeon.setPlayer(&hero);
+    bool same = dungeon.getStateHash() == expected;
+    dungeon.setPlayer(nullptr);
+    return same;
+}
+
+int main(int argc, char* argv[])
+{
+    int size = argc > 1 ? atoi(argv[1]) : 512;
+    int rounds = argc > 2 ? atoi(argv[2]) : 9;
+    uint64_t seed = argc > 3 ? strtoull(argv[3], nullptr, 10) : 1;
+    if(size < 16 || rounds < 1)
+    {
+        cerr << "Usage: " << argv[0] << " [size >= 16] [rounds >= 1] [seed]" << endl;
+        return 1;
+    }
+
+    NullSink discard;
+    gameOutput.setSink(&discard);
+    Dungeon dungeon(size, size, "Benchmark", seed);
+    Character hero("Hero", dungeon.getEntranceX(), dungeon.getEntranceY(), 1);
+    dungeon.setPlayer(&hero);
+
+    uint64_t expected = dungeon.getStateHash();
+
+    string raw;
+    string packed;
+    vector<double> serializeSeconds, compressSeconds, inflateSeconds, crcSeconds;
+    vector<double> packedSaveSeconds, rawLoadSeconds, packedLoadSeconds;
+    int mismatches = 0;
+    int badLoads = 0;
+    for(int round = 0; round < rounds; round++)
+    {
+        auto start = chrono::steady_clock::now();
+        raw = serializeGame(hero, dungeon);
+        serializeSeconds.push_back(chrono::duration<double>(chrono::steady_clock::now() - start).count());
+
+        ostringstream out;
+        start = chrono::steady_clock::now();
+        {
+            CompressedOutBuf packer(out);
+            ostream packing(&packer);
+            packing.write(raw.data(), raw.size());
+            packer.finish();
+        }
+        compressSeconds.push_back(chrono::duration<double>(chrono::steady_clock::now() - start).count());
+        packedSaveSeconds.push_back(serializeSeconds.back() + compressSeconds.back());
+        packed = out.str();
+
+        istringstream in(packed);
+        string inflated(raw.size(), '\0');
+        start = chrono::steady_clock::now();
+        bool intact = SaveContainer::detect(in);
+        if(intact)
+        {
+            CompressedInBuf unpacker(in);
+            istream unpacking(&unpacker);
+            unpacking.read(&inflated[0], inflated.size());
+            intact = (size_t)unpacking.gcount() == raw.size() && !unpacker.isCorrupt();
+        }
+        inflateSeconds.push_back(chrono::duration<double>(chrono::steady_clock::now() - start).count());
+        if(!intact || inflated != raw) mismatches++;
+
+        {
+            Character loadedHero;
+            Dungeon loaded;
+            istringstream rawIn(raw);
+            start = chrono::steady_clock::now();
+            deserializeGame(rawIn, loadedHero, loaded);
+            rawLoadSeconds.push_back(chrono::duration<double>(chrono::steady_clock::now() - start).count());
+            if(!sameState(loadedHero, loaded, expected)) badLoads++;
+        }
+
+        {
+            Character loadedHero;
+            Dungeon loaded;
+            istringstream packedIn(packed);
+            start = chrono::steady_clock::now();
+            bool readable = SaveContainer::detect(packedIn);
+            if(readable)
+            {
+                CompressedInBuf unpacker(packedIn);
+                istream unpacking(&unpacker);
+                deserializeGame(unpacking, loadedHero, loaded);
+                readable = !unpacker.isCorrupt();
+            }
+            packedLoadSeconds.push_back(chrono::duration<double>(chrono::steady_clock::now() - start).count());
+            if(!readable || !sameState(loadedHero, loaded, expected)) badLoads++;
+        }
+
+        start = chrono::steady_clock::now();
+        volatile uint32_t crc = Crc32c::compute(reinterpret_cast<const uint8_t*>(raw.data()), raw.size());
+        (void)crc;
+        crcSeconds.push_back(chrono::duration<double>(chrono::steady_clock::now() - start).count());
+    }
+
+    printf("%dx%d map, %d items, %d monsters, %d rounds\n", size, size, dungeon.getAllItems().size(),
+           dungeon.getAllMonsters().size(), rounds);
+    printf("Save state: %.2f MB raw, %.2f MB compressed (%.2fx)\n", raw.size() / (1024.0 * 1024.0),
+           packed.size() / (1024.0 * 1024.0), packed.empty() ? 0.0 : (double)raw.size() / packed.size());
+    printf("               save MB/s   load MB/s\n");
+    printf("Uncompressed  %10.1f  %10.1f\n", megabytesPerSecond(raw.size(), median(serializeSeconds)),
+           megabytesPerSecond(raw.size(), median(rawLoadSeconds)));
+    printf("Compressed    %10.1f  %10.1f\n", megabytesPerSecond(raw.size(), median(packedSaveSeconds)),
+           megabytesPerSecond(raw.size(), median(packedLoadSeconds)));
+    printf("Serialize  %8.1f MB/s\n", megabytesPerSecond(raw.size(), median(serializeSeconds)));
+    printf("Compress   %8.1f MB/s\n", megabytesPerSecond(raw.size(), median(compressSeconds)));
+    printf("Inflate    %8.1f MB/s\n", megabytesPerSecond(raw.size(), median(inflateSeconds)));
+    printf("CRC32C     %8.1f MB/s (%s)\n", megabytesPerSecond(raw.size(), median(crcSeconds)),
+           Crc32c::hardwareAccelerated() ? "hardware" : "software");
+    printf("%s\n", mismatches ? "INFLATED BYTES DIFFER" : "every round inflates to the original bytes");
+    printf("%s\n", badLoads ? "A LOADED WORLD DIFFERS" : "every load gives back the saved world");
+    dungeon.setPlayer(nullptr); // The hero is destroyed first
+    gameOutput.setSink(nullptr);
+    return mismatches || badLoads ? 1 : 0;
+}
@@ -0,0 +1,384 @@
+#ifndef SAVE_COMPRESSION_H
+#define SAVE_COMPRESSION_H
+
+#include <iostream>
+#include <streambuf>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+using namespace std;
+
+// LZ4-style block codec (same sequence layout as the LZ4 block format)
+class BlockCodec {
+private:
+    static const int MIN_MATCH = 4;
+    static const int LAST_LITERALS = 5;   // Last bytes of a block are always literals
+    static const int MF_LIMIT = 12;       // No match may start this close to the end
+    static const int HASH_BITS = 14;
+    static const int MAX_OFFSET = 65535;
+
+    static uint32_t read32(const uint8_t* p) {
+        uint32_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    static int hashOf(uint32_t seq) {
+        return (int)((seq * 2654435761u) >> (32 - HASH_BITS));
+    }
+
+    // Writes a 4-bit length field overflow as a run of 255-bytes
+    static bool writeLength(uint8_t*& op, const uint8_t* opEnd, int len) {
+        while(len >= 255) {
+            if(op >= opEnd) return false;
+            *op++ = 255;
+            len -= 255;
+        }
+        if(op >= opEnd) return false;
+        *op++ = (uint8_t)len;
+        return true;
+    }
+
+    static bool emitSequence(uint8_t*& op, const uint8_t* opEnd, const uint8_t* literals,
+                             int literalLen, int offset, int matchLen) {
+        if(op >= opEnd) return false;
+        uint8_t* token = op++;
+        int matchCode = matchLen - MIN_MATCH;
+
+        *token = (uint8_t)((literalLen >= 15 ? 15 : literalLen) << 4);
+        if(literalLen >= 15 && !writeLength(op, opEnd, literalLen - 15)) return false;
+        if(op + literalLen > opEnd) return false;
+        memcpy(op, literals, literalLen);
+        op += literalLen;
+
+        if(matchLen == 0) return true; // Final literal-only sequence
+
+        if(op + 2 > opEnd) return false;
+        *op++ = (uint8_t)(offset & 0xFF);
+        *op++ = (uint8_t)(offset >> 8);
+        *token |= (uint8_t)(matchCode >= 15 ? 15 : matchCode);
+        if(matchCode >= 15 && !writeLength(op, opEnd, matchCode - 15)) return false;
+        return true;
+    }
+
+public:
+    static int maxCompressedSize(int srcLen) {
+        return srcLen + srcLen / 255 + 16;
+    }
+
+    // Returns compressed size, or -1 if the output would not fit in dstCap
+    static int compress(const uint8_t* src, int srcLen, uint8_t* dst, int dstCap) {
+        int table[1 << HASH_BITS];
+        for(int i = 0; i < (1 << HASH_BITS); i++) table[i] = -1;
+
+        uint8_t* op = dst;
+        const uint8_t* opEnd = dst + dstCap;
+        int anchor = 0;
+        int ip = 0;
+        const int matchLimit = srcLen - LAST_LITERALS;
+        const int inputLimit = srcLen - MF_LIMIT;
+
+        while(ip < inputLimit) {
+            uint32_t seq = read32(src + ip);
+            int h = hashOf(seq);
+            int ref = table[h];
+            table[h] = ip;
+
+            if(ref < 0 || ip - ref > MAX_OFFSET || read32(src + ref) != seq) {
+                // Skip faster through incompressible runs
+                ip += 1 + ((ip - anchor) >> 6);
+                continue;
+            }
+
+            int matchLen = MIN_MATCH;
+            while(ip + matchLen < matchLimit && src[ref + matchLen] == src[ip + matchLen]) {
+                matchLen++;
+            }
+
+            if(!emitSequence(op, opEnd, src + anchor, ip - anchor, ip - ref, matchLen)) return -1;
+            ip += matchLen;
+            anchor = ip;
+        }
+
+        if(!emitSequence(op, opEnd, src + anchor, srcLen - anchor, 0, 0)) return -1;
+        return (int)(op - dst);
+    }
+
+    // Returns decompressed size, or -1 if the input is malformed
+    static int decompress(const uint8_t* src, int srcLen, uint8_t* dst, int dstCap) {
+        const uint8_t* ip = src;
+        const uint8_t* ipEnd = src + srcLen;
+        uint8_t* op = dst;
+        uint8_t* opEnd = dst + dstCap;
+
+        while(ip < ipEnd) {
+            int token = *ip++;
+
+            int literalLen = token >> 4;
+            if(literalLen == 15) {
+                int b;
+                do {
+                    if(ip >= ipEnd) return -1;
+                    b = *ip++;
+                    literalLen += b;
+                } while(b == 255);
+            }
+            if(ip + literalLen > ipEnd || op + literalLen > opEnd) return -1;
+            memcpy(op, ip, literalLen);
+            ip += literalLen;
+            op += literalLen;
+
+            if(ip == ipEnd) break; // Final literal-only sequence
+
+            if(ip + 2 > ipEnd) return -1;
+            int offset = ip[0] | (ip[1] << 8);
+            ip += 2;
+            if(offset == 0 || offset > op - dst) return -1;
+
+            int matchLen = token & 15;
+            if(matchLen == 15) {
+                int b;
+                do {
+                    if(ip >= ipEnd) return -1;
+                    b = *ip++;
+                    matchLen += b;
+                } while(b == 255);
+            }
+            matchLen += MIN_MATCH;
+            if(op + matchLen > opEnd) return -1;
+
+            // Byte copy so overlapping matches replicate correctly
+            const uint8_t* match = op - offset;
+            for(int i = 0; i < matchLen; i++) {
+                op[i] = match[i];
+            }
+            op += matchLen;
+        }
+        return (int)(op - dst);
+    }
+};
+
+// Adler-32 checksum used to validate every block
+inline uint32_t adler32(const uint8_t* data, int len) {
+    uint32_t a = 1, b = 0;
+    while(len > 0) {
+        int chunk = len < 5552 ? len : 5552; // Largest run without 32-bit overflow
+        len -= chunk;
+        while(chunk--) {
+            a += *data++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return (b << 16) | a;
+}
+
+// Container layout:
+//   "DCZ1" | blockSize u32
+//   per block: rawLen u32 | storedLen u32 (bit 31 = stored uncompressed) | adler32(raw) u32 | payload
+//   terminator: rawLen == 0
+class SaveContainer {
+public:
+    static const int BLOCK_SIZE = 64 * 1024;
+    static const uint32_t STORED_RAW = 0x80000000u;
+
+    static const char* magic() { return "DCZ1"; }
+
+    static void putU32(uint8_t* p, uint32_t v) {
+        p[0] = (uint8_t)v;
+        p[1] = (uint8_t)(v >> 8);
+        p[2] = (uint8_t)(v >> 16);
+        p[3] = (uint8_t)(v >> 24);
+    }
+
+    static uint32_t getU32(const uint8_t* p) {
+        return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+
+    // Checks for the container magic and rewinds if it is not there
+    static bool detect(istream& in) {
+        char head[4];
+        streampos start = in.tellg();
+        in.read(head, 4);
+        if(in.gcount() == 4 && memcmp(head, magic(), 4) == 0) {
+            return true;
+        }
+        in.clear();
+        in.seekg(start);
+        return false;
+    }
+};
+
+// Output buffer that compresses one block at a time, so its own memory stays at one block
+class CompressedOutBuf : public streambuf {
+private:
+    ostream& sink;
+    vector<char> block;
+    vector<uint8_t> scratch;
+    long long rawBytes;
+    long long storedBytes;
+    bool finished;
+
+    bool flushBlock() {
+        int rawLen = (int)(pptr() - pbase());
+        if(rawLen == 0) return true;
+
+        const uint8_t* raw = reinterpret_cast<const uint8_t*>(pbase());
+        int packed = BlockCodec::compress(raw, rawLen, scratch.data(), (int)scratch.size());
+
+        uint8_t header[12];
+        SaveContainer::putU32(header, (uint32_t)rawLen);
+        SaveContainer::putU32(header + 8, adler32(raw, rawLen));
+        if(packed < 0 || packed >= rawLen) {
+            SaveContainer::putU32(header + 4, (uint32_t)rawLen | SaveContainer::STORED_RAW);
+            sink.write(reinterpret_cast<const char*>(header), sizeof(header));
+            sink.write(pbase(), rawLen);
+            storedBytes += sizeof(header) + rawLen;
+        } else {
+            SaveContainer::putU32(header + 4, (uint32_t)packed);
+            sink.write(reinterpret_cast<const char*>(header), sizeof(header));
+            sink.write(reinterpret_cast<const char*>(scratch.data()), packed);
+            storedBytes += sizeof(header) + packed;
+        }
+        rawBytes += rawLen;
+
+        setp(block.data(), block.data() + block.size());
+        return sink.good();
+    }
+
+protected:
+    virtual int_type overflow(int_type ch) override {
+        if(!flushBlock()) return traits_type::eof();
+        if(!traits_type::eq_int_type(ch, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+    virtual int sync() override {
+        return flushBlock() ? 0 : -1;
+    }
+
+public:
+    CompressedOutBuf(ostream& out, int blockSize = SaveContainer::BLOCK_SIZE)
+        : sink(out), block(blockSize), scratch(BlockCodec::maxCompressedSize(blockSize)),
+          rawBytes(0), storedBytes(0), finished(false) {
+        uint8_t header[8];
+        memcpy(header, SaveContainer::magic(), 4);
+        SaveContainer::putU32(header + 4, (uint32_t)blockSize);
+        sink.write(reinterpret_cast<const char*>(header), sizeof(header));
+        storedBytes += sizeof(header);
+        setp(block.data(), block.data() + block.size());
+    }
+
+    ~CompressedOutBuf() {
+        finish();
+    }
+
+    // Flushes the last partial block and writes the terminator
+    bool finish() {
+        if(finished) return sink.good();
+        finished = true;
+        flushBlock();
+        uint8_t terminator[12] = {0};
+        sink.write(reinterpret_cast<const char*>(terminator), sizeof(terminator));
+        storedBytes += sizeof(terminator);
+        sink.flush();
+        return sink.good();
+    }
+
+    long long getRawBytes() const { return rawBytes + (pptr() - pbase()); }
+    long long getStoredBytes() const { return storedBytes; }
+};
+
+// Input buffer that inflates and verifies one block at a time
+class CompressedInBuf : public streambuf {
+private:
+    istream& source;
+    vector<char> block;
+    vector<uint8_t> packed;
+    long long rawBytes;
+    long long storedBytes;
+    bool corrupt;
+    bool atEnd;
+
+protected:
+    virtual int_type underflow() override {
+        if(gptr() < egptr()) return traits_type::to_int_type(*gptr());
+        if(atEnd || corrupt) return traits_type::eof();
+
+        uint8_t header[12];
+        source.read(reinterpret_cast<char*>(header), sizeof(header));
+        if(source.gcount() != (streamsize)sizeof(header)) {
+            corrupt = true;
+            return traits_type::eof();
+        }
+        storedBytes += sizeof(header);
+
+        uint32_t rawLen = SaveContainer::getU32(header);
+        uint32_t storedLen = SaveContainer::getU32(header + 4);
+        uint32_t checksum = SaveContainer::getU32(header + 8);
+        if(rawLen == 0) {
+            atEnd = true;
+            return traits_type::eof();
+        }
+
+        bool isRaw = (storedLen & SaveContainer::STORED_RAW) != 0;
+        storedLen &= ~SaveContainer::STORED_RAW;
+        if(rawLen > block.size() || storedLen > packed.size()) {
+            corrupt = true;
+            return traits_type::eof();
+        }
+
+        source.read(reinterpret_cast<char*>(packed.data()), storedLen);
+        if(source.gcount() != (streamsize)storedLen) {
+            corrupt = true;
+            return traits_type::eof();
+        }
+        storedBytes += storedLen;
+
+        int produced;
+        if(isRaw) {
+            memcpy(block.data(), packed.data(), storedLen);
+            produced = (int)storedLen;
+        } else {
+            produced = BlockCodec::decompress(packed.data(), (int)storedLen,
+                                              reinterpret_cast<uint8_t*>(block.data()), (int)rawLen);
+        }
+
+        if(produced != (int)rawLen ||
+           adler32(reinterpret_cast<const uint8_t*>(block.data()), (int)rawLen) != checksum) {
+            corrupt = true;
+            return traits_type::eof();
+        }
+
+        rawBytes += rawLen;
+        setg(block.data(), block.data(), block.data() + rawLen);
+        return traits_type::to_int_type(*gptr());
+    }
+
+public:
+    // Expects the magic to have been consumed already (see SaveContainer::detect)
+    CompressedInBuf(istream& in)
+        : source(in), rawBytes(0), storedBytes(4), corrupt(false), atEnd(false) {
+        uint8_t sizeField[4];
+        source.read(reinterpret_cast<char*>(sizeField), sizeof(sizeField));
+        uint32_t blockSize = SaveContainer::getU32(sizeField);
+        if(source.gcount() != 4 || blockSize == 0 || blockSize > 16 * 1024 * 1024) {
+            corrupt = true;
+            blockSize = 0;
+        }
+        storedBytes += 4;
+        block.resize(blockSize);
+        packed.resize(BlockCodec::maxCompressedSize(blockSize));
+        setg(block.data(), block.data(), block.data());
+    }
+
+    bool isCorrupt() const { return corrupt; }
+    long long getRawBytes() const { return rawBytes; }
+    long long getStoredBytes() const { return storedBytes; }
+};
+
+#endif
@@ -0,0 +1,429 @@
+#ifndef SAVE_FORMAT_H
+#define SAVE_FORMAT_H
+
+#include "GameExceptions.h"
+#include "String.h"
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <nmmintrin.h>
+#define SAVE_CRC32C_X86 1
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define SAVE_CRC32C_ARM 1
+#endif
+
+using namespace std;
+
+// CRC32C (Castagnoli); uses the SSE4.2 / ARMv8 crc32 instructions when available
+class Crc32c {
+private:
+    static const uint32_t POLY = 0x82F63B78u; // Reflected Castagnoli polynomial
+
+    struct Tables {
+        uint32_t t[8][256];
+
+        Tables() {
+            for(uint32_t i = 0; i < 256; i++) {
+                uint32_t crc = i;
+                for(int k = 0; k < 8; k++) {
+                    crc = (crc >> 1) ^ ((crc & 1) ? POLY : 0);
+                }
+                t[0][i] = crc;
+            }
+            for(uint32_t i = 0; i < 256; i++) {
+                for(int k = 1; k < 8; k++) {
+                    t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xFF];
+                }
+            }
+        }
+    };
+
+    // Slicing-by-8 tables for the portable path, built once on first use
+    static const uint32_t (&tables())[8][256] {
+        static const Tables built;
+        return built.t;
+    }
+
+    static uint32_t software(uint32_t crc, const uint8_t* p, size_t len) {
+        const uint32_t (&t)[8][256] = tables();
+        while(len >= 8) {
+            uint32_t lo, hi;
+            memcpy(&lo, p, 4);
+            memcpy(&hi, p + 4, 4);
+            if(!littleEndianHost()) {
+                lo = __builtin_bswap32(lo);
+                hi = __builtin_bswap32(hi);
+            }
+            lo ^= crc;
+            crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^
+                  t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+            p += 8;
+            len -= 8;
+        }
+        while(len--) {
+            crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xFF];
+        }
+        return crc;
+    }
+
+#if defined(SAVE_CRC32C_X86)
+    __attribute__((target("sse4.2")))
+    static uint32_t hardware(uint32_t crc, const uint8_t* p, size_t len) {
+#if defined(__x86_64__)
+        uint64_t wide = crc;
+        while(len >= 8) {
+            uint64_t v;
+            memcpy(&v, p, 8);
+            wide = _mm_crc32_u64(wide, v);
+            p += 8;
+            len -= 8;
+        }
+        crc = (uint32_t)wide;
+#endif
+        while(len--) {
+            crc = _mm_crc32_u8(crc, *p++);
+        }
+        return crc;
+    }
+#elif defined(SAVE_CRC32C_ARM)
+    static uint32_t hardware(uint32_t crc, const uint8_t* p, size_t len) {
+        while(len >= 8) {
+            uint64_t v;
+            memcpy(&v, p, 8);
+            crc = __crc32cd(crc, v);
+            p += 8;
+            len -= 8;
+        }
+        while(len--) {
+            crc = __crc32cb(crc, *p++);
+        }
+        return crc;
+    }
+#endif
+
+public:
+    static bool littleEndianHost() {
+        const uint16_t probe = 1;
+        return *reinterpret_cast<const uint8_t*>(&probe) == 1;
+    }
+
+    static bool hardwareAccelerated() {
+#if defined(SAVE_CRC32C_X86)
+        static const bool supported = __builtin_cpu_supports("sse4.2");
+        return supported;
+#elif defined(SAVE_CRC32C_ARM)
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // Continues a CRC; pass 0 to start a new one
+    static uint32_t update(uint32_t crc, const uint8_t* data, size_t len) {
+        crc = ~crc;
+#if defined(SAVE_CRC32C_X86) || defined(SAVE_CRC32C_ARM)
+        if(hardwareAccelerated()) {
+            return ~hardware(crc, data, len);
+        }
+#endif
+        return ~software(crc, data, len);
+    }
+
+    static uint32_t compute(const uint8_t* data, size_t len) {
+        return update(0, data, len);
+    }
+};
+
+// Appends fixed-width little-endian fields to an in-memory section
+class SaveWriter {
+private:
+    vector<uint8_t> bytes;
+
+public:
+    void writeU8(uint8_t v) {
+        bytes.push_back(v);
+    }
+
+    void writeBool(bool v) {
+        writeU8(v ? 1 : 0);
+    }
+
+    void writeU16(uint16_t v) {
+        bytes.push_back((uint8_t)v);
+        bytes.push_back((uint8_t)(v >> 8));
+    }
+
+    void writeU32(uint32_t v) {
+        for(int i = 0; i < 4; i++) {
+            bytes.push_back((uint8_t)(v >> (8 * i)));
+        }
+    }
+
+    void writeU64(uint64_t v) {
+        for(int i = 0; i < 8; i++) {
+            bytes.push_back((uint8_t)(v >> (8 * i)));
+        }
+    }
+
+    void writeI32(int32_t v) {
+        writeU32((uint32_t)v);
+    }
+
+    template<typename E>
+    void writeEnum(E v) {
+        writeU8((uint8_t)v);
+    }
+
+    void writeString(const String& s) {
+        int length = s.size();
+        writeU32((uint32_t)length);
+        const char* text = s.c_str();
+        bytes.insert(bytes.end(), text, text + length);
+    }
+
+    const vector<uint8_t>& data() const { return bytes; }
+    size_t size() const { return bytes.size(); }
+
+    // Hands the bytes over without copying; the writer is left empty
+    vector<uint8_t> release() {
+        vector<uint8_t> out;
+        out.swap(bytes);
+        return out;
+    }
+
+    // Starts over, keeping the buffer for the next use
+    void clear() { bytes.clear(); }
+};
+
+// Bounds-checked reader over one section; every overrun throws SaveLoadException
+class SaveReader {
+private:
+    const uint8_t* cur;
+    const uint8_t* end;
+    uint16_t version;
+
+    const uint8_t* take(size_t n) {
+        if((size_t)(end - cur) < n) {
+            throw SaveLoadException("section truncated");
+        }
+        const uint8_t* p = cur;
+        cur += n;
+        return p;
+    }
+
+public:
+    SaveReader(const vector<uint8_t>& data, uint16_t formatVersion)
+        : cur(data.data()), end(data.data() + data.size()), version(formatVersion) {}
+
+    uint8_t readU8() {
+        return *take(1);
+    }
+
+    bool readBool() {
+        uint8_t v = readU8();
+        if(v > 1) {
+            throw SaveLoadException("invalid boolean field");
+        }
+        return v == 1;
+    }
+
+    uint16_t readU16() {
+        const uint8_t* p = take(2);
+        return (uint16_t)(p[0] | (p[1] << 8));
+    }
+
+    uint32_t readU32() {
+        const uint8_t* p = take(4);
+        return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+
+    uint64_t readU64() {
+        uint64_t lo = readU32();
+        uint64_t hi = readU32();
+        return lo | (hi << 32);
+    }
+
+    int32_t readI32() {
+        return (int32_t)readU32();
+    }
+
+    // Reads a count and checks it against the bytes left, assuming minBytesEach per element
+    int readCount(size_t minBytesEach) {
+        uint32_t n = readU32();
+        if(n > 0x7FFFFFFFu || (minBytesEach > 0 && n > remaining() / minBytesEach)) {
+            throw SaveLoadException("element count exceeds section size");
+        }
+        return (int)n;
+    }
+
+    String readString() {
+        int len = readCount(1);
+        const uint8_t* p = take(len);
+        String s(len, ' ');
+        for(int i = 0; i < len; i++) {
+            s[i] = (char)p[i];
+        }
+        return s;
+    }
+
+    // Reads an enum stored as u8 and rejects values past its last enumerator
+    template<typename E>
+    E readEnum(E last) {
+        uint8_t v = readU8();
+        if(v > (uint8_t)last) {
+            throw SaveLoadException("enum value out of range");
+        }
+        return (E)v;
+    }
+
+    size_t remaining() const { return (size_t)(end - cur); }
+    bool atEnd() const { return cur == end; }
+    uint16_t getVersion() const { return version; }
+};
+
+// File layout (all fields little-endian):
+//   header:  "DCSV" | version u16 | flags u16 | sectionCount u32
+//   table:   per section: id u32 | length u64 | crc32c(payload) u32
+//   headerCrc u32 = crc32c(header + table)
+//   payloads, in table order
+// The table carries every length and checksum ahead of the payloads, so the whole save is
+// built in memory before anything is written: the output may be the block compressor, which
+// cannot seek back to patch the table in. Reading holds every section in memory too, so a
+// save or load buffers the whole uncompressed state once; readPayload only keeps a forged
+// length from allocating up front.
+class SaveSchema {
+public:
+    static const uint16_t VERSION = 1;
+    static const int MAX_SECTIONS = 64;
+    static const uint64_t MAX_SECTION_BYTES = 1ull << 30;
+
+    enum SectionId : uint32_t {
+        SECTION_GAME = 1,
+        SECTION_PLAYER = 2,
+        SECTION_DUNGEON = 3
+    };
+
+    struct Section {
+        uint32_t id;
+        vector<uint8_t> payload;
+    };
+
+    static const char* magic() { return "DCSV"; }
+
+    static void write(ostream& out, const vector<Section>& sections) {
+        SaveWriter head;
+        for(int i = 0; i < 4; i++) {
+            head.writeU8((uint8_t)magic()[i]);
+        }
+        head.writeU16(VERSION);
+        head.writeU16(0);
+        head.writeU32((uint32_t)sections.size());
+        for(const Section& s : sections) {
+            head.writeU32(s.id);
+            head.writeU64(s.payload.size());
+            head.writeU32(Crc32c::compute(s.payload.data(), s.payload.size()));
+        }
+        head.writeU32(Crc32c::compute(head.data().data(), head.size()));
+
+        out.write(reinterpret_cast<const char*>(head.data().data()), head.size());
+        for(const Section& s : sections) {
+            out.write(reinterpret_cast<const char*>(s.payload.data()), s.payload.size());
+        }
+    }
+
+    // Reads and verifies every section; nothing is returned unless all checks pass
+    static vector<Section> read(istream& in, uint16_t& version) {
+        uint8_t fixed[12];
+        if(!readExact(in, fixed, sizeof(fixed))) {
+            throw SaveLoadException("file too short for header");
+        }
+        if(memcmp(fixed, magic(), 4) != 0) {
+            throw SaveLoadException("not a versioned save file");
+        }
+        vector<uint8_t> headBytes(fixed, fixed + sizeof(fixed));
+        SaveReader fields(headBytes, 0);
+        fields.readU32();
+        version = fields.readU16();
+        fields.readU16();
+        uint32_t count = fields.readU32();
+        if(version == 0 || version > VERSION) {
+            throw SaveLoadException("unsupported save version");
+        }
+        if(count > (uint32_t)MAX_SECTIONS) {
+            throw SaveLoadException("too many sections");
+        }
+
+        size_t tableSize = count * 16;
+        headBytes.resize(sizeof(fixed) + tableSize + 4);
+        if(!readExact(in, headBytes.data() + sizeof(fixed), tableSize + 4)) {
+            throw SaveLoadException("truncated section table");
+        }
+        SaveReader table(headBytes, version);
+        table.readU32();
+        table.readU16();
+        table.readU16();
+        table.readU32();
+
+        vector<Section> sections(count);
+        vector<uint64_t> lengths(count);
+        vector<uint32_t> checksums(count);
+        for(uint32_t i = 0; i < count; i++) {
+            sections[i].id = table.readU32();
+            lengths[i] = table.readU64();
+            checksums[i] = table.readU32();
+        }
+        uint32_t headerCrc = table.readU32();
+        if(Crc32c::compute(headBytes.data(), headBytes.size() - 4) != headerCrc) {
+            throw SaveLoadException("header checksum mismatch");
+        }
+
+        for(uint32_t i = 0; i < count; i++) {
+            if(lengths[i] > MAX_SECTION_BYTES) {
+                throw SaveLoadException("section too large");
+            }
+            if(readPayload(in, sections[i].payload, (size_t)lengths[i]) != checksums[i]) {
+                throw SaveLoadException("section checksum mismatch");
+            }
+        }
+        return sections;
+    }
+
+    static const Section& require(const vector<Section>& sections, uint32_t id) {
+        for(const Section& s : sections) {
+            if(s.id == id) return s;
+        }
+        throw SaveLoadException("missing required section");
+    }
+
+private:
+    static const size_t READ_STEP = 64 * 1024;
+
+    static bool readExact(istream& in, uint8_t* dst, size_t len) {
+        in.read(reinterpret_cast<char*>(dst), len);
+        return (size_t)in.gcount() == len;
+    }
+
+    // Grows the payload a step at a time as bytes actually arrive, so a forged length in the
+    // table fails on the short read instead of allocating it up front; returns the CRC
+    static uint32_t readPayload(istream& in, vector<uint8_t>& payload, size_t length) {
+        payload.clear();
+        uint32_t crc = 0;
+        while(payload.size() < length) {
+            size_t offset = payload.size();
+            size_t step = min(READ_STEP, length - offset);
+            payload.resize(offset + step);
+            if(!readExact(in, payload.data() + offset, step)) {
+                throw SaveLoadException("truncated section payload");
+            }
+            crc = Crc32c::update(crc, payload.data() + offset, step);
+        }
+        return crc;
+    }
+};
+
+#endif
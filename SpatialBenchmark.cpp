@@ -0,0 +1,137 @@
+// Proximity queries through the spatial index against scanning every entity:
+// "monsters within radius r" and "nearest item of type T" at growing entity counts
+// Usage: SpatialBenchmark [map size] [queries] [seed]
+#include "SpatialIndex.h"
+#include "Item.h"
+#include "Monster.h"
+#include "DungeonGenerator.h"
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+using namespace std;
+
+thread_local GameOutput gameOutput;
+
+int main(int argc, char* argv[])
+{
+    int size = argc > 1 ? atoi(argv[1]) : 4096;
+    int queries = argc > 2 ? atoi(argv[2]) : 2000;
+    uint64_t seed = argc > 3 ? strtoull(argv[3], nullptr, 10) : 1;
+    if(size < 16 || queries < 1)
+    {
+        cerr << "Usage: " << argv[0] << " [map size >= 16] [queries >= 1] [seed]" << endl;
+        return 1;
+    }
+
+    const int RADIUS = 16;
+    const int ITEM_TYPES = 6;
+    printf("%dx%d map, %d queries, radius %d\n", size, size, queries, RADIUS);
+    for(int count : {1000, 10000, 100000, 1000000})
+    {
+        Random rng(seed);
+        SpatialIndex<Monster> monsterIndex;
+        SpatialIndex<Item> itemIndex;
+        monsterIndex.reset(size, size);
+        itemIndex.reset(size, size);
+
+        vector<Monster*> monsters;
+        vector<Item*> items;
+        monsters.reserve(count);
+        items.reserve(count);
+        auto built = chrono::steady_clock::now();
+        for(int i = 0; i < count; i++)
+        {
+            monsters.push_back(new Monster("Goblin", rng.range(0, size - 1), rng.range(0, size - 1), i,
+                                           MonsterType::GOBLIN, 10, 1, 1));
+            monsters.back()->setTracker(&monsterIndex);
+            monsters.back()->setPlaced(true);
+            items.push_back(new Item("Thing", rng.range(0, size - 1), rng.range(0, size - 1), i,
+                                     (ItemType)rng.range(0, ITEM_TYPES - 1), 1));
+            items.back()->setTracker(&itemIndex);
+            items.back()->setPlaced(true);
+        }
+        double buildSeconds = chrono::duration<double>(chrono::steady_clock::now() - built).count();
+
+        vector<int> qx(queries), qy(queries), qt(queries);
+        for(int i = 0; i < queries; i++)
+        {
+            qx[i] = rng.range(0, size - 1);
+            qy[i] = rng.range(0, size - 1);
+            qt[i] = rng.range(0, ITEM_TYPES - 1);
+        }
+
+        // Radius queries
+        long long indexedHits = 0, scannedHits = 0;
+        vector<Monster*> found;
+        auto start = chrono::steady_clock::now();
+        for(int i = 0; i < queries; i++)
+        {
+            monsterIndex.queryWithin(qx[i], qy[i], RADIUS, found);
+            indexedHits += found.size();
+        }
+        double indexedRadius = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        start = chrono::steady_clock::now();
+        for(int i = 0; i < queries; i++)
+        {
+            for(const Monster* m : monsters)
+            {
+                long long dx = m->getX() - qx[i], dy = m->getY() - qy[i];
+                if(dx * dx + dy * dy <= (long long)RADIUS * RADIUS) scannedHits++;
+            }
+        }
+        double scannedRadius = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        // Nearest of a type; both must agree on the distance (ties may pick different items)
+        int mismatches = 0;
+        vector<long long> indexedDistance(queries, -1);
+        start = chrono::steady_clock::now();
+        for(int i = 0; i < queries; i++)
+        {
+            ItemType type = (ItemType)qt[i];
+            const Item* best = itemIndex.nearest(qx[i], qy[i], [type](const Item* item) { return item->getType() == type; });
+            if(best)
+            {
+                long long dx = best->getX() - qx[i], dy = best->getY() - qy[i];
+                indexedDistance[i] = dx * dx + dy * dy;
+            }
+        }
+        double indexedNearest = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        start = chrono::steady_clock::now();
+        for(int i = 0; i < queries; i++)
+        {
+            long long bestDistance = -1;
+            for(const Item* item : items)
+            {
+                if(item->getType() != (ItemType)qt[i]) continue;
+                long long dx = item->getX() - qx[i], dy = item->getY() - qy[i];
+                long long d = dx * dx + dy * dy;
+                if(bestDistance < 0 || d < bestDistance) bestDistance = d;
+            }
+            if(bestDistance != indexedDistance[i]) mismatches++;
+        }
+        double scannedNearest = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        // Keeping the index current: every monster takes one random step
+        start = chrono::steady_clock::now();
+        for(Monster* m : monsters)
+        {
+            int nx = m->getX() + rng.range(-1, 1);
+            int ny = m->getY() + rng.range(-1, 1);
+            if(nx >= 0 && ny >= 0 && nx < size && ny < size) m->setPosition(nx, ny);
+        }
+        double moveSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        printf("%8d entities (indexed in %.2f s), %.1f ns/move\n", count, buildSeconds,
+               moveSeconds * 1e9 / count);
+        printf("  within:  index %9.2f us/query  scan %10.2f us/query  (%lld vs %lld hits)\n",
+               indexedRadius * 1e6 / queries, scannedRadius * 1e6 / queries, indexedHits, scannedHits);
+        printf("  nearest: index %9.2f us/query  scan %10.2f us/query  (%d mismatches)\n",
+               indexedNearest * 1e6 / queries, scannedNearest * 1e6 / queries, mismatches);
+
+        for(Monster* m : monsters) delete m;
+        for(Item* item : items) delete item;
+    }
+    return 0;
+}
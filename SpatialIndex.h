@@ -0,0 +1,214 @@
+#ifndef SPATIAL_INDEX_H
+#define SPATIAL_INDEX_H
+
+#include "Entity.h"
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+using namespace std;
+
+// Uniform bucket grid over the positions of entities lying in the dungeon.
+//
+// The map is cut into square buckets of BUCKET_SIZE cells and each bucket lists the
+// entities inside it. Entities keep the index current themselves (Entity::setTracker):
+// it hears when they are put into a cell, move, or are taken out, and never has to be
+// rebuilt. A radius query only visits the buckets overlapping the circle; a nearest
+// query visits rings of buckets outward until nothing closer can remain.
+//
+// Buckets are grouped into blocks of BLOCK_BUCKETS x BLOCK_BUCKETS that only count their
+// entities, a two-level tree. Empty blocks are skipped without touching their buckets,
+// and when the world is sparse the nearest search walks rings of blocks instead, so a
+// handful of entities on a huge map does not mean scanning thousands of empty buckets.
+template<typename T>
+class SpatialIndex : public EntityTracker {
+public:
+    static const int BUCKET_SHIFT = 4;
+    static const int BUCKET_SIZE = 1 << BUCKET_SHIFT;
+    static const int BLOCK_SHIFT = 3;
+    static const int BLOCK_BUCKETS = 1 << BLOCK_SHIFT;
+
+private:
+    // Position copied next to the pointer, so distance checks do not touch the entity
+    struct Entry {
+        int x, y;
+        Entity* entity;
+    };
+
+    int bucketsX, bucketsY;
+    int blocksX, blocksY;
+    vector<vector<Entry>> buckets;
+    vector<int> blockCounts;
+    size_t count;
+
+    int& blockCountOf(int x, int y) {
+        int bx = bucketCoord(x, bucketsX) >> BLOCK_SHIFT;
+        int by = bucketCoord(y, bucketsY) >> BLOCK_SHIFT;
+        return blockCounts[(size_t)by * blocksX + bx];
+    }
+
+    bool blockEmpty(int bx, int by) const {
+        return blockCounts[(size_t)(by >> BLOCK_SHIFT) * blocksX + (bx >> BLOCK_SHIFT)] == 0;
+    }
+
+    // Keeps the closest accepted entity of one bucket in best
+    template<typename Accept>
+    void scanBucket(int bx, int by, int x, int y, Accept& accepts, Entity*& best, long long& bestDistance) const {
+        for(const Entry& entry : buckets[(size_t)by * bucketsX + bx]) {
+            long long d = distanceSquared(entry, x, y);
+            if((!best || d < bestDistance) && accepts(static_cast<T*>(entry.entity))) {
+                best = entry.entity;
+                bestDistance = d;
+            }
+        }
+    }
+
+    int bucketCoord(int v, int limit) const {
+        v >>= BUCKET_SHIFT;
+        if(v < 0) return 0;
+        return v >= limit ? limit - 1 : v;
+    }
+
+    vector<Entry>& bucketOf(int x, int y) {
+        return buckets[(size_t)bucketCoord(y, bucketsY) * bucketsX + bucketCoord(x, bucketsX)];
+    }
+
+    // The entity remembers its position in the bucket (Entity::getTrackerSlot)
+    static Entry* find(vector<Entry>& bucket, const Entity* entity) {
+        int slot = entity->getTrackerSlot();
+        if(slot < 0 || slot >= (int)bucket.size() || bucket[slot].entity != entity) return nullptr;
+        return &bucket[slot];
+    }
+
+    static void append(vector<Entry>& bucket, Entity& entity) {
+        entity.setTrackerSlot((int)bucket.size());
+        bucket.push_back(Entry{entity.getX(), entity.getY(), &entity});
+    }
+
+    static bool take(vector<Entry>& bucket, Entity* entity) {
+        Entry* entry = find(bucket, entity);
+        if(!entry) return false;
+        *entry = bucket.back();
+        entry->entity->setTrackerSlot(entity->getTrackerSlot());
+        bucket.pop_back();
+        entity->setTrackerSlot(-1);
+        return true;
+    }
+
+    static long long distanceSquared(const Entry& entry, int x, int y) {
+        long long dx = entry.x - x;
+        long long dy = entry.y - y;
+        return dx * dx + dy * dy;
+    }
+
+public:
+    SpatialIndex() : bucketsX(1), bucketsY(1), blocksX(1), blocksY(1), buckets(1), blockCounts(1, 0), count(0) {}
+
+    // Sized for a width x height map; drops every entry (the entities still point here,
+    // so only call this before re-registering them or while none are tracked)
+    void reset(int width, int height) {
+        bucketsX = width > 0 ? (width + BUCKET_SIZE - 1) >> BUCKET_SHIFT : 1;
+        bucketsY = height > 0 ? (height + BUCKET_SIZE - 1) >> BUCKET_SHIFT : 1;
+        blocksX = (bucketsX + BLOCK_BUCKETS - 1) >> BLOCK_SHIFT;
+        blocksY = (bucketsY + BLOCK_BUCKETS - 1) >> BLOCK_SHIFT;
+        buckets.assign((size_t)bucketsX * bucketsY, vector<Entry>());
+        blockCounts.assign((size_t)blocksX * blocksY, 0);
+        count = 0;
+    }
+
+    void entityPlaced(Entity& entity) override {
+        append(bucketOf(entity.getX(), entity.getY()), entity);
+        blockCountOf(entity.getX(), entity.getY())++;
+        count++;
+    }
+
+    void entityMoved(Entity& entity, int oldX, int oldY) override {
+        vector<Entry>& from = bucketOf(oldX, oldY);
+        vector<Entry>& to = bucketOf(entity.getX(), entity.getY());
+        if(&from == &to) {
+            if(Entry* entry = find(from, &entity)) {
+                entry->x = entity.getX();
+                entry->y = entity.getY();
+            }
+            return;
+        }
+        if(!take(from, &entity)) return;
+        append(to, entity);
+        blockCountOf(oldX, oldY)--;
+        blockCountOf(entity.getX(), entity.getY())++;
+    }
+
+    void entityRemoved(Entity& entity) override {
+        if(take(bucketOf(entity.getX(), entity.getY()), &entity)) {
+            blockCountOf(entity.getX(), entity.getY())--;
+            count--;
+        }
+    }
+
+    size_t size() const { return count; }
+
+    // Calls visit(T*) for every entity within radius (Euclidean) of (x, y)
+    template<typename Visit>
+    void forEachWithin(int x, int y, int radius, Visit visit) const {
+        if(radius < 0) return;
+        long long limit = (long long)radius * radius;
+        int bx0 = bucketCoord(x - radius, bucketsX), bx1 = bucketCoord(x + radius, bucketsX);
+        int by0 = bucketCoord(y - radius, bucketsY), by1 = bucketCoord(y + radius, bucketsY);
+        for(int by = by0; by <= by1; by++) {
+            for(int bx = bx0; bx <= bx1; bx++) {
+                if(blockEmpty(bx, by)) continue;
+                for(const Entry& entry : buckets[(size_t)by * bucketsX + bx]) {
+                    if(distanceSquared(entry, x, y) <= limit) visit(static_cast<T*>(entry.entity));
+                }
+            }
+        }
+    }
+
+    void queryWithin(int x, int y, int radius, vector<T*>& out) const {
+        out.clear();
+        forEachWithin(x, y, radius, [&out](T* entity) { out.push_back(entity); });
+    }
+
+    // Closest entity to (x, y) that accepts(T*), or nullptr. Ties go to whichever the
+    // buckets list first.
+    template<typename Accept>
+    T* nearest(int x, int y, Accept accepts) const {
+        // Rings of buckets, or of whole blocks when there is less than one entity per block
+        bool sparse = count < blockCounts.size();
+        int shift = sparse ? BLOCK_SHIFT : 0;
+        int tilesX = sparse ? blocksX : bucketsX;
+        int tilesY = sparse ? blocksY : bucketsY;
+        int tileSize = BUCKET_SIZE << shift;
+        int cx = bucketCoord(x, bucketsX) >> shift;
+        int cy = bucketCoord(y, bucketsY) >> shift;
+        int maxRing = max(max(cx, tilesX - 1 - cx), max(cy, tilesY - 1 - cy));
+        Entity* best = nullptr;
+        long long bestDistance = 0;
+        for(int ring = 0; ring <= maxRing; ring++) {
+            // Anything in this ring or beyond is at least (ring - 1) tiles plus one cell away
+            if(best && ring > 0) {
+                long long reach = (long long)(ring - 1) * tileSize + 1;
+                if(reach * reach >= bestDistance) break;
+            }
+            for(int ty = cy - ring; ty <= cy + ring; ty++) {
+                if(ty < 0 || ty >= tilesY) continue;
+                bool edgeRow = ty == cy - ring || ty == cy + ring;
+                int step = edgeRow || ring == 0 ? 1 : 2 * ring;
+                for(int tx = cx - ring; tx <= cx + ring; tx += step) {
+                    if(tx < 0 || tx >= tilesX) continue;
+                    int bx0 = tx << shift, by0 = ty << shift;
+                    if(blockEmpty(bx0, by0)) continue;
+                    int bx1 = min(bx0 + (1 << shift), bucketsX);
+                    int by1 = min(by0 + (1 << shift), bucketsY);
+                    for(int by = by0; by < by1; by++) {
+                        for(int bx = bx0; bx < bx1; bx++) {
+                            scanBucket(bx, by, x, y, accepts, best, bestDistance);
+                        }
+                    }
+                }
+            }
+        }
+        return static_cast<T*>(best);
+    }
+};
+
+#endif
@@ -0,0 +1,192 @@
+#ifndef STATE_HASH_H
+#define STATE_HASH_H
+
+#include "String.h"
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+using namespace std;
+
+// Zobrist-style hash of a whole game, kept up to date as it changes.
+//
+// Every hashed field of every cell and entity contributes key(subject, field, value),
+// and the hash is the XOR of all contributions. A setter that changes a field XORs the
+// old value's key out and the new one's in, so the hash is always current and comparing
+// two games is comparing two integers. Keys come from mixing the three inputs rather than
+// from a random table, since positions, health and ids have no fixed range. Contributions
+// do not depend on order, so two games with the same contents hash the same however
+// they got there (e.g. live and reloaded).
+class StateHash {
+public:
+    // Whose field it is; ids are only unique within a kind (a carried item keeps the id
+    // of the one it was picked up from)
+    enum Kind : uint32_t {
+        GAME = 1,
+        DUNGEON,
+        CELL,
+        PLAYER,
+        ITEM,
+        MONSTER,
+        CARRIED
+    };
+
+    enum Field : uint32_t {
+        NAME = 1,
+        X,
+        Y,
+        ACTIVE,
+        HEALTH,
+        MAX_HEALTH,
+        MANA,
+        MAX_MANA,
+        ATTACK,
+        DEFENSE,
+        LEVEL,
+        EXPERIENCE,
+        TYPE,
+        WEAKNESS,
+        DEFEATED,
+        REQUIRES,     // One key per required item id
+        VALUE,
+        DESCRIPTION,
+        CONSUMABLE,
+        VISITED,
+        ACCESSIBLE,
+        HOLDS_ITEM,   // One key per item id lying in a cell
+        HOLDS_MONSTER,
+        WIDTH,
+        HEIGHT,
+        NEXT_ID,
+        SEED,
+        ENTRANCE_X,
+        ENTRANCE_Y,
+        WON
+    };
+
+private:
+    uint64_t hash;
+    vector<uint64_t>* journal; // Gets the subject of every change, while set
+
+    // splitMix64's finalizer
+    static uint64_t mix(uint64_t z) {
+        z += 0x9E3779B97F4A7C15ull;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+public:
+    StateHash() : hash(0), journal(nullptr) {}
+
+    static uint64_t subject(Kind kind, int id) {
+        return ((uint64_t)kind << 56) | (uint32_t)id;
+    }
+
+    // Cells are named by position (below 2^28 each way)
+    static uint64_t cell(int x, int y) {
+        return ((uint64_t)CELL << 56) | ((uint64_t)(uint32_t)y << 28) | (uint32_t)x;
+    }
+
+    static Kind kindOf(uint64_t subject) { return (Kind)(subject >> 56); }
+    static int idOf(uint64_t subject) { return (int)(uint32_t)subject; }
+    static int cellX(uint64_t subject) { return (int)(subject & 0xFFFFFFF); }
+    static int cellY(uint64_t subject) { return (int)((subject >> 28) & 0xFFFFFFF); }
+
+    // Keys for the fields of one subject, which is mixed only once
+    class Keys {
+    private:
+        uint64_t base;
+
+    public:
+        explicit Keys(uint64_t subject) : base(mix(subject)) {}
+
+        uint64_t operator()(Field field, uint64_t value) const {
+            return mix((base + field * 0x9E3779B97F4A7C15ull) ^ value);
+        }
+    };
+
+    static uint64_t key(uint64_t subject, Field field, uint64_t value) {
+        return Keys(subject)(field, value);
+    }
+
+    // Field values as key input
+    static uint64_t value(int v) { return (uint32_t)v; }
+    static uint64_t value(bool v) { return v ? 1 : 0; }
+    static uint64_t value(uint64_t v) { return v; }
+
+    // Eight bytes per multiply, mixed once at the end; cell descriptions make this a
+    // large part of hashing a new world
+    static uint64_t value(const String& s) {
+        const char* text = s.c_str();
+        size_t length = (size_t)s.size();
+        uint64_t h = length;
+        size_t i = 0;
+        for(; i + 8 <= length; i += 8) {
+            uint64_t chunk;
+            memcpy(&chunk, text + i, 8);
+            h = (h ^ chunk) * 0xFF51AFD7ED558CCDull;
+            h ^= h >> 32;
+        }
+        uint64_t tail = 0;
+        memcpy(&tail, text + i, length - i);
+        return mix(h ^ tail);
+    }
+
+    template<typename E>
+    static typename enable_if<is_enum<E>::value, uint64_t>::type value(E v) { return (uint64_t)v; }
+
+    // Assigns a hashed field, keeping `hash` (if any) in step
+    template<typename T>
+    static void assign(StateHash* hash, uint64_t subject, Field field, T& slot, const T& v) {
+        if(hash && !(slot == v)) {
+            Keys key(subject);
+            hash->change(subject, key(field, value(slot)) ^ key(field, value(v)));
+        }
+        slot = v;
+    }
+
+    // Changes one thread makes to a hash while others change the same hash, kept apart
+    // until absorb() folds them in; contributions do not depend on order, so neither does
+    // the result (see Dungeon::moveMonsters)
+    struct Batch {
+        const StateHash* target;
+        uint64_t hash;
+        vector<uint64_t> subjects;
+    };
+
+    // The batch changes to `target` go to on this thread, if any
+    static Batch*& openBatch() {
+        static thread_local Batch* open = nullptr;
+        return open;
+    }
+
+    // Adds a contribution, or removes it again
+    void toggle(uint64_t contribution) { hash ^= contribution; }
+
+    // The same for a change to one subject while the game runs, noted in the journal
+    void change(uint64_t subject, uint64_t contribution) {
+        Batch* batch = openBatch();
+        if(batch && batch->target == this) {
+            batch->hash ^= contribution;
+            if(journal) batch->subjects.push_back(subject);
+            return;
+        }
+        hash ^= contribution;
+        if(journal) journal->push_back(subject);
+    }
+
+    void absorb(const Batch& batch) {
+        hash ^= batch.hash;
+        if(journal) journal->insert(journal->end(), batch.subjects.begin(), batch.subjects.end());
+    }
+
+    // Subjects are appended to `changes` (which may repeat them) until this is called with
+    // nullptr; this is how undo history finds what a command touched (see WorldHistory.h)
+    void setJournal(vector<uint64_t>* changes) { journal = changes; }
+
+    void clear() { hash = 0; }
+    uint64_t get() const { return hash; }
+};
+
+#endif
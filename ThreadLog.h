@@ -0,0 +1,314 @@
+#ifndef THREAD_LOG_H
+#define THREAD_LOG_H
+
+#include "AsyncLog.h"
+#include "LogFile.h"
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <string>
+using namespace std;
+
+// Session id of the game running on the current thread (0 = none)
+class LogSession {
+private:
+    static unsigned& slot() {
+        thread_local unsigned id = 0;
+        return id;
+    }
+
+public:
+    static void set(unsigned id) { slot() = id; }
+    static unsigned get() { return slot(); }
+
+    static unsigned next() {
+        static atomic<unsigned> counter(0);
+        return ++counter;
+    }
+};
+
+// Single-producer/single-consumer ring owned by one logging thread
+class ThreadLogBuffer {
+public:
+    struct Entry {
+        uint64_t sequence; // Global order across all threads
+        LogRecord record;
+    };
+
+private:
+    Entry* slots;
+    size_t mask;
+    alignas(64) atomic<size_t> head; // Written by the producer
+    alignas(64) atomic<size_t> tail; // Written by the collector
+
+public:
+    ThreadLogBuffer(size_t capacity) : head(0), tail(0) {
+        size_t size = 2;
+        while(size < capacity) size <<= 1;
+        slots = new Entry[size];
+        mask = size - 1;
+    }
+
+    ~ThreadLogBuffer() {
+        delete[] slots;
+    }
+
+    ThreadLogBuffer(const ThreadLogBuffer&) = delete;
+    ThreadLogBuffer& operator=(const ThreadLogBuffer&) = delete;
+
+    size_t capacity() const { return mask + 1; }
+
+    bool hasRoom(size_t count) const {
+        return head.load(memory_order_relaxed) - tail.load(memory_order_acquire) + count <= mask + 1;
+    }
+
+    // Producer only; caller has checked hasRoom(count). The line's segments share its
+    // sequence number and are published together.
+    void publish(uint64_t sequence, const char* text, int length, size_t count) {
+        size_t h = head.load(memory_order_relaxed);
+        for(size_t i = 0; i < count; i++) {
+            Entry& e = slots[(h + i) & mask];
+            e.sequence = sequence;
+            e.record.assign(text, length, i, count);
+        }
+        head.store(h + count, memory_order_release);
+    }
+
+    // Collector only; appends everything published so far
+    void drainInto(vector<Entry>& out) {
+        size_t t = tail.load(memory_order_relaxed);
+        size_t h = head.load(memory_order_acquire);
+        for(; t != h; t++) {
+            out.push_back(slots[t & mask]);
+        }
+        tail.store(t, memory_order_release);
+    }
+
+    bool empty() const {
+        return head.load(memory_order_acquire) == tail.load(memory_order_relaxed);
+    }
+};
+
+// Gives each logging thread its own buffer and merges them on a collector thread.
+// Records are written in the order their sequence numbers were taken, so lines from
+// concurrent sessions never interleave mid-line and keep a single global order.
+class ThreadLogCollector {
+private:
+    static const int BATCH_BYTES = 64 * 1024;
+
+    uint64_t instanceId;
+    size_t bufferCapacity;
+    OverflowPolicy policy;
+    LogFile& file;
+    atomic<bool> echoToConsole;
+    atomic<uint64_t> dropped;
+    uint64_t droppedReported;
+
+    mutex registryMutex;
+    vector<shared_ptr<ThreadLogBuffer>> buffers;
+    atomic<uint64_t> nextSequence;
+    uint64_t emitSequence;
+    vector<ThreadLogBuffer::Entry> staged;
+
+    thread worker;
+    mutex wakeMutex;
+    condition_variable wake;
+    atomic<bool> stopping;
+
+    mutex flushMutex;
+    condition_variable flushed;
+    uint64_t writtenSequence; // Records before this sequence number have reached the file
+
+    static uint64_t newInstanceId() {
+        static atomic<uint64_t> counter(0);
+        return ++counter;
+    }
+
+    // The calling thread's buffer for this collector, registered on first use
+    ThreadLogBuffer& localBuffer() {
+        struct Binding {
+            uint64_t owner;
+            shared_ptr<ThreadLogBuffer> buffer;
+        };
+        thread_local vector<Binding> bindings;
+        for(const Binding& b : bindings) {
+            if(b.owner == instanceId) return *b.buffer;
+        }
+        // Drop bindings to collectors that no longer exist (we hold the only reference)
+        for(size_t i = 0; i < bindings.size();) {
+            if(bindings[i].buffer.use_count() == 1) {
+                bindings.erase(bindings.begin() + i);
+            } else {
+                i++;
+            }
+        }
+        shared_ptr<ThreadLogBuffer> created = make_shared<ThreadLogBuffer>(bufferCapacity);
+        {
+            lock_guard<mutex> lock(registryMutex);
+            buffers.push_back(created);
+        }
+        bindings.push_back(Binding{instanceId, created});
+        return *created;
+    }
+
+    void flushBatch(string& batch) {
+        if(batch.empty()) return;
+        if(echoToConsole.load(memory_order_relaxed)) {
+            lock_guard<mutex> lock(consoleMutex());
+            cout.write(batch.data(), batch.size());
+            cout.flush();
+        }
+        if(file.is_open()) {
+            file.write(batch.data(), batch.size());
+            file.flush();
+        }
+        batch.clear();
+    }
+
+    // Collects from every buffer and writes the contiguous run of sequence numbers
+    bool collect(string& batch, bool final) {
+        vector<shared_ptr<ThreadLogBuffer>> snapshot;
+        {
+            lock_guard<mutex> lock(registryMutex);
+            snapshot = buffers;
+        }
+
+        size_t before = staged.size();
+        for(const shared_ptr<ThreadLogBuffer>& buffer : snapshot) {
+            buffer->drainInto(staged);
+        }
+        bool gotNew = staged.size() != before;
+        if(staged.empty()) return false;
+
+        // Stable, so the segments of a long line (one sequence number) stay in order
+        stable_sort(staged.begin(), staged.end(),
+                    [](const ThreadLogBuffer::Entry& a, const ThreadLogBuffer::Entry& b) {
+                        return a.sequence < b.sequence;
+                    });
+
+        // A gap means a producer took a number but has not published yet; wait for it
+        size_t emitted = 0;
+        while(emitted < staged.size() &&
+              (final || staged[emitted].sequence == emitSequence ||
+               (emitted > 0 && staged[emitted].sequence == staged[emitted - 1].sequence))) {
+            const LogRecord& rec = staged[emitted].record;
+            batch.append(rec.text, rec.length);
+            if(!rec.more) batch.push_back('\n');
+            emitSequence = staged[emitted].sequence + 1;
+            emitted++;
+            if(!rec.more && (int)batch.size() >= BATCH_BYTES) flushBatch(batch);
+        }
+        staged.erase(staged.begin(), staged.begin() + emitted);
+        if(policy == OverflowPolicy::COUNT) {
+            uint64_t lost = dropped.load(memory_order_relaxed);
+            if(lost != droppedReported) {
+                batch += "[logger] dropped " + to_string(lost - droppedReported) + " records\n";
+                droppedReported = lost;
+            }
+        }
+        flushBatch(batch);
+        {
+            lock_guard<mutex> lock(flushMutex);
+            writtenSequence = emitSequence;
+        }
+        flushed.notify_all();
+
+        // Buffers whose thread has exited (only the registry holds them) can go once empty
+        snapshot.clear();
+        lock_guard<mutex> lock(registryMutex);
+        for(size_t i = 0; i < buffers.size();) {
+            if(buffers[i].use_count() == 1 && buffers[i]->empty()) {
+                buffers.erase(buffers.begin() + i);
+            } else {
+                i++;
+            }
+        }
+        return gotNew;
+    }
+
+    void run() {
+        string batch;
+        batch.reserve(BATCH_BYTES + LogRecord::MAX_TEXT + 64);
+        for(;;) {
+            CoarseClock::tick();
+            if(stopping.load(memory_order_acquire)) {
+                collect(batch, false);
+                collect(batch, true);
+                break;
+            }
+            if(collect(batch, false)) continue;
+
+            unique_lock<mutex> lock(wakeMutex);
+            if(!stopping.load(memory_order_acquire)) {
+                wake.wait_for(lock, chrono::milliseconds(2));
+            }
+        }
+    }
+
+public:
+    ThreadLogCollector(LogFile& logFile, size_t perThreadCapacity = 1024,
+                       OverflowPolicy overflow = OverflowPolicy::BLOCK, bool echo = true)
+        : instanceId(newInstanceId()), bufferCapacity(perThreadCapacity), policy(overflow), file(logFile),
+          echoToConsole(echo), dropped(0), droppedReported(0), nextSequence(0), emitSequence(0), stopping(false),
+          writtenSequence(0) {
+        worker = thread(&ThreadLogCollector::run, this);
+    }
+
+    // Producers must have stopped logging; everything they published is written first
+    ~ThreadLogCollector() {
+        stopping.store(true, memory_order_release);
+        {
+            lock_guard<mutex> lock(wakeMutex);
+            wake.notify_one();
+        }
+        worker.join();
+    }
+
+    ThreadLogCollector(const ThreadLogCollector&) = delete;
+    ThreadLogCollector& operator=(const ThreadLogCollector&) = delete;
+
+    // A full buffer is handled by the overflow policy. A dropped record is dropped before
+    // it takes a sequence number, since a missing number would stall the ordered merge.
+    // Returns false if the record was dropped.
+    bool push(const char* text, int length) {
+        ThreadLogBuffer& buffer = localBuffer();
+        size_t count = LogRecord::segments(length);
+        if(count > buffer.capacity()) count = buffer.capacity();
+        while(!buffer.hasRoom(count)) {
+            if(policy != OverflowPolicy::BLOCK) {
+                dropped.fetch_add(1, memory_order_relaxed);
+                return false;
+            }
+            this_thread::yield();
+        }
+        buffer.publish(nextSequence.fetch_add(1, memory_order_relaxed), text, length, count);
+        return true;
+    }
+
+    // Waits until every record pushed before the call has been written; the thread keeps running
+    void flush() {
+        uint64_t target = nextSequence.load(memory_order_acquire);
+        {
+            lock_guard<mutex> lock(wakeMutex);
+            wake.notify_one();
+        }
+        unique_lock<mutex> lock(flushMutex);
+        flushed.wait(lock, [&] { return writtenSequence >= target; });
+    }
+
+    void setConsoleEcho(bool echo) { echoToConsole.store(echo, memory_order_relaxed); }
+
+    uint64_t getDroppedCount() const { return dropped.load(memory_order_relaxed); }
+
+    size_t getThreadCount() {
+        lock_guard<mutex> lock(registryMutex);
+        return buffers.size();
+    }
+};
+
+#endif
@@ -0,0 +1,76 @@
+// World tick time against thread count on a crowded generated map. Every run rebuilds
+// the same world and must end in the same state, which the checksum column confirms.
+// The part of the tick left on one thread is shown with the speed-up bound it sets.
+// Usage: TickBenchmark [size] [monsters] [ticks] [seed] [max threads]
+#include "WorldSimulation.h"
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+using namespace std;
+
+thread_local GameOutput gameOutput;
+
+int main(int argc, char* argv[])
+{
+    int size = argc > 1 ? atoi(argv[1]) : 2048;
+    int monsters = argc > 2 ? atoi(argv[2]) : 1000000;
+    int ticks = argc > 3 ? atoi(argv[3]) : 100;
+    uint64_t seed = argc > 4 ? strtoull(argv[4], nullptr, 10) : 1;
+    int maxThreads = argc > 5 ? atoi(argv[5]) : 32;
+    if(size < 16 || monsters < 0 || ticks < 1 || maxThreads < 1)
+    {
+        cerr << "Usage: " << argv[0] << " [size >= 16] [monsters] [ticks >= 1] [seed] [max threads >= 1]" << endl;
+        return 1;
+    }
+
+    NullSink discard;
+    gameOutput.setSink(&discard);
+    printf("%dx%d map, %d monsters, %d ticks, %u hardware threads\n", size, size, monsters, ticks,
+           thread::hardware_concurrency());
+
+    for(int threads = 1; threads <= maxThreads; threads *= 2)
+    {
+        Dungeon dungeon(size, size, "Benchmark", seed);
+        Character hero("Hero", dungeon.getEntranceX(), dungeon.getEntranceY(), 1);
+        dungeon.setPlayer(&hero);
+
+        // Top the population up to the requested count
+        Random rng(seed);
+        const vector<MonsterSpawn>& table = SpawnTables::monsters();
+        while(dungeon.getAllMonsters().size() < monsters)
+        {
+            int x = rng.range(0, size - 1);
+            int y = rng.range(0, size - 1);
+            if(dungeon.isAccessible(x, y))
+            {
+                dungeon.spawnMonster(table[SpawnTables::pick(table, rng)], x, y);
+            }
+        }
+        dungeon.clearDirty();
+
+        WorldSimulation world;
+        world.setThreads(threads);
+        world.setChase(true);
+        world.reset(&dungeon, &hero);
+        world.advance(WorldSimulation::TICK_MS * ticks);
+
+        uint64_t checksum = 0;
+        for(const Monster* m : dungeon.getAllMonsters().getAll())
+        {
+            uint64_t h = ((uint64_t)m->getId() << 40) ^ ((uint64_t)m->getX() << 20) ^ (uint64_t)m->getY();
+            checksum += Random::splitMix(h);
+        }
+        const TickStats& stats = world.getStats();
+        printf("%2d threads: %9.1f us/tick  %9.1f us slowest  %8.0f events/tick  checksum %016llx\n",
+               threads, stats.seconds * 1e6 / stats.ticks, stats.maxSeconds * 1e6,
+               (double)stats.events / stats.ticks, (unsigned long long)checksum);
+        // What stays on the calling thread caps what any number of threads can gain
+        double serial = stats.seconds > 0 ? stats.serialSeconds / stats.seconds : 1.0;
+        printf("            %9.1f us/tick on one thread (%.0f%% serial, at most %.2fx from more threads)\n",
+               stats.serialSeconds * 1e6 / stats.ticks, serial * 100, serial > 0 ? 1.0 / serial : 0.0);
+    }
+    gameOutput.setSink(nullptr);
+    return 0;
+}
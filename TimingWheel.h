@@ -0,0 +1,77 @@
+#ifndef TIMING_WHEEL_H
+#define TIMING_WHEEL_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+using namespace std;
+
+// Hashed timing wheel: events are filed in the slot of the tick they are due on, so
+// advancing one tick only looks at that slot. Delays longer than the wheel simply wait
+// in their slot for extra revolutions (each entry keeps its exact due tick).
+//
+// Events due on the same tick fire in the order they were scheduled, which keeps a
+// seeded simulation reproducible.
+template<typename Event, int SLOTS = 256>
+class TimingWheel {
+    static_assert((SLOTS & (SLOTS - 1)) == 0, "SLOTS must be a power of two");
+
+private:
+    struct Entry {
+        uint64_t due;
+        Event event;
+    };
+
+    vector<vector<Entry>> slots;
+    vector<Entry> firing; // Scratch: the current slot while it is processed
+    uint64_t now;
+    size_t pending;
+
+public:
+    TimingWheel() : slots(SLOTS), now(0), pending(0) {}
+
+    // Fires `delay` ticks from now (at least one)
+    void schedule(uint64_t delay, const Event& event) {
+        if(delay == 0) delay = 1;
+        uint64_t due = now + delay;
+        slots[due & (SLOTS - 1)].push_back(Entry{due, event});
+        pending++;
+    }
+
+    // Moves to the next tick and calls fire(event) for everything due on it. Events
+    // scheduled from inside fire are never due before the next tick.
+    // Returns how many fired.
+    template<typename Fire>
+    size_t advance(Fire fire) {
+        now++;
+        vector<Entry>& slot = slots[now & (SLOTS - 1)];
+        if(slot.empty()) return 0;
+
+        firing.swap(slot);
+        size_t fired = 0;
+        for(Entry& entry : firing) {
+            if(entry.due != now) {
+                slot.push_back(entry); // A later revolution
+            }
+        }
+        for(Entry& entry : firing) {
+            if(entry.due == now) {
+                pending--;
+                fired++;
+                fire(entry.event);
+            }
+        }
+        firing.clear();
+        return fired;
+    }
+
+    void clear() {
+        for(vector<Entry>& slot : slots) slot.clear();
+        pending = 0;
+    }
+
+    uint64_t getNow() const { return now; }
+    size_t getPending() const { return pending; }
+};
+
+#endif
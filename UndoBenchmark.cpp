@@ -0,0 +1,109 @@
+// Undo history over a long session on a generated map: the player wanders while the
+// living world moves its monsters, and every step is captured. Reports the memory the
+// history takes against a whole copy of the game per step, the time to capture a step,
+// and the time to undo every step and redo them again, checking each restored step
+// against the state hash it was captured with.
+// Usage: UndoBenchmark [size] [steps] [seed] [living 0/1]
+#include "WorldHistory.h"
+#include "WorldSimulation.h"
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+using namespace std;
+
+thread_local GameOutput gameOutput;
+
+static double megabytes(size_t bytes)
+{
+    return bytes / (1024.0 * 1024.0);
+}
+
+int main(int argc, char* argv[])
+{
+    int size = argc > 1 ? atoi(argv[1]) : 128;
+    int steps = argc > 2 ? atoi(argv[2]) : 10000;
+    uint64_t seed = argc > 3 ? strtoull(argv[3], nullptr, 10) : 1;
+    bool living = argc > 4 ? atoi(argv[4]) != 0 : true;
+    if(size < 16 || steps < 1)
+    {
+        cerr << "Usage: " << argv[0] << " [size >= 16] [steps >= 1] [seed] [living 0/1]" << endl;
+        return 1;
+    }
+
+    NullSink discard;
+    gameOutput.setSink(&discard);
+    Dungeon dungeon(size, size, "Benchmark", seed);
+    Character hero("Hero", dungeon.getEntranceX(), dungeon.getEntranceY(), 1);
+    dungeon.setPlayer(&hero);
+    WorldSimulation world;
+    world.setEnabled(living);
+    world.reset(&dungeon, &hero);
+    printf("%dx%d map, %d items, %d monsters, %d steps%s\n", size, size, dungeon.getAllItems().size(),
+           dungeon.getAllMonsters().size(), steps, living ? ", living world" : "");
+
+    WorldHistory history(steps);
+    auto start = chrono::steady_clock::now();
+    history.capture(dungeon, false, dungeon.getStateHash());
+    double firstSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    HistoryStats first = history.measure();
+
+    // Captures go one per step even when the player bumped into a wall and nothing moved
+    Random rng(seed ^ 0xBE7Cull);
+    const char directions[] = {'n', 's', 'e', 'w'};
+    vector<uint64_t> hashes;
+    vector<double> captureSeconds;
+    hashes.push_back(history.getHash());
+    for(int i = 0; i < steps; i++)
+    {
+        dungeon.movePlayer(directions[rng.range(0, 3)]);
+        world.advance(WorldSimulation::TURN_MS);
+        dungeon.clearDirty();
+        auto before = chrono::steady_clock::now();
+        if(history.capture(dungeon, false, dungeon.getStateHash())) hashes.push_back(history.getHash());
+        captureSeconds.push_back(chrono::duration<double>(chrono::steady_clock::now() - before).count());
+    }
+    HistoryStats stats = history.measure();
+
+    int mismatches = 0;
+    bool won = false;
+    start = chrono::steady_clock::now();
+    for(size_t i = hashes.size() - 1; i > 0; i--)
+    {
+        history.undo(dungeon, won);
+        if(dungeon.getStateHash() != hashes[i - 1]) mismatches++;
+    }
+    double undoSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    if(dungeon.getStateHash() != dungeon.computeStateHash()) mismatches++;
+    start = chrono::steady_clock::now();
+    for(size_t i = 1; i < hashes.size(); i++)
+    {
+        history.redo(dungeon, won);
+        if(dungeon.getStateHash() != hashes[i]) mismatches++;
+    }
+    double redoSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    if(dungeon.getStateHash() != dungeon.computeStateHash()) mismatches++;
+
+    size_t added = stats.bytes - first.bytes;
+    size_t changed = hashes.size() - 1;
+    sort(captureSeconds.begin(), captureSeconds.end());
+    double captureTotal = 0;
+    for(double s : captureSeconds) captureTotal += s;
+    printf("First capture: %.1f MB (%zu chunks, %zu nodes) in %.1f ms\n", megabytes(first.bytes), first.chunks,
+           first.nodes, firstSeconds * 1e3);
+    printf("History: %zu steps that changed something, %.1f MB (%zu chunks, %zu nodes)\n", changed,
+           megabytes(stats.bytes), stats.chunks, stats.nodes);
+    printf("  %.1f KB per step on top of the first capture; a whole copy per step would take %.1f MB (%.0fx)\n",
+           changed ? added / 1024.0 / changed : 0.0, megabytes(stats.fullBytes),
+           stats.bytes ? (double)stats.fullBytes / stats.bytes : 0.0);
+    printf("Capture: %.1f us average, %.1f us p99, %.1f us slowest\n", captureTotal * 1e6 / steps,
+           captureSeconds[captureSeconds.size() * 99 / 100] * 1e6, captureSeconds.back() * 1e6);
+    printf("Undo %.1f us/step, redo %.1f us/step, %s\n", changed ? undoSeconds * 1e6 / changed : 0.0,
+           changed ? redoSeconds * 1e6 / changed : 0.0,
+           mismatches ? "RESTORED STATE DIFFERS" : "every restored step matches its hash");
+    dungeon.setPlayer(nullptr); // The hero is destroyed first
+    gameOutput.setSink(nullptr);
+    return mismatches ? 1 : 0;
+}
@@ -0,0 +1,556 @@
+#ifndef WORLD_HISTORY_H
+#define WORLD_HISTORY_H
+
+#include "Dungeon.h"
+#include "SaveFormat.h"
+#include <vector>
+#include <deque>
+#include <memory>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstdint>
+using namespace std;
+
+// An immutable array of chunks, stored as a trie of BRANCH-way nodes so versions can share
+// it. with() builds a new version that copies only the nodes on the way to the chunks it
+// replaces; every other node and chunk is shared with the old version.
+class ChunkTrie {
+public:
+    typedef vector<uint8_t> Chunk;
+    typedef pair<uint32_t, shared_ptr<const Chunk>> Update;
+
+    static const int BITS = 4;
+    static const uint32_t BRANCH = 1u << BITS;
+
+private:
+    struct Node {
+        shared_ptr<const void> slots[BRANCH]; // Nodes, or chunks in the bottom level
+    };
+
+    shared_ptr<const Node> root;
+    int height; // Levels of nodes; the trie holds BRANCH^height chunks
+
+    static shared_ptr<const void> update(const Node* node, int level, const Update* first, const Update* last) {
+        shared_ptr<Node> copy = node ? make_shared<Node>(*node) : make_shared<Node>();
+        int shift = BITS * (level - 1);
+        while(first != last) {
+            uint32_t slot = (first->first >> shift) & (BRANCH - 1);
+            const Update* end = first + 1;
+            while(end != last && ((end->first >> shift) & (BRANCH - 1)) == slot) end++;
+            if(level == 1) {
+                copy->slots[slot] = first->second;
+            } else {
+                copy->slots[slot] = update(static_cast<const Node*>(copy->slots[slot].get()), level - 1, first, end);
+            }
+            first = end;
+        }
+        return copy;
+    }
+
+    // Indices (from base) of chunks that differ between two subtrees of the same level
+    static void diff(const void* a, const void* b, int level, uint32_t base, vector<uint32_t>& out) {
+        if(a == b) return;
+        if(level == 0) {
+            out.push_back(base);
+            return;
+        }
+        const Node* na = static_cast<const Node*>(a);
+        const Node* nb = static_cast<const Node*>(b);
+        int shift = BITS * (level - 1);
+        for(uint32_t i = 0; i < BRANCH; i++) {
+            diff(na ? na->slots[i].get() : nullptr, nb ? nb->slots[i].get() : nullptr, level - 1,
+                 base + (i << shift), out);
+        }
+    }
+
+    static void measure(const void* p, int level, unordered_set<const void*>& seen, size_t& nodes,
+                        size_t& chunks, size_t& bytes) {
+        if(!p || !seen.insert(p).second) return;
+        if(level == 0) {
+            chunks++;
+            bytes += sizeof(Chunk) + static_cast<const Chunk*>(p)->capacity();
+            return;
+        }
+        nodes++;
+        bytes += sizeof(Node);
+        const Node* node = static_cast<const Node*>(p);
+        for(uint32_t i = 0; i < BRANCH; i++) {
+            measure(node->slots[i].get(), level - 1, seen, nodes, chunks, bytes);
+        }
+    }
+
+    // The same chunks under a taller root
+    ChunkTrie raised(int levels) const {
+        ChunkTrie t = *this;
+        while(t.height < levels) {
+            if(t.root) {
+                shared_ptr<Node> top = make_shared<Node>();
+                top->slots[0] = t.root;
+                t.root = top;
+            }
+            t.height++;
+        }
+        return t;
+    }
+
+public:
+    ChunkTrie() : height(1) {}
+
+    shared_ptr<const Chunk> get(uint32_t index) const {
+        if(height * BITS < 32 && (index >> (height * BITS)) != 0) return nullptr;
+        const Node* node = root.get();
+        for(int level = height; node && level > 1; level--) {
+            node = static_cast<const Node*>(node->slots[(index >> (BITS * (level - 1))) & (BRANCH - 1)].get());
+        }
+        if(!node) return nullptr;
+        return static_pointer_cast<const Chunk>(node->slots[index & (BRANCH - 1)]);
+    }
+
+    // `updates` must be sorted by index, each index once
+    ChunkTrie with(const vector<Update>& updates) const {
+        if(updates.empty()) return *this;
+        int levels = height;
+        while(levels * BITS < 32 && (updates.back().first >> (levels * BITS)) != 0) levels++;
+        ChunkTrie t = raised(levels);
+        t.root = static_pointer_cast<const Node>(update(t.root.get(), t.height, updates.data(),
+                                                        updates.data() + updates.size()));
+        return t;
+    }
+
+    // Indices of the chunks two versions do not share, in increasing order. Shared subtrees
+    // are skipped whole, so this costs what changed rather than the size of the array.
+    static void diff(const ChunkTrie& a, const ChunkTrie& b, vector<uint32_t>& out) {
+        int levels = max(a.height, b.height);
+        ChunkTrie ra = a.raised(levels);
+        ChunkTrie rb = b.raised(levels);
+        diff(ra.root.get(), rb.root.get(), levels, 0, out);
+    }
+
+    // Whether two versions are one and the same
+    bool sameAs(const ChunkTrie& other) const { return root == other.root; }
+
+    // Counts nodes and chunks not in `seen` yet, so shared ones are counted once
+    void measure(unordered_set<const void*>& seen, size_t& nodes, size_t& chunks, size_t& bytes) const {
+        measure(root.get(), height, seen, nodes, chunks, bytes);
+    }
+};
+
+// What a history holds, for the memory report
+struct HistoryStats {
+    size_t steps;
+    size_t chunks;       // Distinct chunks over all steps
+    size_t nodes;        // Distinct trie nodes
+    size_t bytes;        // Both, counted once however many steps share them
+    size_t fullBytes;    // What a whole copy of the game per step would take instead
+};
+
+// Undo/redo over persistent snapshots of one dungeon and its player.
+//
+// The game is cut into chunks: runs of CELLS_PER_CHUNK cells in row order, runs of
+// ENTITIES_PER_CHUNK items and of monsters (in the order the dungeon holds them), and the
+// player. A chunk is the bytes a save holds for that part, except that a run of cells
+// keeps its terrain (type, description, flags) and its occupants (the ids lying there) in
+// separate chunks: monsters walk every turn, and their steps should not copy the
+// descriptions of the cells they cross. Each step keeps its chunks in ChunkTries, so a step
+// shares every chunk that did not change with the one before it: taking a step costs the
+// chunks its command touched plus the trie nodes above them, and stepping back or forward
+// rewrites only the chunks that differ between the two steps.
+//
+// What a command touched comes from the dungeon's state hash, which notes the subject of
+// every change in a journal; no part of the world is serialized unless it was written to,
+// and a rewritten chunk that came out the same as before is shared rather than stored
+// again. The first capture copies the whole world in.
+class WorldHistory {
+public:
+    static const int CELLS_PER_CHUNK = 16;
+    static const int ENTITIES_PER_CHUNK = 16;
+
+private:
+    struct Step {
+        ChunkTrie terrain, occupants, items, monsters;
+        shared_ptr<const ChunkTrie::Chunk> player;
+        int itemCount, monsterCount;
+        int nextId;
+        bool won;
+        uint64_t hash;     // The game's state hash as captured
+        size_t bytes;      // Sum of this step's chunk sizes
+    };
+
+    Dungeon* world;               // Whose journal feeds `changes`
+    vector<uint64_t> changes;     // Subjects changed since the last capture
+    deque<Step> steps;
+    size_t current;               // The step the world is in
+    size_t limit;                 // Steps that can be undone
+    unordered_map<int, int> itemSlots;    // Id -> index in the dungeon's items
+    unordered_map<int, int> monsterSlots;
+    SaveWriter out;               // Chunks are written here, then copied out at their exact size
+
+    shared_ptr<const ChunkTrie::Chunk> seal() {
+        shared_ptr<const ChunkTrie::Chunk> chunk = make_shared<const ChunkTrie::Chunk>(out.data());
+        out.clear();
+        return chunk;
+    }
+
+    shared_ptr<const ChunkTrie::Chunk> terrainChunk(const Dungeon& dungeon, uint32_t chunk) {
+        int cells = dungeon.getWidth() * dungeon.getHeight();
+        int last = min(cells, (int)(chunk + 1) * CELLS_PER_CHUNK);
+        for(int cell = chunk * CELLS_PER_CHUNK; cell < last; cell++) {
+            dungeon.getLocation(cell % dungeon.getWidth(), cell / dungeon.getWidth())->serialize(out);
+        }
+        return seal();
+    }
+
+    shared_ptr<const ChunkTrie::Chunk> occupantChunk(const Dungeon& dungeon, uint32_t chunk) {
+        int cells = dungeon.getWidth() * dungeon.getHeight();
+        int last = min(cells, (int)(chunk + 1) * CELLS_PER_CHUNK);
+        for(int cell = chunk * CELLS_PER_CHUNK; cell < last; cell++) {
+            const Location* loc = dungeon.getLocation(cell % dungeon.getWidth(), cell / dungeon.getWidth());
+            out.writeU32((uint32_t)loc->getItems().size());
+            for(const Item* item : loc->getItems()) out.writeI32(item->getId());
+            out.writeU32((uint32_t)loc->getMonsters().size());
+            for(const Monster* monster : loc->getMonsters()) out.writeI32(monster->getId());
+        }
+        return seal();
+    }
+
+    template<typename T>
+    shared_ptr<const ChunkTrie::Chunk> entityChunk(const vector<T*>& all, uint32_t chunk) {
+        size_t last = min(all.size(), (size_t)(chunk + 1) * ENTITIES_PER_CHUNK);
+        for(size_t i = (size_t)chunk * ENTITIES_PER_CHUNK; i < last; i++) all[i]->serialize(out);
+        return seal();
+    }
+
+    shared_ptr<const ChunkTrie::Chunk> playerChunk(const Dungeon& dungeon) {
+        if(dungeon.getPlayer()) dungeon.getPlayer()->serialize(out);
+        return seal();
+    }
+
+    // Rewrites the chunks listed in `dirty` (may repeat) into a new version of `trie`,
+    // keeping those that come out as they were
+    template<typename MakeChunk>
+    static ChunkTrie rewrite(const ChunkTrie& trie, vector<uint32_t>& dirty, size_t& bytes, MakeChunk make) {
+        sort(dirty.begin(), dirty.end());
+        dirty.erase(unique(dirty.begin(), dirty.end()), dirty.end());
+        vector<ChunkTrie::Update> updates;
+        updates.reserve(dirty.size());
+        for(uint32_t chunk : dirty) {
+            shared_ptr<const ChunkTrie::Chunk> old = trie.get(chunk);
+            shared_ptr<const ChunkTrie::Chunk> made = make(chunk);
+            if(old && *old == *made) continue;
+            bytes += made->size();
+            if(old) bytes -= old->size();
+            updates.push_back(ChunkTrie::Update(chunk, made));
+        }
+        return trie.with(updates);
+    }
+
+    // Learns the ids of entities added since `known` and marks their chunks changed
+    template<typename T>
+    static void noteAdded(const vector<T*>& all, int known, unordered_map<int, int>& slots, vector<uint32_t>& dirty) {
+        for(int i = known; i < (int)all.size(); i++) {
+            slots[all[i]->getId()] = i;
+            dirty.push_back(i / ENTITIES_PER_CHUNK);
+        }
+    }
+
+    void takeWhole(Dungeon& dungeon, bool won, uint64_t hash) {
+        Step step;
+        step.bytes = 0;
+        const vector<Item*>& items = dungeon.getAllItems().getAll();
+        const vector<Monster*>& monsters = dungeon.getAllMonsters().getAll();
+        vector<uint32_t> cellChunks, itemChunks, monsterChunks;
+        int cells = dungeon.getWidth() * dungeon.getHeight();
+        for(int chunk = 0; chunk * CELLS_PER_CHUNK < cells; chunk++) cellChunks.push_back(chunk);
+        itemSlots.clear();
+        monsterSlots.clear();
+        noteAdded(items, 0, itemSlots, itemChunks);
+        noteAdded(monsters, 0, monsterSlots, monsterChunks);
+
+        step.terrain = rewrite(ChunkTrie(), cellChunks, step.bytes,
+                               [&](uint32_t c) { return terrainChunk(dungeon, c); });
+        step.occupants = rewrite(ChunkTrie(), cellChunks, step.bytes,
+                                 [&](uint32_t c) { return occupantChunk(dungeon, c); });
+        step.items = rewrite(ChunkTrie(), itemChunks, step.bytes,
+                             [&](uint32_t c) { return entityChunk(items, c); });
+        step.monsters = rewrite(ChunkTrie(), monsterChunks, step.bytes,
+                                [&](uint32_t c) { return entityChunk(monsters, c); });
+        step.player = playerChunk(dungeon);
+        step.bytes += step.player->size();
+        step.itemCount = (int)items.size();
+        step.monsterCount = (int)monsters.size();
+        step.nextId = dungeon.getNextId();
+        step.won = won;
+        step.hash = hash;
+        steps.push_back(step);
+        current = 0;
+    }
+
+    // Makes the world match `to`; it matches `from` now
+    void restore(Dungeon& dungeon, const Step& from, const Step& to) {
+        vector<uint32_t> terrainChunks, occupantChunks, itemChunks, monsterChunks;
+        ChunkTrie::diff(from.terrain, to.terrain, terrainChunks);
+        ChunkTrie::diff(from.occupants, to.occupants, occupantChunks);
+        ChunkTrie::diff(from.items, to.items, itemChunks);
+        ChunkTrie::diff(from.monsters, to.monsters, monsterChunks);
+        int width = dungeon.getWidth();
+        int cells = width * dungeon.getHeight();
+
+        // Empty the changed cells first, so entities can move between any of them
+        for(uint32_t chunk : occupantChunks) {
+            int last = min(cells, (int)(chunk + 1) * CELLS_PER_CHUNK);
+            for(int cell = chunk * CELLS_PER_CHUNK; cell < last; cell++) {
+                Location* loc = dungeon.getLocation(cell % width, cell / width);
+                while(!loc->getItems().empty()) loc->removeItem(loc->getItems().back()->getId());
+                while(!loc->getMonsters().empty()) loc->removeMonster(loc->getMonsters().back()->getId());
+            }
+        }
+
+        // Entities only ever join the end, so those the target step lacks are the newest
+        while(dungeon.getAllItems().size() > to.itemCount) {
+            itemSlots.erase(dungeon.getAllItems().getAll().back()->getId());
+            dungeon.dropLastItem();
+        }
+        while(dungeon.getAllMonsters().size() > to.monsterCount) {
+            monsterSlots.erase(dungeon.getAllMonsters().getAll().back()->getId());
+            dungeon.dropLastMonster();
+        }
+        for(uint32_t chunk : itemChunks) {
+            SaveReader in(*to.items.get(chunk), SaveSchema::VERSION);
+            int last = min(to.itemCount, (int)(chunk + 1) * ENTITIES_PER_CHUNK);
+            for(int i = chunk * ENTITIES_PER_CHUNK; i < last; i++) {
+                if(i < dungeon.getAllItems().size()) {
+                    dungeon.restoreItem(dungeon.getAllItems().getAll()[i], in);
+                } else {
+                    Item* item = new Item();
+                    item->deserialize(in);
+                    dungeon.adoptItem(item);
+                    itemSlots[item->getId()] = i;
+                }
+            }
+        }
+        for(uint32_t chunk : monsterChunks) {
+            SaveReader in(*to.monsters.get(chunk), SaveSchema::VERSION);
+            int last = min(to.monsterCount, (int)(chunk + 1) * ENTITIES_PER_CHUNK);
+            for(int i = chunk * ENTITIES_PER_CHUNK; i < last; i++) {
+                if(i < dungeon.getAllMonsters().size()) {
+                    dungeon.restoreMonster(dungeon.getAllMonsters().getAll()[i], in);
+                } else {
+                    Monster* monster = new Monster();
+                    monster->deserialize(in);
+                    dungeon.adoptMonster(monster);
+                    monsterSlots[monster->getId()] = i;
+                }
+            }
+        }
+
+        // Then refill the cells from the target step
+        for(uint32_t chunk : terrainChunks) {
+            SaveReader in(*to.terrain.get(chunk), SaveSchema::VERSION);
+            int last = min(cells, (int)(chunk + 1) * CELLS_PER_CHUNK);
+            for(int cell = chunk * CELLS_PER_CHUNK; cell < last; cell++) {
+                int x = cell % width;
+                int y = cell / width;
+                Location* loc = dungeon.getLocation(x, y);
+                Location saved;
+                saved.deserialize(in);
+                loc->setType(saved.getType());
+                loc->setDescription(saved.getDescription());
+                loc->setVisited(saved.getVisited());
+                if(loc->canAccess() != saved.canAccess()) dungeon.setAccessible(x, y, saved.canAccess());
+                dungeon.markDirty(x, y);
+            }
+        }
+        const vector<Item*>& items = dungeon.getAllItems().getAll();
+        const vector<Monster*>& monsters = dungeon.getAllMonsters().getAll();
+        for(uint32_t chunk : occupantChunks) {
+            SaveReader in(*to.occupants.get(chunk), SaveSchema::VERSION);
+            int last = min(cells, (int)(chunk + 1) * CELLS_PER_CHUNK);
+            for(int cell = chunk * CELLS_PER_CHUNK; cell < last; cell++) {
+                Location* loc = dungeon.getLocation(cell % width, cell / width);
+                int cellItems = in.readCount(4);
+                for(int k = 0; k < cellItems; k++) loc->addItem(items[itemSlots.at(in.readI32())]);
+                int cellMonsters = in.readCount(4);
+                for(int k = 0; k < cellMonsters; k++) loc->addMonster(monsters[monsterSlots.at(in.readI32())]);
+                dungeon.markDirty(cell % width, cell / width);
+            }
+        }
+
+        if(from.player != to.player) {
+            SaveReader in(*to.player, SaveSchema::VERSION);
+            dungeon.restorePlayer(in);
+        }
+        dungeon.restoreNextId(to.nextId);
+        // The world is exactly `to` again, which needs no new step
+        changes.clear();
+    }
+
+public:
+    static const size_t DEFAULT_LIMIT = 100;
+
+    explicit WorldHistory(size_t steps = DEFAULT_LIMIT) : world(nullptr), current(0), limit(steps) {}
+
+    // The dungeon's journal points into this, so a dungeon that outlives it stops writing there
+    ~WorldHistory() { clear(); }
+
+    WorldHistory(const WorldHistory&) = delete;
+    WorldHistory& operator=(const WorldHistory&) = delete;
+
+    // Forgets every step and stops following the dungeon; call before it is deleted or replaced
+    void clear() {
+        if(world) world->setChangeJournal(nullptr);
+        world = nullptr;
+        steps.clear();
+        changes.clear();
+        itemSlots.clear();
+        monsterSlots.clear();
+        current = 0;
+    }
+
+    // Steps kept for undo; 0 turns the history off
+    void setLimit(size_t steps) {
+        limit = steps;
+        if(limit == 0) clear();
+        trim();
+    }
+
+    size_t getLimit() const { return limit; }
+
+    // Drops the oldest steps beyond the limit
+    void trim() {
+        while(steps.size() > limit + 1 && current > 0) {
+            steps.pop_front();
+            current--;
+        }
+    }
+
+    // Makes the world as it is now a new step if anything changed since the current one,
+    // dropping the steps that could have been redone. The first call copies in the whole
+    // world and starts following its changes. `hash` is the game's state hash, kept to
+    // check restores against. Returns true if a step was added.
+    bool capture(Dungeon& dungeon, bool won, uint64_t hash) {
+        if(limit == 0) return false;
+        if(world != &dungeon) {
+            clear();
+            world = &dungeon;
+            dungeon.setChangeJournal(&changes);
+            takeWhole(dungeon, won, hash);
+            return true;
+        }
+
+        const Step& last = steps[current];
+        const vector<Item*>& items = dungeon.getAllItems().getAll();
+        const vector<Monster*>& monsters = dungeon.getAllMonsters().getAll();
+        vector<uint32_t> cellChunks, itemChunks, monsterChunks;
+        noteAdded(items, last.itemCount, itemSlots, itemChunks);
+        noteAdded(monsters, last.monsterCount, monsterSlots, monsterChunks);
+        bool playerChanged = false;
+        int width = dungeon.getWidth();
+        for(uint64_t subject : changes) {
+            switch(StateHash::kindOf(subject)) {
+                case StateHash::CELL:
+                    cellChunks.push_back((StateHash::cellY(subject) * width + StateHash::cellX(subject)) / CELLS_PER_CHUNK);
+                    break;
+                case StateHash::ITEM: {
+                    auto found = itemSlots.find(StateHash::idOf(subject));
+                    if(found != itemSlots.end()) itemChunks.push_back(found->second / ENTITIES_PER_CHUNK);
+                    break;
+                }
+                case StateHash::MONSTER: {
+                    auto found = monsterSlots.find(StateHash::idOf(subject));
+                    if(found != monsterSlots.end()) monsterChunks.push_back(found->second / ENTITIES_PER_CHUNK);
+                    break;
+                }
+                case StateHash::PLAYER:
+                case StateHash::CARRIED:
+                    playerChanged = true;
+                    break;
+                default:
+                    break; // The dungeon's own fields are compared below
+            }
+        }
+        changes.clear();
+
+        Step step = last;
+        step.terrain = rewrite(last.terrain, cellChunks, step.bytes,
+                               [&](uint32_t c) { return terrainChunk(dungeon, c); });
+        step.occupants = rewrite(last.occupants, cellChunks, step.bytes,
+                                 [&](uint32_t c) { return occupantChunk(dungeon, c); });
+        step.items = rewrite(last.items, itemChunks, step.bytes,
+                             [&](uint32_t c) { return entityChunk(items, c); });
+        step.monsters = rewrite(last.monsters, monsterChunks, step.bytes,
+                                [&](uint32_t c) { return entityChunk(monsters, c); });
+        if(playerChanged) {
+            shared_ptr<const ChunkTrie::Chunk> player = playerChunk(dungeon);
+            if(*player != *last.player) {
+                step.bytes += player->size();
+                step.bytes -= last.player->size();
+                step.player = player;
+            }
+        }
+        step.itemCount = (int)items.size();
+        step.monsterCount = (int)monsters.size();
+        step.nextId = dungeon.getNextId();
+        step.won = won;
+        step.hash = hash;
+        // Writes that put values back as they were leave nothing to undo
+        if(step.terrain.sameAs(last.terrain) && step.occupants.sameAs(last.occupants) &&
+           step.items.sameAs(last.items) && step.monsters.sameAs(last.monsters) && step.player == last.player &&
+           step.itemCount == last.itemCount && step.monsterCount == last.monsterCount &&
+           step.nextId == last.nextId && step.won == last.won) {
+            return false;
+        }
+
+        steps.resize(current + 1);
+        steps.push_back(step);
+        current++;
+        trim();
+        return true;
+    }
+
+    bool canUndo() const { return world && current > 0; }
+    bool canRedo() const { return world && current + 1 < steps.size(); }
+
+    // Puts the dungeon back one step, or forward one undone step, and sets `won` to the
+    // step's; false if there is none
+    bool undo(Dungeon& dungeon, bool& won) {
+        if(!canUndo() || world != &dungeon) return false;
+        restore(dungeon, steps[current], steps[current - 1]);
+        current--;
+        won = steps[current].won;
+        return true;
+    }
+
+    bool redo(Dungeon& dungeon, bool& won) {
+        if(!canRedo() || world != &dungeon) return false;
+        restore(dungeon, steps[current], steps[current + 1]);
+        current++;
+        won = steps[current].won;
+        return true;
+    }
+
+    size_t getSteps() const { return steps.size(); }
+    size_t getCurrent() const { return current; }
+    // State hash the current step was captured with
+    uint64_t getHash() const { return steps.empty() ? 0 : steps[current].hash; }
+
+    // Walks every step once; shared chunks and nodes are counted once
+    HistoryStats measure() const {
+        HistoryStats stats = HistoryStats{steps.size(), 0, 0, 0, 0};
+        unordered_set<const void*> seen;
+        for(const Step& step : steps) {
+            step.terrain.measure(seen, stats.nodes, stats.chunks, stats.bytes);
+            step.occupants.measure(seen, stats.nodes, stats.chunks, stats.bytes);
+            step.items.measure(seen, stats.nodes, stats.chunks, stats.bytes);
+            step.monsters.measure(seen, stats.nodes, stats.chunks, stats.bytes);
+            if(seen.insert(step.player.get()).second) {
+                stats.chunks++;
+                stats.bytes += sizeof(ChunkTrie::Chunk) + step.player->capacity();
+            }
+            stats.fullBytes += step.bytes;
+        }
+        return stats;
+    }
+};
+
+#endif
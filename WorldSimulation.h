@@ -0,0 +1,298 @@
+#ifndef WORLD_SIMULATION_H
+#define WORLD_SIMULATION_H
+
+#include "Dungeon.h"
+#include "FlowField.h"
+#include "TimingWheel.h"
+#include "JobSystem.h"
+#include <vector>
+#include <unordered_set>
+#include <chrono>
+#include <memory>
+#include <cstdint>
+using namespace std;
+
+struct TickStats {
+    long long ticks;
+    long long events;
+    double seconds;       // Spent inside ticks
+    double serialSeconds; // Part of that spent on the calling thread alone, whatever the thread count
+    double maxSeconds;    // Slowest single tick
+    size_t busiest;    // Most events fired by one tick
+};
+
+// Keeps the dungeon alive between commands: monsters wander or chase the player,
+// wounded monsters regenerate through Monster::heal, and new ones spawn out of sight.
+//
+// Game time advances in fixed ticks of TICK_MS. The engine hands it time (one turn per
+// command) and the accumulator runs as many whole ticks as fit, so the outcome depends
+// only on how much game time passed, never on wall-clock speed. Every action is an
+// event on a timing wheel that reschedules itself, so a tick only touches the monsters
+// whose next action is due on it, however many monsters the dungeon holds.
+//
+// A tick runs in two phases. Deciding where each due monster goes only reads the world
+// as it stood at the start of the tick (monsters never block each other, and wandering
+// draws from a hash of seed, tick and monster id rather than a shared generator), so
+// big ticks spread it over a work-stealing pool. Committing hands the moves to
+// Dungeon::moveMonsters, which applies them band by band of rows on the same pool. The
+// chase flow field, moves crossing between bands, rescheduling, regeneration, spawning
+// and messages stay on the calling thread, the last four in schedule order. Every run is identical whatever the
+// thread count. TickBenchmark prints how much of the tick is left serial and the
+// speed-up bound that sets.
+class WorldSimulation {
+public:
+    static const int TICK_MS = 100;      // 10 ticks per second of game time
+    static const int TURN_MS = 1000;     // Game time one command takes
+    static const int REGEN_TICKS = 20;
+    static const int SPAWN_TICKS = 300;
+    static const int SPAWN_ATTEMPTS = 32;
+    static const int PARALLEL_GRAIN = 1024; // Due actions per job; smaller ticks stay on one thread
+
+private:
+    enum EventKind : uint8_t {
+        MONSTER_ACT,
+        MONSTER_REGEN,
+        SPAWN
+    };
+
+    struct WorldEvent {
+        EventKind kind;
+        Monster* monster;
+    };
+
+    // Where an acting monster decided to go, with what committing needs of it, so the
+    // calling thread does not have to touch the monster again
+    struct Intent {
+        int x, y;
+        int fromX, fromY;
+        int delay;        // Ticks until it acts again; 0 = defeated, not rescheduled
+    };
+
+    Dungeon* dungeon;
+    Character* player;
+    TimingWheel<WorldEvent> wheel;
+    FlowField chaseField;
+    Random rng;
+    bool enabled;
+    bool chase;
+    int accumulatorMs;
+    int liveMonsters;  // Defeated monsters are noticed when their next action comes up
+    int populationCap; // Spawning tops the dungeon back up to its starting population
+    unordered_set<const Monster*> healing;
+    TickStats stats;
+    uint64_t wanderSeed;
+    int threads;                 // 0 = every core
+    unique_ptr<JobSystem> jobs;  // Started the first time a tick is big enough
+    vector<WorldEvent> due;      // This tick's events, in schedule order
+    vector<Intent> intents;      // Parallel to due
+    vector<MonsterMove> moves;   // This tick's steps, in schedule order
+
+    // Ticks between a monster's actions; heavier monsters are slower
+    static int actInterval(const Monster* monster) {
+        switch(monster->getType()) {
+            case MonsterType::GOBLIN: return 8;
+            case MonsterType::SKELETON: return 10;
+            case MonsterType::ORC: return 12;
+            case MonsterType::TROLL: return 15;
+            case MonsterType::DRAGON: return 20;
+            default: return 10;
+        }
+    }
+
+    // Reads only the world as of the start of the tick; safe to run concurrently
+    Intent decide(const Monster* monster, int px, int py, uint64_t tick) const {
+        int mx = monster->getX();
+        int my = monster->getY();
+        if(!monster->getActive() || monster->getDefeated()) return Intent{mx, my, mx, my, 0};
+        int interval = actInterval(monster);
+        if(mx == px && my == py) return Intent{mx, my, mx, my, interval}; // Wait for the fight
+
+        int nx, ny;
+        if(chase && chaseField.nextStep(mx, my, nx, ny)) return Intent{nx, ny, mx, my, interval};
+
+        // Nothing to hunt: amble about now and then
+        static const int dx[4] = {0, 0, 1, -1};
+        static const int dy[4] = {-1, 1, 0, 0};
+        uint64_t h = wanderSeed ^ (tick * 0x9E3779B97F4A7C15ull) ^ (uint64_t)(uint32_t)monster->getId();
+        int d = (int)(Random::splitMix(h) & 7);
+        if(d < 4 && dungeon->isAccessible(mx + dx[d], my + dy[d])) {
+            return Intent{mx + dx[d], my + dy[d], mx, my, 2 * interval};
+        }
+        return Intent{mx, my, mx, my, 2 * interval};
+    }
+
+    static bool steps(const Intent& intent) {
+        return intent.delay > 0 && (intent.x != intent.fromX || intent.y != intent.fromY);
+    }
+
+    // Everything but the step itself, which moveMonsters has taken by now
+    void commitAct(Monster* monster, const Intent& intent) {
+        if(intent.delay == 0) {
+            liveMonsters--;
+            return; // Not rescheduled
+        }
+        if(steps(intent) && intent.x == player->getX() && intent.y == player->getY()) {
+            gameOutput << monster->getName() << " catches up with you!\n";
+        }
+        wheel.schedule(intent.delay, WorldEvent{MONSTER_ACT, monster});
+    }
+
+    void regenerate(Monster* monster) {
+        if(monster->getDefeated() || monster->getHealth() >= monster->getMaxHealth()) {
+            healing.erase(monster);
+            return;
+        }
+        int amount = monster->getMaxHealth() / 20;
+        monster->heal(amount > 0 ? amount : 1);
+        wheel.schedule(REGEN_TICKS, WorldEvent{MONSTER_REGEN, monster});
+    }
+
+    // A new monster in a random open cell the player cannot see
+    void spawn() {
+        wheel.schedule(SPAWN_TICKS, WorldEvent{SPAWN, nullptr});
+        if(liveMonsters >= populationCap) return;
+        for(int attempt = 0; attempt < SPAWN_ATTEMPTS; attempt++) {
+            int x = rng.range(0, dungeon->getWidth() - 1);
+            int y = rng.range(0, dungeon->getHeight() - 1);
+            if(!dungeon->isAccessible(x, y) || dungeon->isInSight(x, y)) continue;
+            if(x == player->getX() && y == player->getY()) continue;
+            const vector<MonsterSpawn>& table = SpawnTables::monsters();
+            Monster* monster = dungeon->spawnMonster(table[SpawnTables::pick(table, rng)], x, y);
+            if(!monster) return;
+            liveMonsters++;
+            wheel.schedule(actInterval(monster), WorldEvent{MONSTER_ACT, monster});
+            return;
+        }
+    }
+
+    void tick() {
+        auto start = chrono::steady_clock::now();
+        due.clear();
+        wheel.advance([this](const WorldEvent& event) { due.push_back(event); });
+        uint64_t now = wheel.getNow();
+
+        // Decide
+        int px = player->getX();
+        int py = player->getY();
+        if(chase) chaseField.update(*dungeon, px, py);
+        intents.resize(due.size());
+        function<void(int, int)> decideRange = [this, px, py, now](int begin, int end) {
+            for(int i = begin; i < end; i++) {
+                if(due[i].kind == MONSTER_ACT) intents[i] = decide(due[i].monster, px, py, now);
+            }
+        };
+        auto decideStart = chrono::steady_clock::now();
+        if((int)due.size() > PARALLEL_GRAIN && threads != 1) {
+            if(!jobs) jobs.reset(new JobSystem(threads));
+            jobs->parallelFor((int)due.size(), PARALLEL_GRAIN, decideRange);
+        } else {
+            decideRange(0, (int)due.size());
+        }
+        double decideSeconds = chrono::duration<double>(chrono::steady_clock::now() - decideStart).count();
+
+        // Commit: the steps first, by band, then the rest in the order the events were scheduled
+        moves.clear();
+        for(size_t i = 0; i < due.size(); i++) {
+            const Intent& intent = intents[i];
+            if(due[i].kind == MONSTER_ACT && steps(intent)) {
+                moves.push_back(MonsterMove{due[i].monster, intent.fromY, intent.x, intent.y});
+            }
+        }
+        double bandSeconds = 0;
+        dungeon->moveMonsters(moves, (int)moves.size() > PARALLEL_GRAIN ? jobs.get() : nullptr, &bandSeconds);
+        for(size_t i = 0; i < due.size(); i++) {
+            switch(due[i].kind) {
+                case MONSTER_ACT: commitAct(due[i].monster, intents[i]); break;
+                case MONSTER_REGEN: regenerate(due[i].monster); break;
+                case SPAWN: spawn(); break;
+            }
+        }
+
+        auto end = chrono::steady_clock::now();
+        double seconds = chrono::duration<double>(end - start).count();
+        stats.ticks++;
+        stats.events += due.size();
+        stats.seconds += seconds;
+        stats.serialSeconds += seconds - decideSeconds - bandSeconds;
+        if(seconds > stats.maxSeconds) stats.maxSeconds = seconds;
+        if(due.size() > stats.busiest) stats.busiest = due.size();
+    }
+
+public:
+    WorldSimulation()
+        : dungeon(nullptr), player(nullptr), rng(1), enabled(false), chase(false), accumulatorMs(0),
+          liveMonsters(0), populationCap(0), wanderSeed(0), threads(0) {
+        stats = TickStats{0, 0, 0, 0, 0, 0};
+    }
+
+    // Schedules every live monster of a new or loaded world; pending events of the old one are dropped
+    void reset(Dungeon* world, Character* hero) {
+        dungeon = world;
+        player = hero;
+        wheel.clear();
+        healing.clear();
+        chaseField.invalidate();
+        accumulatorMs = 0;
+        liveMonsters = 0;
+        if(!enabled || !dungeon || !player) return;
+
+        rng = Random(dungeon->getSeed() ^ 0x5EEDull);
+        wanderSeed = rng.next();
+        for(Monster* monster : dungeon->getAllMonsters().getAll()) {
+            if(!monster->getActive() || monster->getDefeated()) continue;
+            liveMonsters++;
+            // Spread the first actions out so monsters do not all move on the same tick
+            wheel.schedule(rng.range(1, actInterval(monster)), WorldEvent{MONSTER_ACT, monster});
+            noteWounded(monster);
+        }
+        populationCap = liveMonsters;
+        wheel.schedule(SPAWN_TICKS, WorldEvent{SPAWN, nullptr});
+    }
+
+    void setEnabled(bool on) {
+        if(on == enabled) return;
+        enabled = on;
+        reset(dungeon, player);
+    }
+
+    // Chasing is one of the simulated behaviours, so it switches the simulation on
+    void setChase(bool on) {
+        chase = on;
+        chaseField.invalidate();
+        if(on) setEnabled(true);
+    }
+
+    bool isEnabled() const { return enabled; }
+    bool isChasing() const { return chase; }
+
+    // Threads for big ticks, counting the caller; 0 = every core, 1 = never start a pool
+    void setThreads(int count) {
+        threads = count > 0 ? count : 0;
+        jobs.reset();
+    }
+
+    // Starts regeneration for a monster that took damage (no-op if already healing)
+    void noteWounded(Monster* monster) {
+        if(!enabled || !monster || monster->getDefeated()) return;
+        if(monster->getHealth() >= monster->getMaxHealth()) return;
+        if(healing.insert(monster).second) {
+            wheel.schedule(REGEN_TICKS, WorldEvent{MONSTER_REGEN, monster});
+        }
+    }
+
+    // Runs every whole tick that fits into the time passed so far
+    void advance(int milliseconds) {
+        if(!enabled || !dungeon || !player) return;
+        accumulatorMs += milliseconds;
+        while(accumulatorMs >= TICK_MS) {
+            accumulatorMs -= TICK_MS;
+            tick();
+        }
+    }
+
+    const TickStats& getStats() const { return stats; }
+    size_t getPendingEvents() const { return wheel.getPending(); }
+    int getLiveMonsters() const { return liveMonsters; }
+};
+
+#endif
@@ -1,15 +1,165 @@
 #include "GameEngine.h"
 #include "GameExceptions.h"
 #include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
 using namespace std;
 
-int main()
+// Usage: game [--seed <n> [--size <w>x<h>]] [--living] [--chase] [--threads <n>] [--flee <percent>] [--quick-combat]
+//             [--script <file> [--verbose]] [--record <file>] [--undo <steps>]
+//        game --replay <file> [--verify] [--verbose]
+//   --seed generates the dungeon from a seed instead of using the fixed one
+//   --living lets monsters wander, heal and respawn as turns pass
+//   --chase does that too and makes nearby monsters hunt the player
+//   --threads caps the threads used for big world ticks (default: every core)
+//   --flee ends fights once health drops below <percent> of maximum instead of asking
+//   --quick-combat settles each fight in one step with a single summary line
+//   --script runs the commands in <file> headless and reports commands per second
+//   --record writes the session (starting world, commands and combat answers) to <file>
+//   --undo keeps that many commands for undo (default 100, 0 = off); a replay uses the
+//          recording's setting
+//   --replay re-executes a recorded session at full speed and reports per-command timings;
+//            --verify also checks that it ends in the recorded state
+int main(int argc, char* argv[])
 {
     try
     {
+        const char* scriptFile = nullptr;
+        const char* recordFile = nullptr;
+        const char* replayFile = nullptr;
+        bool verify = false;
+        bool verbose = false;
+        bool chase = false;
+        bool living = false;
+        int threads = 0;
+        int fleePercent = 0;
+        int undoSteps = (int)WorldHistory::DEFAULT_LIMIT;
+        bool quickCombat = false;
+        unsigned long long seed = 0;
+        int width = 40;
+        int height = 40;
+        for(int i = 1; i < argc; i++)
+        {
+            if(strcmp(argv[i], "--script") == 0 && i + 1 < argc)
+            {
+                scriptFile = argv[++i];
+            }
+            else if(strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+            {
+                seed = strtoull(argv[++i], nullptr, 10);
+            }
+            else if(strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+            {
+                if(sscanf(argv[++i], "%dx%d", &width, &height) != 2 || width < 1 || height < 1)
+                {
+                    cout << "Size must look like 80x40" << endl;
+                    return 1;
+                }
+            }
+            else if(strcmp(argv[i], "--chase") == 0)
+            {
+                chase = true;
+            }
+            else if(strcmp(argv[i], "--living") == 0)
+            {
+                living = true;
+            }
+            else if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            {
+                threads = atoi(argv[++i]);
+            }
+            else if(strcmp(argv[i], "--flee") == 0 && i + 1 < argc)
+            {
+                fleePercent = atoi(argv[++i]);
+            }
+            else if(strcmp(argv[i], "--quick-combat") == 0)
+            {
+                quickCombat = true;
+            }
+            else if(strcmp(argv[i], "--verbose") == 0)
+            {
+                verbose = true;
+            }
+            else if(strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+            {
+                recordFile = argv[++i];
+            }
+            else if(strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+            {
+                replayFile = argv[++i];
+            }
+            else if(strcmp(argv[i], "--verify") == 0)
+            {
+                verify = true;
+            }
+            else if(strcmp(argv[i], "--undo") == 0 && i + 1 < argc)
+            {
+                undoSteps = atoi(argv[++i]);
+            }
+        }
+        
+        // Without either flag interactive fights ask after every round
+        CombatPolicy policy(fleePercent > 0 ? CombatPolicy::FLEE_BELOW : CombatPolicy::FIGHT_TO_END, fleePercent,
+                            quickCombat);
+        
+        if(replayFile)
+        {
+            SessionLog log = SessionLog::read(replayFile);
+            // The recording brings its own world; the engine only needs a cheap one to replace
+            GameEngine game;
+            game.setLogEcho(false);
+            game.setWorldThreads(threads);
+            ReplayReport report = game.replay(log, verbose ? &cout : nullptr, verify);
+            printReplayReport(cout, report, log);
+            if(verify && !log.complete)
+            {
+                cout << "The recording has no final state to verify against" << endl;
+            }
+            return report.matched ? 0 : 1;
+        }
+        
+        if(scriptFile)
+        {
+            ifstream script(scriptFile);
+            if(!script.is_open())
+            {
+                cout << "Cannot open script " << scriptFile << endl;
+                return 1;
+            }
+            
+            GameEngine game(seed, width, height);
+            game.setLogEcho(false);
+            game.setWorldSimulation(living);
+            game.setMonsterChase(chase);
+            game.setWorldThreads(threads);
+            game.setUndoLimit(undoSteps);
+            if(recordFile)
+            {
+                game.startRecording(recordFile);
+            }
+            StreamCommandSource source(script);
+            HeadlessReport report = game.runHeadless(source, verbose ? &cout : nullptr, policy);
+            cout << "Headless run: " << game.describeRate(report) << endl;
+            return 0;
+        }
+        
         cout << "Starting Dungeon Crawler Game..." << endl;
         
-        GameEngine game;
+        GameEngine game(seed, width, height);
+        game.setWorldSimulation(living);
+        game.setMonsterChase(chase);
+        game.setWorldThreads(threads);
+        game.setUndoLimit(undoSteps);
+        if(fleePercent > 0 || quickCombat)
+        {
+            game.setCombatPolicy(policy);
+        }
+        if(recordFile)
+        {
+            game.startRecording(recordFile);
+        }
         game.run();
         
         if(game.hasWon()) 